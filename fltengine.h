@@ -0,0 +1,449 @@
+/*
+** fltengine.h
+**
+** The compiled engine for one numeric type. fltiny.c includes this
+** once for each type it runs programs in besides double, with these
+** defined first:
+**
+**    NUM          the numeric type
+**    ENGINE(n)    the name n with the type's suffix
+**    NUMINT       1 for an integer type, else 0
+**    NUMCONST(op) the OP_NUM constant of op as a NUM
+**    NUMPRINT(x)  print x with numberformat
+**    NUMPOW NUMFLOOR NUMCEIL   maths for the type
+**    NUMMATH(fn, x)            a {name} function, if not NUMINT
+**
+** ENGINE(runtyped)() runs the program from the line in the @ register
+** with the variables and stacks held as NUM, and puts them back as
+** double when it returns. The array stays double, and an element is
+** made a NUM as it is fetched and a double again as it is stored, so a
+** run costs nothing for the array it does not touch. It hands over to
+** the double engine when it meets something only that engine does: a
+** line to interpret, a breakpoint or trace, stack depths that neither
+** verifyprogram() nor stackdepth() can vouch for, a divide by zero, a
+** matrix kernel, a view or array element that is not there, a '?' that
+** may suspend the run, or for an integer type a result that double
+** would round.
+**
+** Returns TYPED_DONE when the run is over, TYPED_LINE to carry on in
+** double from the line in @, or else the operation of line *stepp to
+** carry on from.
+*/
+
+NUM ENGINE(tvarz)[VARCOUNT];
+NUM ENGINE(tustack)[STACKLIMIT];
+NUM ENGINE(tcompstack)[STACKLIMIT];
+
+
+/*
+** ENGINE(tload)
+**
+** Put the array element v into *x. FALSE if NUM would not hold it the
+** way double does, for the double engine to take over.
+*/
+
+static int ENGINE(tload)(double v, NUM *x) {
+
+#if NUMINT
+  if (v != floor(v) || v > INTEXACT || v < -INTEXACT
+      || (v == 0 && signbit(v))) {
+    return FALSE;
+  }
+#endif
+  *x = (NUM) v;
+  return TRUE;
+}
+
+
+int ENGINE(runtyped)(int *stepp) {
+
+  NUM *vz, *cs, *us;     /* typed variables and stacks                    */
+  int sp, usp;           /* stack indexes, kept out of the globals        */
+  int step;              /* index into program memory                     */
+  int result;
+  long i, k;
+  CODENODE *code;        /* compiled line                                 */
+  OPNODE *op, *end;
+  NUM x;
+#if NUMINT
+  NUM y, r;              /* operands and result checked for overflow      */
+#else
+  long from, n;          /* range of a {name} over the array              */
+#endif
+
+  vz = ENGINE(tvarz);
+  cs = ENGINE(tcompstack);
+  us = ENGINE(tustack);
+  for (i = 0; i < VARCOUNT; i++) {
+    vz[i] = (NUM) varz[i];
+  }
+  for (i = 0; i < STACKLIMIT; i++) {
+    cs[i] = (NUM) compstack[i];
+    us[i] = (NUM) ustack[i];
+  }
+  sp = compstackindex;
+  usp = ustackindex;
+
+  result = TYPED_DONE;
+  step = -1;
+  do {
+
+    /* the line just run, when --sample's timer has ticked */
+    if (sampledue && step >= 0) {
+      for (i = 0; i < usp; i++) {
+	ustack[i] = (double) us[i];
+      }
+      ustackindex = usp;
+      sample(step);
+    }
+
+    /* ... and when the lines between limitcheck()s have run */
+    if (step >= 0 && --limitleft <= 0) {
+      for (i = 0; i < usp; i++) {
+	ustack[i] = (double) us[i];
+      }
+      ustackindex = usp;
+      if (limitcheck(step)) {
+	break;
+      }
+    }
+
+    /* locate line from @, usually it is just the next line */
+    if (step + 1 <= laststep && linos[step + 1] == exlino) {
+      step++;
+    } else {
+      step = findstep(exlino);
+      if (step < 0) {
+	result = TYPED_LINE;
+	break;
+      }
+    }
+
+    /* StringPrint, gatherformat and numbuild are only left set by
+       interpreted lines, so they need not be looked at here */
+    code = linecompile(step);
+    if (code == NULL || ! code->exact || lineflags[step] != NOBREAKPOINT
+	|| nowstepping || (debugging && traceing)) {
+      result = TYPED_LINE;
+      break;
+    }
+    if ( ! code->proven
+	&& (sp < code->mindepth || sp > code->maxentry
+	    || usp < code->upops || usp > STACKLIMIT - code->urise)) {
+      result = TYPED_LINE;
+      break;
+    }
+
+    thisstep = (long) exlino;
+    exlino = linos[step + 1];
+
+    for (op = code->ops, end = op + code->nops; op < end; op++) {
+      switch (op->code) {
+
+      case OP_NUM:     cs[sp++] = NUMCONST(op);         break;
+      case OP_LASTNUM: cs[sp++] = (NUM) thenumber;      break;
+      case OP_GETVAR:  cs[sp++] = vz[op->arg];          break;
+      case OP_PUTVAR:  vz[op->arg] = cs[sp - 1];        break;
+
+      case OP_VARDYN:
+	if (putget == GET || indirect == TRUE) {
+	  cs[sp++] = vz[op->arg];
+	} else {
+	  vz[op->arg] = cs[sp - 1];
+	}
+	break;
+
+      case OP_CLEAR:
+	sp = 0;
+	putget = GET;
+	indirect = FALSE;
+	break;
+
+      case OP_PUTMODE: putget = PUT;                               break;
+      case OP_PRINT:   fputs(code->strings + op->arg, stdout);     break;
+      case OP_FORMAT:  strcpy(numberformat, code->strings + op->arg); break;
+      case OP_NOT:     cs[sp - 1] = ! cs[sp - 1];                  break;
+      case OP_EQ:      sp--; cs[sp - 1] = cs[sp - 1] == cs[sp];    break;
+      case OP_LT:      sp--; cs[sp - 1] = cs[sp - 1] < cs[sp];     break;
+      case OP_GT:      sp--; cs[sp - 1] = cs[sp - 1] > cs[sp];     break;
+
+      case OP_AND:
+	sp--;
+	cs[sp - 1] = cs[sp - 1] != 0 && cs[sp] != 0;
+	break;
+
+      case OP_OR:
+	sp--;
+	cs[sp - 1] = cs[sp - 1] != 0 || cs[sp] != 0;
+	break;
+
+#if NUMINT
+      /* operands are within INTEXACT, so these can not overflow */
+      case OP_ADD:
+	r = cs[sp - 2] + cs[sp - 1];
+	if (r > INTEXACT || r < -INTEXACT) {
+	  goto inexact;
+	}
+	cs[--sp - 1] = r;
+	break;
+
+      case OP_SUB:
+	r = cs[sp - 2] - cs[sp - 1];
+	if (r > INTEXACT || r < -INTEXACT) {
+	  goto inexact;
+	}
+	cs[--sp - 1] = r;
+	break;
+
+      case OP_MUL:
+	x = cs[sp - 1];
+	y = cs[sp - 2];
+	if (__builtin_mul_overflow(y, x, &r) || r > INTEXACT || r < -INTEXACT
+	    || (r == 0 && (x < 0 || y < 0))) {
+	  /* too big, or a zero that double would make -0 */
+	  goto inexact;
+	}
+	cs[--sp - 1] = r;
+	break;
+
+      case OP_NEG:
+	if (cs[sp - 1] == 0) {
+	  goto inexact;
+	}
+	cs[sp - 1] = - cs[sp - 1];
+	break;
+
+      case OP_INT:
+	break;
+#else
+      case OP_ADD: sp--; cs[sp - 1] = cs[sp - 1] + cs[sp];         break;
+      case OP_SUB: sp--; cs[sp - 1] = cs[sp - 1] - cs[sp];         break;
+      case OP_MUL: sp--; cs[sp - 1] = cs[sp - 1] * cs[sp];         break;
+      case OP_NEG: cs[sp - 1] = cs[sp - 1] * -1;                   break;
+      case OP_POW: sp--; cs[sp - 1] = NUMPOW(cs[sp - 1], cs[sp]);  break;
+
+      case OP_DIV:
+	if (cs[sp - 1] == 0) {
+	  goto inexact;
+	}
+	sp--;
+	cs[sp - 1] = cs[sp - 1] / cs[sp];
+	break;
+
+      case OP_INT:
+	x = cs[sp - 1];
+	cs[sp - 1] = x < 0 ? NUMCEIL(x) : NUMFLOOR(x);
+	break;
+
+      case OP_RAND:
+	cs[sp++] = (NUM) pipi();
+	break;
+
+      case OP_INPUT:
+	if (inputyield) {
+	  goto inexact;
+	}
+	printf("%s",NUMPROMPT);
+	cs[sp++] = (NUM) inputnumber();
+	break;
+
+      case OP_MATHDYN:
+	if (putget == PUT) {
+	  goto mathrange;
+	}
+	/* fall through */
+      case OP_MATH:
+	cs[sp - 1] = NUMMATH(op->arg, cs[sp - 1]);
+	break;
+
+      case OP_MATHRANGE:
+      mathrange:
+	if (mathbounds((double) cs[sp - 2], (double) cs[sp - 1], &from, &n)) {
+	  for (i = from; i < from + n; i++) {
+	    darray[i] = (double) NUMMATH(op->arg, (NUM) darray[i]);
+	  }
+	}
+	break;
+#endif
+
+      case OP_LPARDYN:
+	if (putget == PUT) {
+	  indirect = TRUE;
+	}
+	break;
+
+      case OP_INDIRECT:
+	indirect = TRUE;
+	break;
+
+      case OP_RPARDYN:
+	if (putget == GET) {
+	  goto fetch;
+	}
+	goto store;
+
+      case OP_FETCH:
+      fetch:
+	if ( ! (cs[sp - 1] > -1 && cs[sp - 1] < arrayelements)
+	    || ! ENGINE(tload)(darray[(long) cs[sp - 1]], &x)) {
+	  goto inexact;
+	}
+	indirect = FALSE;
+	cs[sp - 1] = x;
+	break;
+
+      case OP_STORE:
+      store:
+	x = cs[sp - 1];
+	if ( ! (x > -1 && x < arrayelements)) {
+	  goto inexact;
+	}
+	indirect = FALSE;
+	sp--;
+	darray[(long) x] = (double) cs[sp - 1];
+	break;
+
+      case OP_MATRIX:
+	/* only setting up a view is done here, kernels are left to double */
+	if (CALLKERNEL(op->arg) != MATRIX_VIEW
+	    || ! viewdefine(CALLVIEW(op->arg, 0), (double) cs[sp - 4],
+			    (double) cs[sp - 3], (double) cs[sp - 2],
+			    (double) cs[sp - 1], FALSE)) {
+	  goto inexact;
+	}
+	break;
+
+      case OP_ELEMDYN:
+	if (putget == PUT) {
+	  goto elemstore;
+	}
+	/* fall through */
+      case OP_ELEMENT:
+	k = viewindex(op->arg, (double) cs[sp - 2], (double) cs[sp - 1], FALSE);
+	if (k < 0 || ! ENGINE(tload)(darray[k], &x)) {
+	  goto inexact;
+	}
+	sp--;
+	cs[sp - 1] = x;
+	break;
+
+      case OP_ELEMSTORE:
+      elemstore:
+	k = viewindex(op->arg, (double) cs[sp - 2], (double) cs[sp - 1], FALSE);
+	if (k < 0) {
+	  goto inexact;
+	}
+	sp -= 2;
+	darray[k] = (double) cs[sp - 1];
+	break;
+
+      case OP_RANDDYN:
+	if (putget == PUT) {
+	  goto seed;
+	}
+#if NUMINT
+	goto inexact;
+#else
+	cs[sp++] = (NUM) pipi();
+	break;
+#endif
+
+      case OP_SEED:
+      seed:
+	x = cs[sp - 1];
+	spipi(seedvalue((double) x));
+	break;
+
+      case OP_IODYN:
+	if (putget == PUT) {
+	  goto output;
+	}
+#if NUMINT
+	goto inexact;
+#else
+	if (inputyield) {
+	  goto inexact;
+	}
+	printf("%s",NUMPROMPT);
+	cs[sp++] = (NUM) inputnumber();
+	break;
+#endif
+
+      case OP_OUTPUT:
+      output:
+	NUMPRINT(cs[sp - 1]);
+	break;
+
+      case OP_ATDYN:
+	if (putget == PUT) {
+	  goto jump;
+	}
+	/* fall through */
+      case OP_GETAT:
+	cs[sp++] = (NUM) exlino;
+	break;
+
+      case OP_JUMP:
+      jump:
+	if (cs[sp - 1] != 0) {
+	  exlino = (double) cs[sp - 1];
+	}
+	break;
+
+      case OP_USTKDYN:
+	if (putget == PUT) {
+	  goto pushu;
+	}
+	/* fall through */
+      case OP_POPU:
+	cs[sp++] = us[--usp];
+	break;
+
+      case OP_PUSHU:
+      pushu:
+	us[usp++] = cs[sp - 1];
+	break;
+
+      case OP_STOP:
+	running = FALSE;
+	goto done;
+
+      default:
+	goto inexact;
+      }
+    }
+
+    if (code->hasconst) {
+      thenumber = code->lastconst;
+    }
+
+  } while ( running );
+  goto done;
+
+  /* the double engine finishes this line from op */
+ inexact:
+  *stepp = step;
+  result = op - code->ops;
+
+ done:
+  for (i = 0; i < VARCOUNT; i++) {
+    varz[i] = (double) vz[i];
+  }
+  for (i = 0; i < STACKLIMIT; i++) {
+    compstack[i] = (double) cs[i];
+    ustack[i] = (double) us[i];
+  }
+  compstackindex = sp;
+  ustackindex = usp;
+  return result;
+}
+
+#undef NUM
+#undef ENGINE
+#undef NUMINT
+#undef NUMCONST
+#undef NUMPRINT
+#undef NUMPOW
+#undef NUMFLOOR
+#undef NUMCEIL
+#undef NUMMATH
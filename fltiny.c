@@ -2,8 +2,10 @@
 ** NAME
 **    fltiny.c -- interpreter for the Tiny programming language
 ** DESCRIPTION
-**    This is an entire ANSI C89 program that interprets programs written
-**    in the language Tiny.
+**    This is an entire program that interprets programs written in the
+**    language Tiny. It needs GNU C on Linux: it uses fopencookie, epoll,
+**    perf_event_open, GCC vector types and overflow builtins, and sets
+**    stdout to streams of its own.
 ** LICENSE TERMS
 **    Copyright (C) 2006 Ron Hudson
 **    This program is free software; you can redistribute it and/or modify
@@ -84,10 +86,126 @@
 ** F00.01.04 Ron Hudson, Bruce Hudson                             11-oct-2007
 **           Fix random numbers
 **
+** F00.02.00 In Progress
+**
+**           Lines are compiled into operations when they are stored.
+**           Editing a line recompiles only that line, jumps find their
+**           line by binary search. Lines typed without a line number
+**           are run at once in interactive mode. [x] ~ now seeds the
+**           random numbers with x.
+**
+**           Program memory is kept as separate arrays of line numbers,
+**           flags, text offsets and compiled lines. Text is stored in
+**           one arena so lines can be any length, and the program
+**           grows as needed.
+**
+**           fltiny --serve sock runs programs for fltiny --client over
+**           a Unix socket, with a pool of worker processes that each
+**           cache the programs they have compiled.
+**
+**           The original interpreter is kept as --engine=reference.
+**           --difftest n runs random programs under every engine and
+**           prints the smallest one that does not match the reference.
+**
+**           Programs that only use integers run in int64, handing back
+**           to double wherever a result would differ. --engine=float
+**           and --engine=longdouble run in those types instead.
+**
+**           {sqrt} {exp} {log} {sin} {cos} and {atan} work on the top
+**           of the stack while getting, and over a range of the array
+**           while putting. --math=fast uses vector kernels within a
+**           few ULP of the C library.
+**
+**           {view A} makes A a matrix over part of the array, {A} is
+**           an element of it, and {matmul} {transpose} {matvec} and
+**           row and column sums, least and greatest work on whole
+**           views. --array n makes the array bigger.
+**
+**           --output=async hands output to a writer thread through a
+**           ring buffer, emptied before any input is read and at exit.
+**
+**           [lino] {spawn} starts a task with its own stacks and @
+**           register. Tasks take turns at {yield} or every --slice
+**           lines.
+**
+**           Subroutines that only do arithmetic and set variables
+**           are memoized on the variables they read; #memo and
+**           #nomemo on a subroutine's first line decide for it.
+**           --stats reports the calls and hits.
+**
+**           Lines proven to fit the stacks before a run, following
+**           constant jumps and the $ stack's return lines, run with
+**           no checks; other lines check every operation, and a line
+**           that can overflow is reported ( --verify=strict refuses
+**           to run it ).
+**
+**           --sample file writes a profile of the run, sampled on a
+**           SIGPROF timer and weighed by a perf_event counter if asked,
+**           as collapsed stacks through the $ stack's return lines.
+**
+**           #include file first last takes in a unit of lines kept
+**           in that range. Units are compiled on their own and cached
+**           under --unitcache by the hash of their text, so unchanged
+**           ones are not parsed again.
+**
+**           {pfor i} runs a subroutine for each i of a range on a
+**           pool of threads sharing the array; {psum} {pmin} and
+**           {pmax} reduce a variable over the runs.
+**
+**           Lines are optimized for each run in SSA form over the
+**           flow verifyprogram() finds: constants are propagated,
+**           arithmetic a variable holds already is reused, dead stores
+**           go and loop invariants are worked out before the loop.
+**           --optimize=off runs the lines as compiled.
+**
+**           {csvin f c} and {binin f} load a column of a CSV file or
+**           a file of little-endian doubles into a range of the
+**           array; {csvout f} and {binout f} write a range back.
+**
+**           {sort} radix sorts a range of the array in place, large
+**           ones on --threads threads, {sortwith} moving a second
+**           range along; {select} finds the k-th least and {search}
+**           finds a number in a sorted range by halving it.
+**
+**           --max-lines, --max-time and --max-output stop a run that
+**           goes on too long, saying where it was, with exit status
+**           3. --serve runs several jobs on each worker, switching
+**           them every 20 ms so that a long one can't hold the rest.
+**
+**           {hput} {hget} {hhas} {hdel} and {hcount} keep a hash
+**           table of numbers keyed by numbers, open addressed in one
+**           flat array that grows; {hkeys} and {hvalues} put what it
+**           holds into the array.
+**
+**           --compile=lazy loads a program as its text and line
+**           numbers only and compiles each line when it first runs.
+**           --stats says how many lines were compiled.
+**
+**           Task slots are made a block at a time as tasks need them
+**           and used again when tasks end, up to 131071 tasks. The
+**           array takes memory only for the pages that are used, and
+**           a server request clears it by giving its pages back.
+**
+**           A run can stop at a '?' that has no input waiting and be
+**           carried on later with the number. A server request that
+**           asks for this keeps its session on the worker, which
+**           waits on every such connection at once with epoll.
+**
+**           --batch runs a program once for each set of variables in
+**           a file, 8 runs at a time in vector lanes. Lanes at the same
+**           line run it together, and a lane that leaves the others or
+**           meets what the lanes can't do finishes on its own.
+**
+**           --record keeps the numbers '?' reads and the seeds '~' is
+**           given, those from the clock too, in a file that --replay
+**           reads back instead of the terminal and the clock. A replay
+**           that goes another way than its recording is stopped.
+**
 */
 
-#define VERSION "F00.01.04" 
+#define VERSION "F00.02.00" 
 
+#define _GNU_SOURCE                /* fopencookie                       */
 
 #include <time.h>
 #include <stdio.h>
@@ -96,13 +214,32 @@
 #include <stdlib.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
 
 #define TRUE 1
 #define FALSE 0
 
 #define PUT 1
 #define GET 0
-#define STEPLIMIT 300
+#define STEPLIMIT 300              /* program steps to start with       */
+#define ARENASTART 8192            /* bytes of line text to start with  */
+#define EMPTYSTEPS 3               /* empty steps after the last line   */
 #define STACKLIMIT 30
 #define ARRAYELEMENTS 999
 #define PUT 1
@@ -114,13 +251,146 @@
 #define TRACEPOINT 1
 #define BREAKHERE 2
 #define PI 3.1415926535897932384626433832795
+#define CACHESIZE 16               /* programs each server worker keeps */
+#define TASKLIMIT 131072           /* tasks at once, with the program   */
+#define TASKBLOCK 1024             /* task slots made at a time         */
+#define TASKSLICE 100              /* lines in a turn by default        */
+#define LIMITCHUNK 4096            /* most lines between limitcheck()s  */
+#define LIMITSTATUS 3              /* exit status of a run over a limit */
+#define OUTSTATUS 4                /* exit status when output was lost  */
+#define RECORDMAGIC "Tiny-rec"     /* start of a --record file          */
+#define SERVEJOBS 4                /* jobs taking turns on each worker  */
+#define SERVESLICE 20              /* ms in a --serve job's turn        */
+#define LANES 8                    /* runs a --batch takes at once      */
+#define SERVEREADY 64              /* epoll events taken at a time      */
+#define SESSIONPAGE 512            /* array elements a session keeps as */
+                                   /* one piece, 4k                     */
+#define SESSIONPOOL 1024           /* ended sessions kept for reuse     */
+#define MEMOVARS 8                 /* variables a memoized subroutine   */
+                                   /* may read, and may set             */
+#define MEMOSUBLIMIT 256           /* subroutines memoized at once      */
+#define MEMOSIZE 4096              /* memotable entries, a power of 2   */
+#define VERIFYSTATES 16384         /* states verifyprogram() walks      */
+#define VTABLESIZE 65536           /* ... and its table of them         */
+#define VSTATEWORDS (5 + 4 * STACKLIMIT) /* words in a state's key      */
+#define MEMONONE -1                /* CODENODE memo: not a subroutine   */
+#define MEMOREJECT -2              /* ... one that can't be memoized    */
+#define PARBLOCKS 1024             /* most blocks a {pfor} is split in  */
+#define PARTHREADLIMIT 256         /* most --threads                    */
+#define UNITLIMIT 64               /* #include'd units in a program     */
+#define UNITFORMAT 2               /* of --unitcache files, change it   */
+                                   /* when OPNODE or CODENODE changes   */
+#define OPTREGS 16                 /* registers for hoisted expressions */
+#define VARCOUNT (27 + OPTREGS)    /* varz, a to z, the accumulator and */
+                                   /* ... the registers after them      */
+
+/* Engines, the index into enginenames */
+#define ENGINE_COMPILED   0        /* int64 when the program allows     */
+#define ENGINE_REFERENCE  1
+#define ENGINE_DOUBLE     2
+#define ENGINE_FLOAT      3
+#define ENGINE_LONGDOUBLE 4
+
+/* What a typed engine returns, else the operation to carry on from */
+#define TYPED_DONE -1              /* the run is over                   */
+#define TYPED_LINE -2              /* carry on in double from @         */
+
+#define INTEXACT 9007199254740992LL /* 2^53, double holds integers to  */
 
 
-typedef struct statement {
-  int  breakpoint;
-  double lino;
-  char text[80];
-} STATENODE;
+/*
+** Compiled operation codes. Each line of program text is translated
+** into a list of these when it is stored, so running a program does
+** not have to re-scan the text. The _DYN forms are used where the
+** line has not yet said whether it is putting or getting ( no '['
+** seen yet ) and so must look at putget when they run.
+*/
+
+#define OP_NUM       1            /* push a numeric constant           */
+#define OP_LASTNUM   2            /* push the last constant parsed     */
+#define OP_GETVAR    3            /* push a variable                   */
+#define OP_PUTVAR    4            /* store top of stack in a variable  */
+#define OP_VARDYN    5            /* variable, put or get at run time  */
+#define OP_CLEAR     6            /* '[' clear stack, begin get        */
+#define OP_PUTMODE   7            /* ']' begin put                     */
+#define OP_PRINT     8            /* print a string                    */
+#define OP_FORMAT    9            /* set numberformat                  */
+#define OP_ADD      10
+#define OP_SUB      11
+#define OP_MUL      12
+#define OP_DIV      13
+#define OP_POW      14
+#define OP_INT      15
+#define OP_NOT      16
+#define OP_NEG      17
+#define OP_LT       18
+#define OP_GT       19
+#define OP_EQ       20
+#define OP_AND      21
+#define OP_OR       22
+#define OP_INDIRECT 23            /* '(' while putting                 */
+#define OP_LPARDYN  24
+#define OP_FETCH    25            /* ')' while getting                 */
+#define OP_STORE    26            /* ')' while putting                 */
+#define OP_RPARDYN  27
+#define OP_RAND     28            /* '~' get                           */
+#define OP_SEED     29            /* '~' put                           */
+#define OP_RANDDYN  30
+#define OP_INPUT    31            /* '?' get                           */
+#define OP_OUTPUT   32            /* '?' put                           */
+#define OP_IODYN    33
+#define OP_GETAT    34            /* '@' get                           */
+#define OP_JUMP     35            /* '@' put                           */
+#define OP_ATDYN    36
+#define OP_POPU     37            /* '$' get                           */
+#define OP_PUSHU    38            /* '$' put                           */
+#define OP_USTKDYN  39
+#define OP_STOP     40            /* ':' end of program                */
+#define OP_MATH     41            /* '{name}' get, arg is the function */
+#define OP_MATHRANGE 42           /* '{name}' put, over the array      */
+#define OP_MATHDYN  43
+#define OP_MATRIX   44            /* '{view A}' or a matrix kernel     */
+#define OP_ELEMENT  45            /* '{A}' get, arg is the view        */
+#define OP_ELEMSTORE 46           /* '{A}' put                         */
+#define OP_ELEMDYN  47
+#define OP_TASK     48            /* '{spawn}' '{yield}' and so on     */
+#define OP_PARALLEL 49            /* '{pfor i}' '{psum i r}' and so on */
+#define OP_DATA     50            /* '{csvin f c}' '{binout f}' and so on */
+#define OP_SORT     51            /* '{sort}' '{search}' and so on     */
+#define OP_HASH     52            /* '{hput}' '{hget}' and so on       */
+
+#define UNKNOWN -1                /* compile time putget or indirect   */
+
+
+typedef struct operation {
+  int    code;                    /* OP_ operation code                */
+  int    arg;                     /* variable number or string offset, */
+                                  /* or OP_NUM's value as an int       */
+  double value;                   /* numeric constant                  */
+} OPNODE;
+
+typedef struct compiled {
+  OPNODE *ops;                    /* operations in execution order     */
+  int    nops;
+  char   *strings;                /* strings for OP_PRINT, OP_FORMAT   */
+                                  /* and OP_DATA                       */
+  int    exact;                   /* FALSE: line must be interpreted   */
+  int    hasconst;                /* line leaves thenumber set to      */
+  double lastconst;               /* ... this value                    */
+  int    mindepth;                /* stack depths on entry that run    */
+  int    maxentry;                /* ... safely, see stackdepth()      */
+  int    upops;                   /* $ stack depths on entry that run  */
+  int    urise;                   /* ... safely, upops to STACKLIMIT   */
+                                  /* less urise                        */
+  int    proven;                  /* runs safely however it is reached */
+                                  /* this run, see verifyprogram()     */
+  int    memo;                    /* memosubs index if a subroutine    */
+                                  /* starts here, see memoanalyse()    */
+  OPNODE *plain;                  /* ops as compiled, if optimize-     */
+  int    nplain;                  /* program() has rewritten them      */
+  OPNODE *hoist;                  /* run after the line, to work out   */
+  int    nhoist;                  /* loop invariants, or NULL          */
+} CODENODE;
 
 
 
@@ -128,10 +398,13 @@ typedef struct statement {
 ** Global Variables 
 */
 
-double varz[27];                   /* Variables                         */
-double ustack[STACKLIMIT];         /* $ stack                           */
-double darray[ARRAYELEMENTS];      /* User Array                        */
-double compstack[STACKLIMIT];      /* computational stack               */
+double varz[VARCOUNT];             /* Variables                         */
+double *ustack;                    /* $ stack, the running task's       */
+double *darray;                    /* User Array                        */
+long arrayelements;                /* ... its size, --array             */
+double *stackspace;                /* computational stack, with room    */
+                                   /* below for a line to underflow     */
+#define compstack (stackspace + STACKLIMIT)
 
 int ustackindex;                   /* index to free stack item          */
 int compstackindex;                /* index to free stack item          */
@@ -144,7 +417,234 @@ int nowstepping;                   /* Flag, single stepping program     */
 char numberformat[20];             /* Number printout format            */
 char listformat[30];               /* list format                       */
 
-STATENODE progmem[STEPLIMIT];      /* Program memory                    */
+/*
+** Program memory. Each step's line number, breakpoint flag, text and
+** compiled form are kept in separate arrays so that searching for a
+** line number only reads line numbers. Line text is stored end to end
+** in textarena and may be any length. EMPTYSTEPS empty steps always
+** follow the last line.
+*/
+
+double *linos;                     /* line number of each step          */
+int *lineflags;                    /* breakpoint flag of each step      */
+long *textoff;                     /* offset of the text in textarena   */
+CODENODE **linecode;               /* compiled form, NULL if none       */
+int stepsize;                      /* steps allocated                   */
+
+char *textarena;                   /* all the program text              */
+long arenaused;                    /* bytes of textarena in use         */
+long arenasize;                    /* bytes of textarena allocated      */
+long arenagarbage;                 /* bytes of replaced or deleted text */
+
+#define linetext(step) (textarena + textoff[step])
+
+
+/*
+** A whole program memory, for keeping more than one program loaded.
+** useprog() makes one current by setting the globals above.
+*/
+
+typedef struct program {
+  double *linos;
+  int *lineflags;
+  long *textoff;
+  CODENODE **linecode;
+  int stepsize;
+  int laststep;
+  char *textarena;
+  long arenaused;
+  long arenasize;
+  long arenagarbage;
+} PROGNODE;
+
+typedef struct progcache {
+  unsigned long hash;              /* hashtext() of the program text    */
+  char *text;                      /* the program text, NULL if unused  */
+  long len;
+  long lastuse;                    /* cacheclock when last used         */
+  int held;                        /* sessions waiting in this program  */
+  PROGNODE prog;
+} PROGCACHE;
+
+typedef struct serveslot {
+  pid_t pid;                       /* worker process, 0 for none        */
+  volatile int busy;               /* running a request                 */
+  int stopped;                     /* SIGSTOPped for another's turn     */
+  struct timespec since;           /* when busy, stopped or continued   */
+  volatile long long paused;       /* ns spent stopped, for --max-time  */
+} SERVESLOT;
+
+/*
+** Execution state, kept from one line to the next while running
+*/
+
+double exlino;                     /* effective lino (@ register)       */
+double thenumber;                  /* last numeric constant parsed      */
+char numstring[40];                /* numeric constant being built      */
+int running;                       /* flag - running                    */
+int putget;                        /* put get flag                      */
+int indirect;                      /* indirect for store flag           */
+int numbuild;                      /* building a number                 */
+int StringPrint;                   /* Printing                          */
+int gatherformat;                  /* reading a format string           */
+int exitstatus;                    /* status to exit with after a run   */
+int engine;                        /* ENGINE_ that runs programs        */
+int mathfast;                      /* TRUE: --math=fast                 */
+int asyncout;                      /* TRUE: --output=async              */
+int memoing;                       /* FALSE: --memo=off                 */
+int optimizing;                    /* FALSE: --optimize=off             */
+int lazycompile;                   /* TRUE: --compile=lazy              */
+int inputyield;                    /* TRUE: '?' past the input suspends */
+int suspended;                     /* the run is waiting for input      */
+int showstats;                     /* TRUE: --stats                     */
+int parthreads;                    /* --threads for {pfor} and {sort}   */
+int parordered;                    /* TRUE: --reduce=ordered            */
+char *unitcache;                   /* --unitcache, NULL for none        */
+char *loadingfrom;                 /* file being loaded, if known       */
+char *samplepath;                  /* --sample, NULL if not sampling    */
+int sampleevent;                   /* --sample-event, see sampleevents  */
+volatile sig_atomic_t sampledue;   /* --sample's timer has ticked       */
+long limitlines;                   /* --max-lines, 0 for no limit       */
+double limittime;                  /* --max-time in seconds, or 0       */
+long limitoutput;                  /* --max-output in bytes, or 0       */
+long limitleft;                    /* lines to run before limitcheck()  */
+FILE *recordfp;                    /* --record, NULL if not recording   */
+int replaying;                     /* TRUE: --replay                    */
+char *replaywent;                  /* how a replay went another way     */
+char *sampleevents[] = { "time", "cycles", "cache-misses", "branch-misses",
+			 NULL };
+
+/* A two dimensional view of the array, see matrixcall() */
+typedef struct view {
+  long base;                       /* element of row 0, column 0        */
+  long rows;                       /* 0 if the view is not set up       */
+  long cols;
+  long stride;                     /* elements from one row to the next */
+} VIEW;
+
+VIEW views[26];                    /* views A to Z                      */
+double *matrixspace;               /* results of the matrix kernels     */
+long matrixsize;                   /* ... elements allocated            */
+
+/* A task's state between turns, see schedule() */
+typedef struct task {
+  double stackspace[2 * STACKLIMIT];
+  double ustack[STACKLIMIT];
+  int compstackindex;
+  int ustackindex;
+  double exlino;
+  double thenumber;
+  int putget;
+  int indirect;
+  int numbuild;
+  int StringPrint;
+  int gatherformat;
+  char numstring[40];
+  int local;                       /* TRUE: its own variables ...       */
+  double *varz;                    /* ... kept here between turns, made */
+                                   /* the first time the slot needs it  */
+  int next, prev;                  /* ring of tasks taking turns        */
+} TASK;
+
+TASK *taskblocks[TASKLIMIT / TASKBLOCK];  /* slots, made as needed      */
+int tasktop;                       /* slots handed out since taskreset  */
+int *freetasks;                    /* slots given back since ...        */
+int nfreetasks;                    /* ... and how many                  */
+#define TASKSLOT(n) (&taskblocks[(n) / TASKBLOCK][(n) % TASKBLOCK])
+int thistask;                      /* slot of the task running          */
+int tasking;                       /* a task has been started this run  */
+int yielding;                      /* {yield} on the line running       */
+long taskslice;                    /* --slice                           */
+long sliceleft;                    /* lines left in this turn           */
+double sharedvarz[VARCOUNT];       /* shared variables, while a task    */
+                                   /* with its own is running           */
+
+/* What verifyprogram() knows of a value, a line and a state */
+#define AV_UNKNOWN 0
+#define AV_CONST   1               /* v                                 */
+#define AV_BOOL    2               /* 0 or 1                            */
+#define AV_CHOICE  3               /* 0 or v                            */
+
+#define VREACHED   1
+#define VUNSAFE    2               /* went past the end of a stack      */
+#define VCOMPOVER  4               /* ... over the computation stack    */
+#define VUSTKOVER  8               /* ... over the $ stack              */
+
+#define VERIFY_OFF    0            /* --verify=                         */
+#define VERIFY_WARN   1
+#define VERIFY_STRICT 2
+
+typedef struct absval {
+  int    kind;
+  double v;
+} ABSVAL;
+
+typedef struct vstate {
+  int    step;                     /* line about to run                 */
+  int    putget, indirect;
+  int    csp, usp;                 /* stack depths ...                  */
+  ABSVAL cs[STACKLIMIT];           /* ... and contents                  */
+  ABSVAL us[STACKLIMIT];
+  double exlino;                   /* @ while the line runs             */
+} VSTATE;
+
+typedef struct verify {
+  int    *lines;                   /* V flags of each step              */
+  long   *table;                   /* states seen, offsets into keys    */
+  int64_t *keys;                   /* their keys, each after its length */
+  long   used, size;               /* words of keys                     */
+  long   *work;                    /* states still to walk              */
+  long   nwork;
+  long   nstates;
+  int    failed;                   /* prove nothing                     */
+  int    *edges;                   /* line to line, in pairs            */
+  long   nedges, edgesize;
+} VERIFY;
+
+int verifymode;                    /* --verify                          */
+int *flowedges;                    /* the edges of the last verify-     */
+long nflowedges;                   /* program(), -1 if not known        */
+int nopthoists;                    /* loop invariants optimizeprogram() */
+                                   /* hoisted, see runhoist()           */
+long optfolded, optreused;         /* for --stats: numbers and reused   */
+long optstores, opthoisted;        /* ... values put in, stores taken   */
+                                   /* out and invariants hoisted        */
+
+/* A subroutine memoized, and its results kept, see memoanalyse() */
+typedef struct memosub {
+  int    first, last;              /* steps, last is the [$] @ line     */
+  int    nin, nout;
+  int    in[MEMOVARS];             /* variables read before being set   */
+  int    out[MEMOVARS];            /* variables set                     */
+  int    hasconst;                 /* leaves thenumber set to           */
+  double lastconst;                /* ... this value                    */
+  long   calls, hits;              /* for --stats                       */
+} MEMOSUB;
+
+typedef struct memoentry {
+  long   gen;                      /* memogen of the run that made it   */
+  int    sub;
+  double in[MEMOVARS];
+  double out[MEMOVARS];
+} MEMOENTRY;
+
+MEMOSUB memosubs[MEMOSUBLIMIT];
+int nmemosubs;
+MEMOENTRY *memotable;              /* made the first time it is needed  */
+long memogen;                      /* entries of older runs are stale   */
+
+/* An #include'd unit, see includeunit() */
+typedef struct unit {
+  double first, last;              /* lines it keeps                    */
+  char   name[80];
+} UNIT;
+
+UNIT units[UNITLIMIT];
+int nunits;
+
+char *enginenames[] = { "compiled", "reference", "double", "float",
+			"longdouble", NULL };
+int engineexact[] = { TRUE, TRUE, TRUE, FALSE, FALSE }; /* as reference */
 
 double randseed;		   /* hold the random number seed       */
 
@@ -153,52 +653,308 @@ double randseed;		   /* hold the random number seed       */
 */
 
 void setup(void);                               /* setup system */
-void addprogramstep(double lino, char text[80]);
+void arrayclear(void);
+void addprogramstep(double lino, char text[]);
+void storestep(double lino, char text[], CODENODE *code);
 void listprogram(void);
-void loadprogram(char filename[80]);
-void saveprogram(char filename[20]);
+void loadprogram(char filename[]);
+void loadstream(FILE *fp);
+void includeunit(char directive[]);
+int unitof(double lino);
+char *readall(int fd, long *len);
+void saveprogram(char filename[]);
+char *readtext(FILE *fp);
+double parselino(char instring[], char **text);
+long storetext(char text[]);
+void growsteps(void);
+void clearstep(int step);
+int findplace(double lino);
 void execprogram(void);
+void runengine(void);
+void runprogram(void);
+void refprogram(void);
+void startrun(void);
+void immediateline(char text[]);
+void interpretline(char xtext[]);
+void interpretfrom(char xtext[], int first);
+void debugprompt(char xtext[]);
+int findstep(double lino);
+CODENODE *compileline(char text[]);
+CODENODE *linecompile(int step);
+void freecode(CODENODE *code);
+void stackdepth(CODENODE *code);
+void runline(CODENODE *code, int first);
+int intprogram(void);
+int floatprogram(void);
+void runtyped(int (*typed)(int *stepp));
+int runtyped_int64(int *stepp);
+int runtyped_float(int *stepp);
+int runtyped_long(int *stepp);
+void printlong(long double x);
 double cpop(void);                                /* Pop compstack       */
 double spop(void);                                /* Pop storage stack   */
 void cpush(double in);                            /* Push comp stack     */
 void spush(double in);                            /* Push storage stack  */
+void stackerror(char message[]);
 double inputnumber(void);
+int inputended(void);
+void suspendline(CODENODE *code, int next);
+void suspendtext(char xtext[], int next);
+void resumeprogram(double value);
+int recordopen(char path[]);
+int replayload(char path[]);
+void recordwrite(int kind, double value);
+double replayinput(void);
+double seedvalue(double x);
+void replaysay(FILE *fp);
+void recordstop(void);
 void formatlisting(void);
 void helpscreen(void);
 double pipi(void);
 void spipi(double);
+int mathname(char text[], int *len);
+void mathlanes(int fn, double *p);
+double mathone(int fn, double x);
+long double mathlong(int fn, long double x);
+long arrayindex(double x);
+int mathbounds(double first, double count, long *from, long *n);
+void mathrange(int fn, double first, double count);
+int matrixname(char text[], int *len);
+int viewdefine(int v, double base, double rows, double cols, double stride,
+	       int report);
+long viewindex(int v, double row, double col, int report);
+void matrixcall(int call);
+int dataname(char text[], int *len, int *path, int *pathlen);
+void datacall(char path[], int call);
+void sortcall(int what);
+void hashcall(int what);
+void hashclear(void);
+void saveprog(PROGNODE *prog);
+void useprog(PROGNODE *prog);
+void freeprog(PROGNODE *prog);
+PROGCACHE *cacheprogram(char text[], long len);
+void serve(char path[], int workers);
+void servesignal(SERVESLOT *slot, int stop, struct timespec *now);
+SERVESLOT *serveoldest(SERVESLOT slots[], int n, int stopped);
+void servetick(SERVESLOT slots[], int n, int workers);
+int client(char path[], char filename[]);
+int batchprogram(char path[]);
+int difftest(long count, unsigned long seed);
+void outstart(void);
+void outflush(void);
+void outstop(void);
+int findname(char *names[], char text[], int *len);
+void taskreset(void);
+void schedule(void);
+void taskcall(int what);
+int parallelname(char text[], int *len);
+void parallelcall(int call);
+int memoanalyse(void);
+void memocall(int m);
+void printstats(void);
+int safeline(CODENODE *code);
+int verifyprogram(int root);
+void optimizeprogram(int root);
+void optreset(void);
+void runhoist(CODENODE *code);
+void samplestart(void);
+void sample(int step);
+void samplestop(void);
+int stackframes(int step, double frames[]);
+void limitstart(void);
+int limitcheck(int step);
+void limitstop(void);
+unsigned long hashtext(char text[], long len);
 
 
 
 
 int main(int argc, char *argv[]) {
 
-  char instring[80];   /* input buffer                                    */
-  char text[80];       /* Parsed input statement w/o line number          */
-  char lstring[20];    /* the line number as a string                     */
+  char *instring;      /* input buffer                                    */
+  char *text;          /* Parsed input statement w/o line number          */
+  char filename[80];   /* file name for open and save                     */
   double lino;         /* Parsed line number                              */
-  char c;              /* character temporary                             */
   int going;           /* flag is interpreter still going else exit       */
-  int place;           /* pointer used while inputing a line              */
-  int i,j,t;           /* General counter and array pointer               */
-  int lsptr;           /* index to lstring                                */
+  int i,j;             /* General counter and array pointer               */
   int before;          /* flag, parsing statement, flags line number      */
-  double bkstep;       /* index into progmem array where a brekpoint goes */
+  int bkstep;          /* step where a brekpoint goes                     */
   double lineref;      /* Reference to a line number for various reasons  */
+  char *servepath;     /* --serve socket                                  */
+  char *clientpath;    /* --client socket                                 */
+  char *batchpath;     /* --batch file of variable presets                */
+  char *recordpath;    /* --record file                                   */
+  char *replaypath;    /* --replay file                                   */
+  int workers;         /* --workers for --serve                           */
+  long difftests;      /* --difftest programs to check                    */
+  unsigned long seed;  /* --seed for --difftest                           */
+  int argi;            /* argument being looked at                        */
   
 
-  if (argc > 1) {
+  /* options */
+  servepath = NULL;
+  clientpath = NULL;
+  batchpath = NULL;
+  recordpath = NULL;
+  replaypath = NULL;
+  workers = 0;
+  difftests = 0;
+  seed = time(NULL);
+  arrayelements = ARRAYELEMENTS;
+  taskslice = TASKSLICE;
+  memoing = TRUE;
+  optimizing = TRUE;
+  parthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  parordered = FALSE;
+  unitcache = NULL;
+  if (getenv("HOME") != NULL) {
+    unitcache = malloc(strlen(getenv("HOME")) + 20);
+    sprintf(unitcache, "%s/.cache/fltiny", getenv("HOME"));
+  }
+  verifymode = VERIFY_WARN;
+  for (argi = 1; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+    if (strcmp(argv[argi], "--serve") == 0 && argi + 1 < argc) {
+      servepath = argv[++argi];
+    } else if (strcmp(argv[argi], "--client") == 0 && argi + 1 < argc) {
+      clientpath = argv[++argi];
+    } else if (strcmp(argv[argi], "--batch") == 0 && argi + 1 < argc) {
+      batchpath = argv[++argi];
+    } else if (strcmp(argv[argi], "--record") == 0 && argi + 1 < argc) {
+      recordpath = argv[++argi];
+    } else if (strcmp(argv[argi], "--replay") == 0 && argi + 1 < argc) {
+      replaypath = argv[++argi];
+    } else if (strcmp(argv[argi], "--workers") == 0 && argi + 1 < argc) {
+      workers = atoi(argv[++argi]);
+    } else if (strncmp(argv[argi], "--engine=", 9) == 0) {
+      for (engine = 0; enginenames[engine] != NULL; engine++) {
+	if (strcmp(enginenames[engine], argv[argi] + 9) == 0) {
+	  break;
+	}
+      }
+      if (enginenames[engine] == NULL) {
+	printf("Tiny -- no engine %s\n", argv[argi] + 9);
+	exit(1);
+      }
+    } else if (strcmp(argv[argi], "--math=exact") == 0) {
+      mathfast = FALSE;
+    } else if (strcmp(argv[argi], "--math=fast") == 0) {
+      mathfast = TRUE;
+    } else if (strcmp(argv[argi], "--output=sync") == 0) {
+      asyncout = FALSE;
+    } else if (strcmp(argv[argi], "--output=async") == 0) {
+      asyncout = TRUE;
+    } else if (strcmp(argv[argi], "--memo=on") == 0) {
+      memoing = TRUE;
+    } else if (strcmp(argv[argi], "--memo=off") == 0) {
+      memoing = FALSE;
+    } else if (strcmp(argv[argi], "--optimize=on") == 0) {
+      optimizing = TRUE;
+    } else if (strcmp(argv[argi], "--optimize=off") == 0) {
+      optimizing = FALSE;
+    } else if (strcmp(argv[argi], "--compile=eager") == 0) {
+      lazycompile = FALSE;
+    } else if (strcmp(argv[argi], "--compile=lazy") == 0) {
+      lazycompile = TRUE;
+    } else if (strcmp(argv[argi], "--verify=off") == 0) {
+      verifymode = VERIFY_OFF;
+    } else if (strcmp(argv[argi], "--verify=warn") == 0) {
+      verifymode = VERIFY_WARN;
+    } else if (strcmp(argv[argi], "--verify=strict") == 0) {
+      verifymode = VERIFY_STRICT;
+    } else if (strcmp(argv[argi], "--threads") == 0 && argi + 1 < argc) {
+      parthreads = atoi(argv[++argi]);
+    } else if (strcmp(argv[argi], "--reduce=ordered") == 0) {
+      parordered = TRUE;
+    } else if (strcmp(argv[argi], "--reduce=fast") == 0) {
+      parordered = FALSE;
+    } else if (strcmp(argv[argi], "--unitcache") == 0 && argi + 1 < argc) {
+      unitcache = argv[++argi];
+      if (strcmp(unitcache, "off") == 0) {
+	unitcache = NULL;
+      }
+    } else if (strcmp(argv[argi], "--sample") == 0 && argi + 1 < argc) {
+      samplepath = argv[++argi];
+    } else if (strncmp(argv[argi], "--sample-event=", 15) == 0) {
+      for (sampleevent = 0; sampleevents[sampleevent] != NULL; sampleevent++) {
+	if (strcmp(sampleevents[sampleevent], argv[argi] + 15) == 0) {
+	  break;
+	}
+      }
+      if (sampleevents[sampleevent] == NULL) {
+	printf("Tiny -- no event %s\n", argv[argi] + 15);
+	exit(1);
+      }
+    } else if (strcmp(argv[argi], "--max-lines") == 0 && argi + 1 < argc) {
+      limitlines = atol(argv[++argi]);
+    } else if (strcmp(argv[argi], "--max-time") == 0 && argi + 1 < argc) {
+      limittime = atof(argv[++argi]);
+    } else if (strcmp(argv[argi], "--max-output") == 0 && argi + 1 < argc) {
+      limitoutput = atol(argv[++argi]);
+    } else if (strcmp(argv[argi], "--stats") == 0) {
+      showstats = TRUE;
+    } else if (strcmp(argv[argi], "--slice") == 0 && argi + 1 < argc) {
+      taskslice = atol(argv[++argi]);
+    } else if (strcmp(argv[argi], "--array") == 0 && argi + 1 < argc) {
+      arrayelements = atol(argv[++argi]);
+      if (arrayelements < ARRAYELEMENTS) {
+	arrayelements = ARRAYELEMENTS;
+      }
+    } else if (strcmp(argv[argi], "--difftest") == 0 && argi + 1 < argc) {
+      difftests = atol(argv[++argi]);
+    } else if (strcmp(argv[argi], "--seed") == 0 && argi + 1 < argc) {
+      seed = strtoul(argv[++argi], NULL, 10);
+    } else {
+      printf("Tiny -- unknown option %s\n", argv[argi]);
+      exit(1);
+    }
+  }
+
+  if (parthreads < 1) {
+    parthreads = 1;
+  } else if (parthreads > PARTHREADLIMIT) {
+    parthreads = PARTHREADLIMIT;
+  }
+
+  if (difftests > 0) {
+    exit(difftest(difftests, seed));
+  }
+
+  if (servepath != NULL) {
+    serve(servepath, workers);
+    exit(0);
+  }
+
+  if (clientpath != NULL && argi < argc) {
+    exit(client(clientpath, argv[argi]));
+  }
+
+  if (asyncout) {
+    outstart();
+  }
+
+  if (recordpath != NULL && ! recordopen(recordpath)) {
+    exit(1);
+  }
+  if (replaypath != NULL && ! replayload(replaypath)) {
+    exit(1);
+  }
+
+  if (argi < argc) {
     
     setup();
 
-    loadprogram(argv[1]);
+    loadprogram(argv[argi]);
+    if (batchpath != NULL) {
+      exit(batchprogram(batchpath));
+    }
     execprogram();
+    recordstop();
     /*
 	printf(" Program finished press enter to close\n");
 	inputnumber();
     */
     debugging = TRUE;
-    exit(1);
+    exit(exitstatus);
   }
 
   printf("\n\nFloating Point Tiny --  Interactive Mode\n\n");
@@ -212,26 +968,15 @@ int main(int argc, char *argv[]) {
   going = TRUE;
   do {
 
-    /* clear input buffer */
-    for (i = 0; i < 80; i++) {
-      instring[i] = '\0';
-    }
-
-    /* read input a string at a time */
-    place = 0;
-
     /* print prompt */
     printf(CMDPROMPT);
 
-    /* grab charactors until end of line or line too long */
-    do {
-      c = fgetc(stdin);
-      instring[place] = c;
-      place = place + 1;
-      if (place > 80) {
-	printf("\n\n-- Line too long \n");
-      }
-    } while( c != '\0' && c != '\n' && place < 80);
+    /* read input a line at a time, any length */
+    outflush();
+    instring = readtext(stdin);
+    if (instring == NULL) {
+      break;
+    }
     
     /* detect and execute a command */
     if (instring[0] == '#') {
@@ -254,9 +999,10 @@ int main(int argc, char *argv[]) {
 
       /* #s filename   Save */
       if (tolower(instring[1] == 's')) {
-	/* discard '#s' and copy filename into text[] */
+	/* discard '#s' and copy filename into filename[] */
 	i = 0;
 	j = 0;
+	filename[0] = '\0';
 	before = FALSE;
 	while (i < (int)strlen(instring)) {
 	  if (instring[i] == ' ') {
@@ -266,15 +1012,16 @@ int main(int argc, char *argv[]) {
 	  }
 
 	  if (before) {
-	    if (isalnum(instring[i])|| (instring[i] == '.')) {
-	      text[j] = instring[i];
+	    if ((isalnum(instring[i])|| (instring[i] == '.'))
+		&& j < (int) sizeof(filename) - 1) {
+	      filename[j] = instring[i];
 	      j++;
-	      text[j] = '\0';
+	      filename[j] = '\0';
 	    }
 	  }
 	  i++;
 	}
-	saveprogram(text);
+	saveprogram(filename);
 
       }
 
@@ -287,9 +1034,10 @@ int main(int argc, char *argv[]) {
       /* #o filename  old program (load the program) */
       if (tolower(instring[1]) == 'o') {
 
-	/* discard '#o' and copy filename into text[] */
+	/* discard '#o' and copy filename into filename[] */
 	i = 0;
 	j = 0;
+	filename[0] = '\0';
 	before = FALSE;
 	while (i < (int)strlen(instring)) {
 	  if (instring[i] == ' ') {
@@ -300,15 +1048,16 @@ int main(int argc, char *argv[]) {
 
 
 	  if (before) {
-	    if (isalnum(instring[i]) || (instring[i] == '.')) {
-	      text[j] = instring[i];
+	    if ((isalnum(instring[i]) || (instring[i] == '.'))
+		&& j < (int) sizeof(filename) - 1) {
+	      filename[j] = instring[i];
 	      j++;
-	      text[j] = '\0';
+	      filename[j] = '\0';
 	    }
 	  }
 	  i++;
 	}
-	loadprogram(text);
+	loadprogram(filename);
       }
 
       /* Trace facility */
@@ -323,21 +1072,19 @@ int main(int argc, char *argv[]) {
 	  }
 	  }*/
 
-	/*Find the proper element in the progmem array*/ 
-	bkstep = -1;
-	for(t=0; t<laststep; t++) {
-	  if (progmem[t].lino == lineref) {
-	    bkstep = t;
-	  }
+	/*Find the proper step in program memory*/ 
+	bkstep = findplace(lineref);
+	if (bkstep == laststep || linos[bkstep] != lineref) {
+	  bkstep = -1;
 	}
 
 	if ( bkstep < 0 && tolower(instring[3]) != 'f' ) {
 	  printf("Tiny -- Can't find line number %012.4f\n",lineref);
 	} else {
 	  switch ( tolower(instring[3]) ) {
-	  case 'n': progmem[(long)bkstep].breakpoint = NOBREAKPOINT; break;
-	  case 't': progmem[(long)bkstep].breakpoint = TRACEPOINT;   break;
-	  case 'b': progmem[(long)bkstep].breakpoint = BREAKHERE;    break;
+	  case 'n': lineflags[bkstep] = NOBREAKPOINT; break;
+	  case 't': lineflags[bkstep] = TRACEPOINT;   break;
+	  case 'b': lineflags[bkstep] = BREAKHERE;    break;
 	  case 'f': 
 	    debugging = ! debugging;
 	    if (debugging) {
@@ -350,6 +1097,11 @@ int main(int argc, char *argv[]) {
 	} 
       }
 
+      /* #i file first last   include a unit */
+      if (tolower(instring[1]) == 'i') {
+	includeunit(instring);
+      }
+
       /* User asking for help? */
       if (instring[1] == '?') {
 	      helpscreen();
@@ -368,36 +1120,8 @@ int main(int argc, char *argv[]) {
     if (isdigit(instring[0])) {
 
       /* separate statement into lino and text */
-      lino = 0;
-	  lsptr = 0;
-      j = 0;
-      before = TRUE;
-      for(i = 0; i <= (int)strlen(instring);  i++) {
-
-	/* locate break after line number */
-	if ( ! isdigit( instring[i] ) && ! ( instring[i] == '.')) {
-	  before = FALSE;
-	}
-      
-	/* if still line number */
-	if (before) {
-	  /* collect each digit of line number */
-        lstring[lsptr++] = instring[i];
-		lstring[lsptr+1] = 0;
-		sscanf(lstring,"%lf",&lino);
-
-	} else {
-	  /* else collect text from rest of string */
-	  text[j] = instring[i];
-	  j = j + 1;
-	}
-      }
-
-      text[j] = '\0';   /* ensure an end of line sentinel */
+      lino = parselino(instring, &text);
 
-
-
-      
       /* store line in program structure here... */
       addprogramstep(lino,text);
 
@@ -405,12 +1129,13 @@ int main(int argc, char *argv[]) {
       printf(listformat,lino,text);
     }
 
-    /*
-    ** Add 'interpret no line number line here and it will
-    ** only work in interactive mode. To Be added at a 
-    ** later date.
-    */
+    /* No line number, run it now */
+    if (instring[0] != '#' && ! isdigit(instring[0])
+	&& strspn(instring, " \t\n") < strlen(instring)) {
+      immediateline(instring);
+    }
 
+    free(instring);
   } while (going);
   return 0;
 }
@@ -429,9 +1154,22 @@ void setup(void) {
 
 
   /* initalize variables */
-  for (i=0; i<27; i++) {
+  for (i=0; i<VARCOUNT; i++) {
     varz[i] = 0;
   }
+  memset(views, 0, sizeof(views));
+
+  /* the array is made once and keeps its values; the system only
+     gives it pages as they are used */
+  if (darray == NULL) {
+    darray = mmap(NULL, arrayelements * sizeof(double),
+		  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (darray == MAP_FAILED) {
+      printf("Tiny -- out of memory for the array\n");
+      exit(1);
+    }
+  }
+  taskreset();
  
   /* initalize listing format */
   formatlisting();
@@ -441,100 +1179,254 @@ void setup(void) {
 
   /* initialze progrogram storage */
 
-  for (i=0; i<STEPLIMIT; i++) {
-    progmem[i].breakpoint = NOBREAKPOINT;
-    progmem[i].lino = 0;
-    strcpy(progmem[i].text,"");
+  if (textarena == NULL) {
+    arenasize = ARENASTART;
+    textarena = malloc(arenasize);
+    growsteps();
   }
 
+  for (i=0; i < laststep + EMPTYSTEPS; i++) {
+    freecode(linecode[i]);
+    clearstep(i);
+  }
+
+  /* offset 0 is the empty text of the empty steps */
+  textarena[0] = '\0';
+  arenaused = 1;
+  arenagarbage = 0;
+
   laststep = 0;
+  nunits = 0;
   traceing = FALSE;
   debugging = TRUE;
 }
 
 
+/*
+** arrayclear
+**
+** Set the whole array to 0 by giving its pages back, which reads as
+** 0 until they are written again, rather than writing every element.
+*/
+
+void arrayclear(void) {
+
+  madvise(darray, arrayelements * sizeof(double), MADV_DONTNEED);
+}
+
+
+/*
+** growsteps
+**
+** Make room for more program steps. The arrays are doubled, along
+** with the empty steps that follow the last line.
+*/
+
+void growsteps(void) {
+
+  int i, old;
+
+  old = stepsize;
+  stepsize = (stepsize == 0) ? STEPLIMIT : stepsize * 2;
+
+  linos     = realloc(linos,     (stepsize + EMPTYSTEPS) * sizeof(double));
+  lineflags = realloc(lineflags, (stepsize + EMPTYSTEPS) * sizeof(int));
+  textoff   = realloc(textoff,   (stepsize + EMPTYSTEPS) * sizeof(long));
+  linecode  = realloc(linecode,  (stepsize + EMPTYSTEPS) * sizeof(CODENODE *));
+  if (linos == NULL || lineflags == NULL || textoff == NULL
+      || linecode == NULL) {
+    printf("Tiny -- out of memory for program\n");
+    exit(1);
+  }
+
+  for (i = (old == 0) ? 0 : old + EMPTYSTEPS;
+       i < stepsize + EMPTYSTEPS; i++) {
+    clearstep(i);
+  }
+}
+
+
+void clearstep(int step) {
+
+  linos[step]     = 0;
+  lineflags[step] = NOBREAKPOINT;
+  textoff[step]   = 0;
+  linecode[step]  = NULL;
+}
+
+
+/*
+** linecompile
+**
+** The compiled form of the line at step, compiling it first if it
+** has not been. With --compile=lazy a program is loaded as its text
+** and line numbers only, and each line is compiled here the first
+** time it runs, so a large program starts as soon as it is read.
+*/
+
+CODENODE *linecompile(int step) {
+
+  if (linecode[step] == NULL && step < laststep) {
+    linecode[step] = compileline(linetext(step));
+  }
+  return linecode[step];
+}
+
+
+/*
+** storetext
+**
+** Copy a line of text onto the end of textarena and return where it
+** went. When more than half the arena is text that is no longer used
+** the live lines are packed down first.
+*/
+
+long storetext(char text[]) {
+
+  long len, off;
+  char *packed;
+  int i;
+
+  len = strlen(text) + 1;
+
+  if (arenagarbage > arenaused / 2 && arenagarbage > ARENASTART) {
+    packed = malloc(arenasize);
+    packed[0] = '\0';
+    off = 1;
+    for (i = 0; i < laststep; i++) {
+      strcpy(packed + off, linetext(i));
+      textoff[i] = off;
+      off += strlen(packed + off) + 1;
+    }
+    free(textarena);
+    textarena = packed;
+    arenaused = off;
+    arenagarbage = 0;
+  }
+
+  while (arenaused + len > arenasize) {
+    arenasize = arenasize * 2;
+    textarena = realloc(textarena, arenasize);
+    if (textarena == NULL) {
+      printf("Tiny -- out of memory for program text\n");
+      exit(1);
+    }
+  }
+
+  off = arenaused;
+  memcpy(textarena + off, text, len);
+  arenaused += len;
+  return off;
+}
+
+
+/*
+** findplace
+**
+** Binary search of the line numbers. Returns the step holding lino,
+** or the step where lino would be inserted.
+*/
+
+int findplace(double lino) {
+
+  int low, high, mid;
+
+  low  = 0;
+  high = laststep;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (linos[mid] < lino) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+
+void addprogramstep(double lino, char text[]) {
+  storestep(lino, text, NULL);
+}
 
 
+/*
+** storestep
+**
+** Add, replace or, for an empty text, delete line lino. code is the
+** line already compiled, or NULL to compile it here, or with
+** --compile=lazy when it first runs.
+*/
 
-void addprogramstep(double lino, char text[80]) {
-  int i, j;
+void storestep(double lino, char text[], CODENODE *code) {
+  int i, n;
 
   if (lino != 0) {
 
+    i = findplace(lino);
+
     if (text[0] == '\n') {
       
       /* find and delete lino */
-      i = 0;
-      while ((lino != progmem[i].lino ) && (i < laststep)) i++;
-
-      /*
-      ** If found the line,
-      **   then march all lines beyond up one,
-      **   else i will equal laststep and the while
-      **   will not run.
-      */
-      while (i < (laststep - 1)) {
-    	progmem[i].lino = progmem[i + 1].lino;
-	    strcpy(progmem[i].text, progmem[i + 1].text);
-	    progmem[i].breakpoint =  progmem[i + 1].breakpoint;
-	    i++;
-      };
+      freecode(code);
+      if (i == laststep || linos[i] != lino) {
+	/* no such line, nothing to delete */
+	return;
+      }
+      freecode(linecode[i]);
+      arenagarbage += strlen(linetext(i)) + 1;
 
       /*
-      ** Delete the last line now that all the lines have been
-      ** moved forward.
+      ** March all lines beyond up one, then clear the step after 
+      ** the new last line.
       */
-      progmem[i].lino = 0;
-      strcpy(progmem[i].text, "");
-      progmem[i].breakpoint = NOBREAKPOINT;
+      n = laststep - i - 1;
+      memmove(linos + i,     linos + i + 1,     n * sizeof(double));
+      memmove(lineflags + i, lineflags + i + 1, n * sizeof(int));
+      memmove(textoff + i,   textoff + i + 1,   n * sizeof(long));
+      memmove(linecode + i,  linecode + i + 1,  n * sizeof(CODENODE *));
       laststep--;
+      clearstep(laststep);
       
+    } else if (i < laststep && linos[i] == lino) {
+	
+      /*
+      ** Replace this line (lino is already correct, just store the
+      ** new text.
+      */
+      arenagarbage += strlen(linetext(i)) + 1;
+      textoff[i] = storetext(text);
+      lineflags[i] = NOBREAKPOINT;
+      freecode(linecode[i]);
+      linecode[i] = code;
+      if ( ! lazycompile) {
+	linecompile(i);
+      }
+
     } else {
-      /* Search forward */
-      i=0;  
-      while ((lino > progmem[i].lino) && (i < laststep)) {
-    	i++;    /* bypass lower numbered lines */
+
+      if (laststep == stepsize) {
+	growsteps();
       }
-      if (progmem[i].lino == lino) {
-	
-	/*
-	** Replace this line (lino is already correct, just copy in 
-	** the new text.
-	*/
-	strcpy(progmem[i].text, text);
-	progmem[i].breakpoint = NOBREAKPOINT;
-      } else {
-	
-	if (laststep == 0) {
-	  
-	  /* First line of the program*/
-	  progmem[0].lino = lino;
-	  strcpy(progmem[0].text, text);
-	  progmem[0].breakpoint = NOBREAKPOINT;
-	  laststep++;
-	} else {
 	
-	  /*
-	  ** Insert this line here by saving the point to 
-	  ** insert the new line and start moving the lines 
-	  ** beyond to make room for the new line.
-	  */
-	  j = laststep;
-	
-	  /* Move all the lines that are beyond here */
-	  while ( j > i) {
-	    progmem[j].lino = progmem[j - 1].lino;
-	    strcpy(progmem[j].text, progmem[j - 1].text);
-	    progmem[j].breakpoint = progmem[j - 1].breakpoint;
-	    j--;
-	  };
+      /*
+      ** Insert this line here by moving the lines beyond 
+      ** to make room for the new line.
+      */
+      n = laststep - i;
+      memmove(linos + i + 1,     linos + i,     n * sizeof(double));
+      memmove(lineflags + i + 1, lineflags + i, n * sizeof(int));
+      memmove(textoff + i + 1,   textoff + i,   n * sizeof(long));
+      memmove(linecode + i + 1,  linecode + i,  n * sizeof(CODENODE *));
 	
-	  /* Put in the new line */
-	  progmem[i].lino = lino;
-	  strcpy(progmem[i].text, text);
-	  progmem[i].breakpoint = NOBREAKPOINT;
-	  laststep++;
-	}
+      /* Put in the new line */
+      linos[i] = lino;
+      textoff[i] = storetext(text);
+      lineflags[i] = NOBREAKPOINT;
+      linecode[i] = code;
+      laststep++;
+      if ( ! lazycompile) {
+	linecompile(i);
       }
     }
   }
@@ -551,30 +1443,85 @@ void listprogram(void) {
 
   for (i=0; i < laststep; i++) {
 
-    switch (progmem[i].breakpoint) {
+    switch (lineflags[i]) {
     case NOBREAKPOINT: printf("  "); break;
     case BREAKHERE:    printf("* "); break;
     case TRACEPOINT:   printf("+ "); break;
     }
 
-    printf(listformat,progmem[i].lino,progmem[i].text);
+    printf(listformat,linos[i],linetext(i));
   }
 
   printf("\n");
 }
 
 
-void loadprogram(char filename[80]) {
+/*
+** readtext
+**
+** Read one line of any length, including its newline. The line is
+** malloc'd and the caller frees it. Returns NULL at end of file.
+*/
+
+char *readtext(FILE *fp) {
+
+  char *buf;
+  int size, len, c;
+
+  size = 128;
+  len = 0;
+  buf = malloc(size);
+
+  while ((c = fgetc(fp)) != EOF) {
+    if (len + 2 > size) {
+      size = size * 2;
+      buf = realloc(buf, size);
+    }
+    buf[len++] = c;
+    if (c == '\n' || c == '\0') {
+      break;
+    }
+  }
+
+  if (len == 0) {
+    free(buf);
+    return NULL;
+  }
+  buf[len] = '\0';
+  return buf;
+}
+
+
+/*
+** parselino
+**
+** Split a line into the line number at its front and the statement
+** text that follows. Returns the line number, or 0 if there is none.
+*/
+
+double parselino(char instring[], char **text) {
+
+  char lstring[40];    /* the line number as a string                     */
+  double lino;
+  int i;
+
+  lino = 0;
+  for (i = 0; isdigit(instring[i]) || instring[i] == '.'; i++) {
+    if (i < (int) sizeof(lstring) - 1) {
+      lstring[i] = instring[i];
+    }
+  }
+  lstring[i < (int) sizeof(lstring) - 1 ? i : (int) sizeof(lstring) - 1] = 0;
+  sscanf(lstring,"%lf",&lino);
+
+  *text = instring + i;
+  return lino;
+}
+
+
+void loadprogram(char filename[]) {
 
 	FILE *fp;
-	char instring[80];
-	char lstring[20];
-	int lsptr;
-	char text[80];
-	int before;
-	int i,j;
-	double lino;
-	char * eflag;
 
 	fp = fopen(filename,"r");
 
@@ -584,70 +1531,391 @@ void loadprogram(char filename[80]) {
 
 	} else {
 
-		do {
-			eflag = fgets(instring,80,fp);
+		loadingfrom = filename;
+		loadstream(fp);
+		loadingfrom = NULL;
+		fclose(fp);
+	}
+}
+
 
-			if (eflag != NULL) {
+void loadstream(FILE *fp) {
 
-			/* separate statement into lino and text */
-			lino = 0;
-			lsptr = 0;
-			j = 0;
-			before = TRUE;
-			for(i = 0; i <= (int)strlen(instring);  i++) {
-	  
-				/* locate break after line number */
-				if ( (! isdigit( instring[i])) &&  (instring[i] != '.') ) {
-					before = FALSE;
-				}
-	  
-				/* if still line number */
-				if (before) {
-					/* collect each digit of line number */
-					lstring[lsptr++] = instring[i];
-					lstring[lsptr+1] = 0;
-					sscanf(lstring,"%lf",&lino);
-				} else {
-					/* else collect text from rest of string */
-					text[j] = instring[i];
-					j++;
-				}
-			}
-	
-			text[j] = '\0';   /* ensure an end of line sentinel */
+	char *instring;
+	char *text;
+	double lino;
+
+	while ((instring = readtext(fp)) != NULL) {
+
+		if (strncmp(instring, "#include", 8) == 0) {
+			includeunit(instring);
+			free(instring);
+			continue;
+		}
 
-			/* printf(listformat,lino,text); */
+		/* separate statement into lino and text */
+		lino = parselino(instring, &text);
 
+		if (lino != 0 && unitof(lino) >= 0) {
+			printf("Tiny -- line %012.4f is %s's, left out\n",
+			       lino, units[unitof(lino)].name);
+		} else {
 			addprogramstep(lino,text);
-	 
 		}
-	} while ( eflag != NULL );
-    fclose(fp);
+		free(instring);
 	}
 }
 
 
-double cpop(void){
+/*
+** Units
+**
+** A program file can take in a library of lines, a unit, with
+**
+**    #include plural.flt 200 299
+**
+** on a line of its own. The unit's lines are numbered as they are to
+** run, and must lie in the range given, which the unit then keeps:
+** the program's own lines there are left out. The name is taken from
+** the directory of the file being loaded.
+**
+** A unit is compiled on its own, and what the compiler made of it is
+** kept in a file under --unitcache named by the hash of the unit's
+** text. Loading an unchanged unit again reads the lines and their
+** compiled form back from that file without looking at the text.
+*/
 
-  compstackindex--;
-  return compstack[compstackindex]; 
-};
+/*
+** unitof
+**
+** The unit whose range holds lino, or -1.
+*/
 
-double spop(void){
-  ustackindex--;
-  return ustack[ustackindex];
-};
+int unitof(double lino) {
 
-void cpush(double in){
-  compstack[compstackindex] = in;
-  compstackindex++;
-};
+  int u;
+
+  for (u = 0; u < nunits; u++) {
+    if (lino >= units[u].first && lino <= units[u].last) {
+      return u;
+    }
+  }
+  return -1;
+}
+
+
+/*
+** unitread
+**
+** Load a unit's lines from the cache file at path. Returns FALSE,
+** having loaded nothing, if there is no such file or it doesn't fit.
+*/
+
+#define TAKE(p, n) (at + (long) (n) <= len ? (memcpy((p), buf + at, (n)), \
+						at += (n), TRUE) : FALSE)
+
+int unitread(char path[], double first, double last) {
+
+  char *buf;
+  long len, at;
+  int fd, pass, format, limit, nlines, i, textlen, nstr;
+  double lino;
+  char *text;
+  CODENODE code, *made;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return FALSE;
+  }
+  buf = readall(fd, &len);
+  close(fd);
+
+  /* the first pass only looks, so that a bad file loads nothing */
+  for (pass = 0; pass < 2; pass++) {
+    at = 0;
+    if (len < 4 || memcmp(buf, "FLTU", 4) != 0) {
+      break;
+    }
+    at = 4;
+    if ( ! TAKE(&format, sizeof(int)) || format != UNITFORMAT
+	|| ! TAKE(&limit, sizeof(int)) || limit != STACKLIMIT
+	|| ! TAKE(&nlines, sizeof(int))) {
+      break;
+    }
+    for (i = 0; i < nlines; i++) {
+      if ( ! TAKE(&lino, sizeof(double)) || lino < first || lino > last
+	  || ! TAKE(&textlen, sizeof(int)) || textlen < 0
+	  || at + textlen > len) {
+	break;
+      }
+      text = buf + at;
+      at += textlen;
+      if ( ! TAKE(&code, sizeof(CODENODE)) || ! TAKE(&nstr, sizeof(int))
+	  || nstr < 0 || code.nops < 0
+	  || at + nstr + code.nops * (long) sizeof(OPNODE) > len) {
+	break;
+      }
+      if (pass == 1) {
+	made = malloc(sizeof(CODENODE));
+	*made = code;
+	made->strings = malloc(nstr + 1);
+	memcpy(made->strings, buf + at, nstr);
+	made->ops = malloc(code.nops * sizeof(OPNODE) + 1);
+	memcpy(made->ops, buf + at + nstr, code.nops * sizeof(OPNODE));
+	made->memo = MEMONONE;
+	made->proven = FALSE;
+	made->plain = NULL;
+	made->nplain = 0;
+	made->hoist = NULL;
+	made->nhoist = 0;
+	text = strndup(text, textlen);
+	storestep(lino, text, made);
+	free(text);
+      }
+      at += nstr + code.nops * sizeof(OPNODE);
+    }
+    if (i < nlines) {
+      break;
+    }
+  }
+
+  free(buf);
+  return pass == 2;
+}
+
+#undef TAKE
+
+
+/*
+** unitwrite
+**
+** Keep the lines from first to last, as loaded and compiled, in the
+** cache file at path. Written beside it first, so that a unit being
+** read at the same time is never half written.
+*/
+
+void unitwrite(char path[], double first, double last) {
+
+  FILE *fp;
+  char *tmp;
+  CODENODE *code, plain;
+  OPNODE *op;
+  int format, limit, nlines, step, len, nstr, n;
+
+  /* the cache directory, and the one it is in, are made if need be */
+  tmp = malloc(strlen(path) + 20);
+  strcpy(tmp, unitcache);
+  if (strrchr(tmp, '/') != NULL && strrchr(tmp, '/') != tmp) {
+    *strrchr(tmp, '/') = '\0';
+    mkdir(tmp, 0777);
+  }
+  mkdir(unitcache, 0777);
+
+  sprintf(tmp, "%s.%d", path, (int) getpid());
+  fp = fopen(tmp, "wb");
+  if (fp == NULL) {
+    free(tmp);
+    return;
+  }
+
+  nlines = 0;
+  for (step = findplace(first); step < laststep && linos[step] <= last;
+       step++) {
+    nlines++;
+  }
+  format = UNITFORMAT;
+  limit = STACKLIMIT;
+  fwrite("FLTU", 1, 4, fp);
+  fwrite(&format, sizeof(int), 1, fp);
+  fwrite(&limit, sizeof(int), 1, fp);
+  fwrite(&nlines, sizeof(int), 1, fp);
+
+  for (step = findplace(first); step < laststep && linos[step] <= last;
+       step++) {
+    code = linecompile(step);
+    len = strlen(linetext(step));
+    fwrite(&linos[step], sizeof(double), 1, fp);
+    fwrite(&len, sizeof(int), 1, fp);
+    fwrite(linetext(step), 1, len, fp);
+    if (code->plain != NULL) {
+      /* as compiled, not as the last run optimized it */
+      plain = *code;
+      plain.ops = code->plain;
+      plain.nops = code->nplain;
+      code = &plain;
+    }
+    fwrite(code, sizeof(CODENODE), 1, fp);
+
+    /* the strings end with the last one the operations use */
+    nstr = 0;
+    for (op = code->ops; op < code->ops + code->nops; op++) {
+      if (op->code == OP_PRINT || op->code == OP_FORMAT
+	  || op->code == OP_DATA) {
+	n = op->arg + strlen(code->strings + op->arg) + 1;
+	if (n > nstr) {
+	  nstr = n;
+	}
+      }
+    }
+    fwrite(&nstr, sizeof(int), 1, fp);
+    fwrite(code->strings, 1, nstr, fp);
+    fwrite(code->ops, sizeof(OPNODE), code->nops, fp);
+  }
+
+  if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+    unlink(tmp);
+  }
+  free(tmp);
+}
+
+
+/*
+** includeunit
+**
+** Take in the unit an #include line names, from the cache if it has
+** been compiled before.
+*/
+
+void includeunit(char directive[]) {
+
+  char name[80], *path, *cached, *text, *line, *end, *lntext, *stmt;
+  double first, last, lino;
+  unsigned long hash;
+  long len;
+  int fd, step;
+
+  /* past the #include */
+  directive += strcspn(directive, " \t\n");
+  if (sscanf(directive, "%79s %lf %lf", name, &first, &last) != 3
+      || first <= 0 || last < first) {
+    printf("Tiny -- #include needs a file, first and last line\n");
+    return;
+  }
+  step = findplace(first);
+  if (nunits == UNITLIMIT || unitof(first) >= 0 || unitof(last) >= 0
+      || (step < laststep && linos[step] <= last)) {
+    printf("Tiny -- lines %g to %g are in use, %s not included\n",
+	   first, last, name);
+    return;
+  }
+
+  /* named from the directory of the file including it */
+  path = malloc(strlen(name) + (loadingfrom ? strlen(loadingfrom) : 0) + 2);
+  if (name[0] != '/' && loadingfrom != NULL
+      && strrchr(loadingfrom, '/') != NULL) {
+    len = strrchr(loadingfrom, '/') - loadingfrom + 1;
+    memcpy(path, loadingfrom, len);
+    strcpy(path + len, name);
+  } else {
+    strcpy(path, name);
+  }
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("Tiny can't open file [%s] \n", path);
+    free(path);
+    return;
+  }
+  text = readall(fd, &len);
+  close(fd);
+  free(path);
+
+  units[nunits].first = first;
+  units[nunits].last = last;
+  strcpy(units[nunits].name, name);
+  nunits++;
+
+  cached = NULL;
+  if (unitcache != NULL) {
+    hash = hashtext(text, len);
+    cached = malloc(strlen(unitcache) + 40);
+    sprintf(cached, "%s/%016lx.flu", unitcache, hash);
+    if (unitread(cached, first, last)) {
+      free(cached);
+      free(text);
+      return;
+    }
+  }
+
+  /* compile it */
+  for (line = text; line < text + len; line = end) {
+    end = strchr(line, '\n');
+    end = end == NULL ? text + len : end + 1;
+    lino = parselino(line, &lntext);
+    if (lino == 0) {
+      continue;
+    }
+    if (lino < first || lino > last) {
+      printf("Tiny -- line %012.4f of %s is outside %g to %g\n",
+	     lino, name, first, last);
+      continue;
+    }
+    stmt = strndup(lntext, end - lntext);
+    addprogramstep(lino, stmt);
+    free(stmt);
+  }
+
+  if (cached != NULL) {
+    unitwrite(cached, first, last);
+    free(cached);
+  }
+  free(text);
+}
+
+
+/*
+** cpop, spop, cpush, spush
+**
+** The stack operations of interpreted lines, which check as they go.
+** Popping below the bottom of the computation stack reads the room
+** left below it, and is reported when the line ends; anything else
+** past either end stops the program, and the operation is not done.
+*/
+
+double cpop(void){
+
+  if (compstackindex <= -STACKLIMIT) {
+    stackerror("*** Tiny Comp Stack underflow \n");
+    return 0;
+  }
+  compstackindex--;
+  return compstack[compstackindex]; 
+};
+
+double spop(void){
+  if (ustackindex <= 0) {
+    stackerror("*** Tiny $ Stack underflow \n");
+    return 0;
+  }
+  ustackindex--;
+  return ustack[ustackindex];
+};
+
+void cpush(double in){
+  if (compstackindex >= STACKLIMIT) {
+    stackerror("*** Tiny Comp Stack overflow \n");
+    return;
+  }
+  compstack[compstackindex] = in;
+  compstackindex++;
+};
 
 void spush(double in){
+  if (ustackindex >= STACKLIMIT) {
+    stackerror("*** Tiny $ Stack overflow \n");
+    return;
+  }
   ustack[ustackindex] = in;
   ustackindex++;
 };
 
+void stackerror(char message[]) {
+  if (running) {
+    printf("%s", message);
+  }
+  running = FALSE;
+}
+
 
 double logical(double input) {
 	if (input == 0) {
@@ -685,528 +1953,10092 @@ void spipi(double dx) {
 
 
 /*
-** execprogram
-** 
-** This executes the program that is currently loaded.
+** Maths functions
+**
+** {sqrt} {exp} {log} {sin} {cos} {atan}. While getting a function
+** replaces the top of the stack with its value. While putting it
+** leaves the stack alone and takes the top as a count and the one
+** below as the first element of the array, and replaces that many
+** elements in place:
 **
+**     [a {sin} 2 *] b          b = 2 sin a
+**     [0 100] {sqrt} {log}     array 0 to 99 = log sqrt array
+**
+** --math=exact gets every value from the C library. --math=fast
+** uses the polynomial kernels below, which are within a few ULP of
+** it and work on MATHLANES elements at once. sqrt is the same in
+** both, the hardware square root is already exact.
 */
 
-void execprogram(void) {
-
-  double x,y;            /* Temporary                                     */
-  double exlino;         /* effective lino (@ register)                   */
-  double thenumber;      /* Used to collect numeric constants             */
-  char numstring[40];    /* a string in which numeric constants are built */
-  int  place;            /* used in numeric constant collection           */
-  char xtext[80];        /* Program text being interpreted                */
-  char xchar;            /* actual char being interpreted                 */
-  char xstr[2];          /* when we need a string xchar instead           */
-  int i;                 /* loop indexes                                  */
-  int running;           /* flag - running                                */
-  int progmemstep;       /* index into progmem                            */
-  int putget;            /* put get flag                                  */
-  int indirect;          /* indirect for store flag                       */ 
-  int numbuild;          /* building a number                             */
-  int StringPrint;       /* Printing                                      */
-  int BackSlash;         /* Prev Char was a backslash                     */
-  int Parencomment;      /* Paren comment level                           */
-  int Poundcomment;      /* Pound Comment                                 */
-  int gatherformat;      /* Flag used while reading format strings        */
-  int debugstopped;      /* Flag used in debugging prompt                 */
-  char debugcommand[80]; /* Holds debugging input string                  */
+char *mathnames[] = { "sqrt", "exp", "log", "sin", "cos", "atan", NULL };
 
+#define MATH_SQRT 0
+#define MATH_EXP  1
+#define MATH_LOG  2
+#define MATH_SIN  3
+#define MATH_COS  4
+#define MATH_ATAN 5
 
-  /* setup */
-  putget       = GET;
-  numbuild     = FALSE;
-  StringPrint  = FALSE;
-  BackSlash    = FALSE;
-  indirect     = FALSE;
-  Parencomment = 0;      /* not inside parens */
-  Poundcomment = FALSE;  /* No Poundsign comment yet */
-  gatherformat = FALSE;
+/* elements the fast kernels take, one vector register of doubles */
+#ifdef __AVX__
+#define MATHLANES 4
+#define VC(c)          ((vdouble) { (c), (c), (c), (c) }) /* c in each lane */
+#else
+#define MATHLANES 2
+#define VC(c)          ((vdouble) { (c), (c) })           /* c in each lane */
+#endif
 
+typedef double vdouble __attribute__ ((vector_size (MATHLANES * 8)));
+typedef long long vlong __attribute__ ((vector_size (MATHLANES * 8)));
+typedef unsigned long long vulong __attribute__ ((vector_size (MATHLANES * 8)));
 
+/*
+** Vectors never cross a function call, so the kernels take and give
+** back plain doubles and these helpers are macros.
+*/
 
-  /* Get first Line Number */
-  progmemstep = 0;
-  exlino = progmem[progmemstep].lino;
- 
+#define VSELECT(m,a,b) ((vdouble) (((vlong) (a) & (m)) | ((vlong) (b) & ~(m))))
+#define VROUND(x)      (((x) + VC(0x1.8p52)) - VC(0x1.8p52)) /* |x| < 2^51 */
+#define VPOW2(k)       ((vdouble) (((k) + 1023) << 52)) /* 2^k, normal k  */
 
+/* integer and double, for integers below 2^51, from the bits of x +
+   0x1.8p52: SSE2 has no instruction for these conversions */
+#define MAGIC          0x4338000000000000LL        /* bits of 0x1.8p52  */
+#define VTOINT(x)      ((vlong) ((x) + VC(0x1.8p52)) - MAGIC)
+#define VTODOUBLE(k)   ((vdouble) ((k) + MAGIC) - VC(0x1.8p52))
+#define SIGNBIT        0x8000000000000000ULL
 
-  running = TRUE;
-  do {
+#define TRIGLIMIT 524288.0         /* 2^19, past this sin and cos use   */
+                                   /* the C library                     */
 
-    /* locate line from @ */
-    progmemstep = 0;
-    while (progmem[progmemstep].lino != exlino) {
-      progmemstep++;
-    
-      /* if past lastline then error message stop */
-      if (progmemstep > laststep) {
-		printf("Tiny-- Attempt to jump to %lf, line not found\n",exlino);
-		running = FALSE;
-		break;
-      }
-    }
 
+/*
+** mathname
+**
+** Look up the function named after a '{', see findname().
+*/
 
-    /* fetch line */
-    strcpy(xtext, progmem[progmemstep].text);
+int mathname(char text[], int *len) {
 
-    if (strlen(xtext) == 0) {
-      printf("Tiny-- Execute past end of program\n");
-      running = FALSE;
-    }
+  return findname(mathnames, text, len);
+}
 
-    thisstep = (long) exlino;
 
-    if (debugging && traceing) {
-      printf("\033[s\033[H---------- Trace: %012.4f\033[u",exlino);
-    }
+/*
+** findname
+**
+** Look up the name after a '{' in names. *len is set to the
+** characters the name and its '}' take up. Returns the index in
+** names, or -1 if it is not there or there is no '}'.
+*/
 
-    if (progmem[progmemstep].breakpoint == TRACEPOINT) {
-      traceing = ! traceing;
-    }
+int findname(char *names[], char text[], int *len) {
 
-    if (progmem[progmemstep].breakpoint == BREAKHERE) {
-      nowstepping = TRUE;
-    }
+  int n, fn;
 
-    if ( nowstepping ) {
-      printf("\033[u\033[H\033[K %012.4f %s\033[u",exlino,xtext);
-      do {
+  for (n = 0; isalpha(text[n]); n++) {
+  }
+  if (text[n] != '}') {
+    *len = n;
+    return -1;
+  }
+  *len = n + 1;
 
-	/*Assume its a short stop, get a deubgging command*/
-	debugstopped = FALSE;
-	printf("%s",DEBUGPROMPT);
-	fgets(debugcommand,80,stdin);
-
-	/* Debugging help */
-	if (tolower(debugcommand[0]) == '?') {
-		printf(" l list                  \n");
-		printf(" q quit                  \n");
-		printf(" n disable breakpoints   \n");
-		printf(" g go to next breakpoint \n");
-		printf(" b set a breakpoint      \n");
-		printf(" v view a variable       \n");
-		printf(" a view an array element \n");
-	}
-
-	/* Re-print current program step */
-	if (tolower(debugcommand[0] == 'l')) {
-	  printf("\033[u\033[H\033[K %012.4f %s\033[u",exlino,xtext);
-	  debugstopped = TRUE;
-	}	
+  for (fn = 0; names[fn] != NULL; fn++) {
+    if ((int) strlen(names[fn]) == n && strncmp(names[fn], text, n) == 0) {
+      return fn;
+    }
+  }
+  return -1;
+}
 
-	/* Return to command prompt */
-	if (tolower(debugcommand[0]) == 'q') {
-	  running = FALSE;
-	}
 
-	/* Disable breakpoints  */
-	if (tolower(debugcommand[0]) == 'n') {
-	  debugging = FALSE;
-	  nowstepping = FALSE;
-	}
+/*
+** vexp
+**
+** exp after fdlibm: x = k ln2 + r, a rational approximation for
+** exp(r), then 2^k applied in two halves so that results that are
+** huge or tiny come out right.
+*/
 
-	/* Run to next breakpoint */ 
-	if (tolower(debugcommand[0]) == 'g') {
-	  nowstepping = FALSE;
-	}
+static void vexp(double *p) {
+
+  vdouble x, k, hi, lo, r, t, c, y;
+  vlong ki, k1;
+
+  memcpy(&x, p, sizeof(x));
+  x = VSELECT(x < VC(-746.0), VC(-746.0), x);
+  x = VSELECT(x > VC(710.0), VC(710.0), x);
+
+  k = VROUND(x * VC(1.44269504088896338700e+00));
+  hi = x - k * VC(6.93147180369123816490e-01);
+  lo = k * VC(1.90821492927058770002e-10);
+  r = hi - lo;
+  t = r * r;
+  c = r - t * (VC(1.66666666666666019037e-01)
+	       + t * (VC(-2.77777777770155933842e-03)
+		      + t * (VC(6.61375632143793436117e-05)
+			     + t * (VC(-1.65339022054652515390e-06)
+				    + t * VC(4.13813679705723846039e-08)))));
+  y = VC(1.0) - ((lo - (r * c) / (VC(2.0) - c)) - hi);
+
+  ki = VTOINT(k);
+  k1 = ki >> 1;
+  y = y * VPOW2(k1) * VPOW2(ki - k1);
+  memcpy(p, &y, sizeof(y));
+}
 
-	/* Set a breakpoint */
-	if (tolower(debugcommand[0]) == 'b') {
-	  debugstopped = TRUE;
-	}
 
-	/*Examine a variable*/
-	if (tolower(debugcommand[0]) == 'v') {
-	  double v;
+/*
+** vlog
+**
+** log after fdlibm: x = m 2^e with m from sqrt(1/2) to sqrt(2), then
+** a polynomial in s = (m - 1) / (m + 1).
+*/
 
-	  if (debugcommand[1] <='z' && debugcommand[1] >= 'a') {
+static void vlog(double *p) {
+
+  vdouble x, m, f, s, z, r, hfsq, e, y, big;
+  vlong bits, ex, tiny;
+
+  memcpy(&x, p, sizeof(x));
+
+  /* subnormals are scaled up first */
+  tiny = x < VC(0x1p-1022);
+  big = VSELECT(tiny, x * VC(0x1p54), x);
+  bits = (vlong) big;
+  ex = ((bits >> 52) & 0x7ff) - 1023 - (tiny & 54);
+  m = (vdouble) ((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+
+  ex = ex - (m > VC(1.41421356237309504880));
+  m = VSELECT(m > VC(1.41421356237309504880), m * VC(0.5), m);
+
+  e = VTODOUBLE(ex);
+  f = m - VC(1.0);
+  s = f / (VC(2.0) + f);
+  z = s * s;
+  r = z * (VC(6.666666666666735130e-01)
+	   + z * (VC(3.999999999940941908e-01)
+		  + z * (VC(2.857142874366239149e-01)
+			 + z * (VC(2.222219843214978396e-01)
+				+ z * (VC(1.818357216161805012e-01)
+				       + z * (VC(1.531383769920937332e-01)
+					      + z * VC(1.479819860511658591e-01)))))));
+  hfsq = VC(0.5) * f * f;
+  y = e * VC(6.93147180369123816490e-01)
+    - ((hfsq - (s * (hfsq + r) + e * VC(1.90821492927058770002e-10))) - f);
+
+  /* 0, negatives, infinity and NaN */
+  y = VSELECT(x == VC(0.0), VC(-HUGE_VAL), y);
+  y = VSELECT(x < VC(0.0), VC(-NAN), y);
+  y = VSELECT(x == VC(HUGE_VAL), x, y);
+  y = VSELECT(x != x, x, y);
+  memcpy(p, &y, sizeof(y));
+}
 
-	    v = varz[tolower(debugcommand[1])-'a'];
-	    printf("\033[s\033[H\033[K Variable %c = %lf \033[u",
-		debugcommand[1],v);
-	  }	    
-	  debugstopped = TRUE;
-	}
 
+/*
+** vsincos
+**
+** sin ( cosine FALSE ) or cos ( TRUE ) after fdlibm: x = k pi/2 + r
+** with pi/2 in three parts, then the sine or cosine polynomial for r
+** as the quadrant needs. Right for |x| up to TRIGLIMIT.
+*/
 
-	/*Examine an array location*/
-	if (tolower(debugcommand[0]) == 'a') {
-	  int i,j;
+static void vsincos(double *p, int cosine) {
+
+  vdouble x, k, r, z, sn, cs, w, hz, y;
+  vlong q, swap;
+
+  memcpy(&x, p, sizeof(x));
+  k = VROUND(x * VC(6.36619772367581382433e-01));
+  r = ((x - k * VC(1.57079632673412561417e+00))
+       - k * VC(6.07710050630396597660e-11))
+    - k * VC(2.02226624871116645580e-21);
+  z = r * r;
+
+  sn = r + z * r * (VC(-1.66666666666666324348e-01)
+		    + z * (VC(8.33333333332248946124e-03)
+			   + z * (VC(-1.98412698298579493134e-04)
+				  + z * (VC(2.75573137070700676789e-06)
+					 + z * (VC(-2.50507602534068634195e-08)
+						+ z * VC(1.58969099521155010221e-10))))));
+
+  hz = VC(0.5) * z;
+  w = VC(1.0) - hz;
+  cs = w + (((VC(1.0) - w) - hz)
+	    + z * z * (VC(4.16666666666666019037e-02)
+		       + z * (VC(-1.38888888888741095749e-03)
+			      + z * (VC(2.48015872894767294178e-05)
+				     + z * (VC(-2.75573143513906633035e-07)
+					    + z * (VC(2.08757232129817482790e-09)
+						   + z * VC(-1.13596475577881948265e-11)))))));
+
+  q = VTOINT(k) + (cosine ? 1 : 0);
+  swap = -(q & 1);
+  y = (vdouble) ((vulong) VSELECT(swap, cs, sn) ^ ((vulong) (q & 2) << 62));
+
+  /* sin x is x when x is tiny, which keeps -0 */
+  if ( ! cosine) {
+    y = VSELECT((vdouble) ((vulong) x & ~SIGNBIT) < VC(0x1p-27), x, y);
+  }
+  memcpy(p, &y, sizeof(y));
+}
 
-	  j = 0;
-	  for (i=2; i<=(int) strlen(debugcommand); i++) {
-	    if (debugcommand[i] <= '9' && debugcommand[i] >= '0') {
-	      j = (j * 10) + (debugcommand[i] - '0');
-	    }
-	    printf("\033[s\033[H\033[K Array(%d) = %lf \033[u",j,darray[j]);
-	  }
-	  debugstopped = TRUE;
-	}
 
+/*
+** vatan
+**
+** atan after fdlibm: |x| past 1 uses pi/2 - atan(1/x), past tan(pi/8)
+** uses pi/4 + atan((x - 1) / (x + 1)), then an odd polynomial.
+*/
 
+static void vatan(double *p) {
+
+  vdouble x, t, z, y;
+  vlong big, mid;
+  vulong sign;
+
+  memcpy(&x, p, sizeof(x));
+  sign = (vulong) x & SIGNBIT;
+  t = (vdouble) ((vulong) x ^ sign);
+  big = t > VC(1.0);
+  t = VSELECT(big, VC(1.0) / t, t);
+  mid = t > VC(0.41421356237309503);
+  t = VSELECT(mid, (t - VC(1.0)) / (t + VC(1.0)), t);
+
+  z = t * t;
+  y = t - t * z * (VC(3.33333333333329318027e-01)
+		   + z * (VC(-1.99999999998764832476e-01)
+		   + z * (VC(1.42857142725034663711e-01)
+		   + z * (VC(-1.11111104054623557880e-01)
+		   + z * (VC(9.09088713343650656196e-02)
+		   + z * (VC(-7.69187620504482999495e-02)
+		   + z * (VC(6.66107313738753120669e-02)
+		   + z * (VC(-5.83357013379057348645e-02)
+		   + z * (VC(4.97687799461593236017e-02)
+		   + z * (VC(-3.65315727442169155270e-02)
+		   + z * VC(1.62858201153657823623e-02)))))))))));
+
+  y = VSELECT(mid, VC(7.85398163397448278999e-01)
+	      + (VC(3.06161699786838301793e-17) + y), y);
+  y = VSELECT(big, VC(1.57079632679489655800e+00)
+	      - (y - VC(6.12323399573676603587e-17)), y);
+  y = (vdouble) ((vulong) y ^ sign);
+  memcpy(p, &y, sizeof(y));
+}
 
-      } while (debugstopped);
-    }
 
+/*
+** mathlanes
+**
+** Run a fast kernel over MATHLANES values in place. sin and cos of
+** values too big for their kernel, infinity or NaN, come from the C
+** library.
+*/
 
-    /* set @ to line number of next line */
-    exlino = progmem[progmemstep+1].lino;
+void mathlanes(int fn, double *p) {
 
-    /* interpret line */
-    for (i=0; i < (int)strlen(xtext); i++) {
+  double x[MATHLANES];
+  int i;
 
-      xchar = xtext[i];
+  memcpy(x, p, sizeof(x));
+  switch (fn) {
+  case MATH_EXP:  vexp(p);                 break;
+  case MATH_LOG:  vlog(p);                 break;
+  case MATH_ATAN: vatan(p);                break;
+  case MATH_SIN:  vsincos(p, FALSE);       break;
+  case MATH_COS:  vsincos(p, TRUE);        break;
+  default:
+    for (i = 0; i < MATHLANES; i++) {
+      p[i] = sqrt(p[i]);
+    }
+    return;
+  }
 
-      if (xchar == '#') {
-		break;
+  if (fn == MATH_SIN || fn == MATH_COS) {
+    for (i = 0; i < MATHLANES; i++) {
+      if ( ! (fabs(x[i]) <= TRIGLIMIT)) {
+	p[i] = fn == MATH_COS ? cos(x[i]) : sin(x[i]);
       }
+    }
+  }
+}
 
 
-      if (gatherformat) {
-	if (xchar == '\'') {
-	  xchar = '\0';
-	  gatherformat = FALSE;
-	} else {
-	  xstr[0] = xchar;
-	  xstr[1] = '\0';
-	  strcat (numberformat, xstr);
-	  xchar = '\0';
-	}
-      }
+/*
+** mathone
+**
+** One value of a function.
+*/
 
-      if (xchar == '\'') {
-	/* 
-	** when first we notice a single qoute, clear the numberformat
-	** and begin to gather new characters in
-	*/
-	gatherformat = TRUE;
-	strcpy(numberformat,"\0");
-      }
+double mathone(int fn, double x) {
 
+  double v[MATHLANES];
 
-      if (StringPrint) {
-	
+  if (mathfast) {
+    memset(v, 0, sizeof(v));
+    v[0] = x;
+    mathlanes(fn, v);
+    return v[0];
+  }
 
-	if (xchar == '\\') {
-	  i++;
-	  xchar = xtext[i];
-	  switch ( xchar ) { 
-	  case 'n':  printf("\n");   break;
-	  case 't':  printf("\t");   break;
-	  case '\\': printf("\\");   break;
-	  case 'e':  printf("\033"); break;
-	  case '"':  printf("\"");   break;
-	  case '\'': printf("'");    break;
-	  case '.':  printf(".");    break;
-	  case 'a':  printf("\a");   break;
-	  default:   printf("\nTiny -- **backslash what? %c\n",xchar);
-	  }
+  switch (fn) {
+  case MATH_EXP:  return exp(x);
+  case MATH_LOG:  return log(x);
+  case MATH_SIN:  return sin(x);
+  case MATH_COS:  return cos(x);
+  case MATH_ATAN: return atan(x);
+  default:        return sqrt(x);
+  }
+}
 
-	} else {
-	  if (xchar == '"') {
-	    StringPrint = FALSE;
-	  } else {
-	    printf("%c",xchar);
-	  }
-	}
-      } else {
 
-	/* ':' is the "stop program " */
-	if (xchar == ':') {
-	  running = FALSE;
-	  break;
-	}
+/*
+** arrayindex
+**
+** The element of the array that x names for '(' and ')'. If there is
+** none it says so and stops the program, and returns -1.
+*/
 
+long arrayindex(double x) {
 
-	/* 
-	** Constants in programs 
-	**  Here is the code that accepts constants in program
-	**  statements
-	*/
+  if (x > -1 && x < arrayelements) {
+    return (long) x;
+  }
+  printf("Tiny -- %lf no such array element %g\n", exlino, x);
+  running = FALSE;
+  return -1;
+}
 
-	if (isdigit(xchar) || (xchar == '.' )) {
-	
-		if ( numbuild ) {
 
-                  place = strlen(numstring);
-		  numstring[place] = xchar;
-		  numstring[place+1] = '\0';
-		} else {
-			numbuild = TRUE;
-			numstring[0] = xchar;
-		        numstring[1] = '\0';
-		}	
-	} 
-	
-	/* 
-	** first non digit after a number 
-	*/
+/*
+** mathbounds
+**
+** Check a range of the array given as first element and count. An
+** empty range gives a count of 0, one outside the array stops the
+** program. Returns FALSE if there is nothing to do. The range is
+** checked as doubles, so that nan, inf or 1e300 are never cast.
+*/
 
-	if (numbuild && (! isdigit(xchar)) && (! (xchar == '.')) ) {
+int mathbounds(double first, double count, long *from, long *n) {
 
-	  sscanf(numstring,"%lf",&thenumber);
-	  cpush(thenumber);
-	  numbuild = FALSE;
-	}
-       
-	/* Get/Put Variables */
-	xchar = tolower(xchar);
-	if (xchar <= 'z' && 'a' <= xchar) {
-	  if (putget == GET || indirect == TRUE) {
+  *from = 0;
+  *n = 0;
+  if (count < 1) {
+    return FALSE;
+  }
+  first = trunc(first);
+  count = trunc(count);
+  if ( ! (first >= 0 && count <= arrayelements - first)) {
+    printf("Tiny -- %lf array range %g to %g out of bounds\n",
+	   exlino, first, first + count - 1);
+    running = FALSE;
+    return FALSE;
+  }
+  *from = (long) first;
+  *n = (long) count;
+  return TRUE;
+}
 
-	    cpush(varz[xchar - 'a']);
-	    
-	  } else {
-	    /* putget == Put && indirect == FALSE */
-	    varz[xchar - 'a'] = cpop();
-	    cpush(varz[xchar - 'a']);
-	   
-	  }
-	}
 
-      
-	switch (xchar) {
-	case '[':
-	  compstackindex = 0;
-	  putget = GET;
-	  indirect = FALSE;
-	  break;
+/*
+** mathlong
+**
+** One value of a function in long double, for --engine=longdouble.
+*/
 
-	case ']': putget = PUT;           break;
-	case '"': StringPrint = TRUE;     break;
-	case '+': cpush(cpop() + cpop()); break;
-	case '*': cpush(cpop() * cpop()); break;
-	case '!': cpush( ! cpop());       break;
-	case '_': cpush(cpop() * -1);     break;
+long double mathlong(int fn, long double x) {
 
-	case '(':
-	  if (putget == GET) {
+  switch (fn) {
+  case MATH_EXP:  return expl(x);
+  case MATH_LOG:  return logl(x);
+  case MATH_SIN:  return sinl(x);
+  case MATH_COS:  return cosl(x);
+  case MATH_ATAN: return atanl(x);
+  default:        return sqrtl(x);
+  }
+}
 
-	    /* does Nothing */
 
-	  } else { /* put */
+/*
+** mathrange
+**
+** A function over count elements of the array from first, in place.
+** A range outside the array stops the program.
+*/
 
-	    /* Raises indirect flag variables will be fetched */
-	    indirect = TRUE;
+void mathrange(int fn, double first, double count) {
 
-	  }
-	  break;
+  long from, n, i;
+  double tail[MATHLANES];
 
+  if ( ! mathbounds(first, count, &from, &n)) {
+    return;
+  }
+
+  if ( ! mathfast) {
+    for (i = from; i < from + n; i++) {
+      darray[i] = mathone(fn, darray[i]);
+    }
+    return;
+  }
+
+  for (i = from; i + MATHLANES <= from + n; i += MATHLANES) {
+    mathlanes(fn, darray + i);
+  }
+  if (i < from + n) {
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, darray + i, (from + n - i) * sizeof(double));
+    mathlanes(fn, tail);
+    memcpy(darray + i, tail, (from + n - i) * sizeof(double));
+  }
+}
+
+
+/*
+** Matrices
+**
+** {view A} makes A, one of the letters A to Z, a view of the array as
+** a matrix. It takes the top four of the stack and leaves them there:
+** the element at row 0 column 0, the rows, the columns, and the
+** elements from the start of one row to the start of the next. {A}
+** is then an element of the matrix, rows and columns counted from 0.
+** While getting it replaces a row and column with the element, while
+** putting it takes them off and stores the value below them:
+**
+**     [0 3 4 4] {view A}       A is 3 by 4, elements 0 to 11
+**     [1 2 {A}] x              x = A(1,2)
+**     [x 2 * 1 2] {A}          A(1,2) = 2x
+**
+** The kernels work on whole views and leave the stack alone. The view
+** the result goes to comes first. A vector can be a view of any shape
+** with the right number of elements, taken row by row:
+**
+**     {matmul C A B}           C = A B
+**     {transpose B A}          B = A transposed
+**     {matvec y A x}           y = A x
+**     {rowsum v A}             v(i) = sum of row i, and likewise
+**     {colsum v A}             ... {rowmin} {colmin} {rowmax} {colmax}
+**
+** A kernel works out its result in matrixspace and then stores it, so
+** the views may overlap.
+*/
+
+char *matrixnames[] = { "", "view", "matmul", "transpose", "matvec",
+			"rowsum", "colsum", "rowmin", "colmin", "rowmax",
+			"colmax", NULL };
+int matrixviews[] = { 1, 1, 3, 2, 3, 2, 2, 2, 2, 2, 2 }; /* views named */
+
+#define MATRIX_ELEMENT   0
+#define MATRIX_VIEW      1
+#define MATRIX_MATMUL    2
+#define MATRIX_TRANSPOSE 3
+#define MATRIX_MATVEC    4
+#define MATRIX_ROWSUM    5         /* reductions from here on, rows and */
+#define MATRIX_COLMAX   10         /* columns taking turns              */
+
+/* a call is the kernel and up to three views, packed in an OPNODE arg */
+#define CALLKERNEL(call)  ((call) & 255)
+#define CALLVIEW(call, n) (((call) >> (8 + 5 * (n))) & 31)
+
+#define VIEWROW(w, i)  (darray + (w)->base + (i) * (w)->stride)
+#define VIEWSIZE(w)    ((w)->rows * (w)->cols)
+
+#define MATMULROWS  64             /* rows of B one pass of matmul uses */
+#define MATMULCOLS 256             /* ... and columns, 128K of doubles  */
+#define TRANSBLOCK  32             /* square transposed at a time       */
+
+
+/*
+** matrixname
+**
+** Look up a matrix call after a '{': a view letter alone, or a kernel
+** name and its view letters separated by spaces. *len is set to the
+** characters the call and its '}' take up, and left alone if there is
+** no such call. Returns the call, else -1.
+*/
+
+int matrixname(char text[], int *len) {
+
+  int n, k, kernel, call;
+
+  for (n = 0; islower(text[n]); n++) {
+  }
+  for (kernel = 0; matrixnames[kernel] != NULL; kernel++) {
+    if ((int) strlen(matrixnames[kernel]) == n
+	&& strncmp(matrixnames[kernel], text, n) == 0) {
+      break;
+    }
+  }
+  if (matrixnames[kernel] == NULL) {
+    return -1;
+  }
+
+  call = kernel;
+  for (k = 0; k < matrixviews[kernel]; k++) {
+    if (n > 0) {
+      if (text[n] != ' ') {
+	return -1;
+      }
+      while (text[n] == ' ') {
+	n++;
+      }
+    }
+    if ( ! isupper(text[n]) || isalpha(text[n + 1])) {
+      return -1;
+    }
+    call |= (text[n] - 'A') << (8 + 5 * k);
+    n++;
+  }
+  while (text[n] == ' ') {
+    n++;
+  }
+  if (text[n] != '}') {
+    return -1;
+  }
+  *len = n + 1;
+  return call;
+}
+
+
+/*
+** viewdefine
+**
+** Set up view v, if it fits inside the array. Otherwise it is left as
+** it was and, if report is TRUE, the program is stopped.
+*/
+
+int viewdefine(int v, double base, double rows, double cols, double stride,
+	       int report) {
+
+  long b, r, c, s;
+
+  if (base > -1 && base < arrayelements && rows >= 1 && rows <= arrayelements
+      && cols >= 1 && cols <= arrayelements && stride >= cols
+      && stride <= arrayelements) {
+    b = (long) base;
+    r = (long) rows;
+    c = (long) cols;
+    s = (long) stride;
+    if (b + (r - 1) * s + c <= arrayelements) {
+      views[v].base = b;
+      views[v].rows = r;
+      views[v].cols = c;
+      views[v].stride = s;
+      return TRUE;
+    }
+  }
+  if (report) {
+    printf("Tiny -- %lf view %c does not fit the array\n", exlino, 'A' + v);
+    running = FALSE;
+  }
+  return FALSE;
+}
+
+
+/*
+** viewindex
+**
+** The array element at row and column of view v. If there is no such
+** element returns -1 and, if report is TRUE, stops the program.
+*/
+
+long viewindex(int v, double row, double col, int report) {
+
+  VIEW *w;
+
+  w = &views[v];
+  if (row > -1 && row < w->rows && col > -1 && col < w->cols) {
+    return w->base + (long) row * w->stride + (long) col;
+  }
+  if (report) {
+    if (w->rows == 0) {
+      printf("Tiny -- %lf no view %c\n", exlino, 'A' + v);
+    } else {
+      printf("Tiny -- %lf view %c has no element %g %g\n",
+	     exlino, 'A' + v, row, col);
+    }
+    running = FALSE;
+  }
+  return -1;
+}
+
+
+/*
+** matmul
+**
+** c = a b, with c as rows of b->cols elements end to end. Each pass
+** takes a block of b small enough to stay in the cache and adds what
+** it gives to every row of c. Each element of c still adds up its
+** products in order, the blocking only changes when it does so.
+*/
+
+static void matmul(VIEW *a, VIEW *b, double *c) {
+
+  long i, j, k, kk, jj, kend, jend, p;
+  double *crow, *arow, *brow;
+  double x;
+  vdouble vx, vb, vc;
+
+  p = b->cols;
+  memset(c, 0, a->rows * p * sizeof(double));
+  for (jj = 0; jj < p; jj += MATMULCOLS) {
+    jend = jj + MATMULCOLS < p ? jj + MATMULCOLS : p;
+    for (kk = 0; kk < a->cols; kk += MATMULROWS) {
+      kend = kk + MATMULROWS < a->cols ? kk + MATMULROWS : a->cols;
+      for (i = 0; i < a->rows; i++) {
+	crow = c + i * p;
+	arow = VIEWROW(a, i);
+	for (k = kk; k < kend; k++) {
+	  x = arow[k];
+	  vx = VC(x);
+	  brow = VIEWROW(b, k);
+	  for (j = jj; j + MATHLANES <= jend; j += MATHLANES) {
+	    memcpy(&vb, brow + j, sizeof(vb));
+	    memcpy(&vc, crow + j, sizeof(vc));
+	    vc += vx * vb;
+	    memcpy(crow + j, &vc, sizeof(vc));
+	  }
+	  for (; j < jend; j++) {
+	    crow[j] += x * brow[j];
+	  }
+	}
+      }
+    }
+  }
+}
+
+
+/*
+** matvec
+**
+** y = a x, x given as a->cols elements end to end.
+*/
+
+static void matvec(VIEW *a, double *x, double *y) {
+
+  long i, k;
+  double *arow;
+  double sum, lanes[MATHLANES];
+  vdouble va, vx, vsum;
+
+  for (i = 0; i < a->rows; i++) {
+    arow = VIEWROW(a, i);
+    vsum = VC(0.0);
+    for (k = 0; k + MATHLANES <= a->cols; k += MATHLANES) {
+      memcpy(&va, arow + k, sizeof(va));
+      memcpy(&vx, x + k, sizeof(vx));
+      vsum += va * vx;
+    }
+    memcpy(lanes, &vsum, sizeof(lanes));
+    sum = 0;
+    for (k = 0; k < MATHLANES; k++) {
+      sum += lanes[k];
+    }
+    for (k = a->cols - a->cols % MATHLANES; k < a->cols; k++) {
+      sum += arow[k] * x[k];
+    }
+    y[i] = sum;
+  }
+}
+
+
+/*
+** transpose
+**
+** t = a transposed, a square block at a time so that both the rows
+** read and the rows written stay in the cache.
+*/
+
+static void transpose(VIEW *a, double *t) {
+
+  long i, j, ii, jj, iend, jend;
+  double *arow;
+
+  for (ii = 0; ii < a->rows; ii += TRANSBLOCK) {
+    iend = ii + TRANSBLOCK < a->rows ? ii + TRANSBLOCK : a->rows;
+    for (jj = 0; jj < a->cols; jj += TRANSBLOCK) {
+      jend = jj + TRANSBLOCK < a->cols ? jj + TRANSBLOCK : a->cols;
+      for (i = ii; i < iend; i++) {
+	arow = VIEWROW(a, i);
+	for (j = jj; j < jend; j++) {
+	  t[j * a->rows + i] = arow[j];
+	}
+      }
+    }
+  }
+}
+
+
+/*
+** reduce
+**
+** The sum, least or greatest of each row or each column of a, for a
+** reduction kernel.
+*/
+
+static void reduce(int kernel, VIEW *a, double *r) {
+
+  long i, j;
+  int what;              /* 0 sum, 1 least, 2 greatest                    */
+  double *arow;
+  double x;
+
+  what = (kernel - MATRIX_ROWSUM) / 2;
+  if ((kernel - MATRIX_ROWSUM) % 2 == 0) {
+    for (i = 0; i < a->rows; i++) {
+      arow = VIEWROW(a, i);
+      x = arow[0];
+      for (j = 1; j < a->cols; j++) {
+	switch (what) {
+	case 0: x += arow[j];                         break;
+	case 1: x = arow[j] < x ? arow[j] : x;        break;
+	case 2: x = arow[j] > x ? arow[j] : x;        break;
+	}
+      }
+      r[i] = x;
+    }
+    return;
+  }
+
+  memcpy(r, VIEWROW(a, 0), a->cols * sizeof(double));
+  for (i = 1; i < a->rows; i++) {
+    arow = VIEWROW(a, i);
+    switch (what) {
+    case 0:
+      for (j = 0; j < a->cols; j++) {
+	r[j] += arow[j];
+      }
+      break;
+    case 1:
+      for (j = 0; j < a->cols; j++) {
+	r[j] = arow[j] < r[j] ? arow[j] : r[j];
+      }
+      break;
+    case 2:
+      for (j = 0; j < a->cols; j++) {
+	r[j] = arow[j] > r[j] ? arow[j] : r[j];
+      }
+      break;
+    }
+  }
+}
+
+
+/*
+** matrixcall
+**
+** Run a matrix kernel. Views that are not set up or do not match in
+** size stop the program.
+*/
+
+void matrixcall(int call) {
+
+  int kernel, k;
+  VIEW *w[3];
+  long out, need, i;
+
+  kernel = CALLKERNEL(call);
+  for (k = 0; k < matrixviews[kernel]; k++) {
+    w[k] = &views[CALLVIEW(call, k)];
+    if (w[k]->rows == 0) {
+      printf("Tiny -- %lf no view %c\n", exlino, 'A' + CALLVIEW(call, k));
+      running = FALSE;
+      return;
+    }
+  }
+
+  switch (kernel) {
+  case MATRIX_MATMUL:
+    out = w[1]->cols == w[2]->rows && w[0]->rows == w[1]->rows
+          && w[0]->cols == w[2]->cols ? VIEWSIZE(w[0]) : -1;
+    break;
+  case MATRIX_TRANSPOSE:
+    out = w[0]->rows == w[1]->cols && w[0]->cols == w[1]->rows
+          ? VIEWSIZE(w[0]) : -1;
+    break;
+  case MATRIX_MATVEC:
+    out = VIEWSIZE(w[2]) == w[1]->cols && VIEWSIZE(w[0]) == w[1]->rows
+          ? VIEWSIZE(w[0]) : -1;
+    break;
+  default:
+    out = (kernel - MATRIX_ROWSUM) % 2 == 0 ? w[1]->rows : w[1]->cols;
+    if (VIEWSIZE(w[0]) != out) {
+      out = -1;
+    }
+    break;
+  }
+  if (out < 0) {
+    printf("Tiny -- %lf {%s} views do not match\n",
+	   exlino, matrixnames[kernel]);
+    running = FALSE;
+    return;
+  }
+
+  /* matvec copies its x in after the result */
+  need = kernel == MATRIX_MATVEC ? out + w[1]->cols : out;
+  if (need > matrixsize) {
+    matrixspace = realloc(matrixspace, need * sizeof(double));
+    matrixsize = need;
+  }
+
+  switch (kernel) {
+  case MATRIX_MATMUL:
+    matmul(w[1], w[2], matrixspace);
+    break;
+  case MATRIX_TRANSPOSE:
+    transpose(w[1], matrixspace);
+    break;
+  case MATRIX_MATVEC:
+    for (i = 0; i < w[2]->rows; i++) {
+      memcpy(matrixspace + out + i * w[2]->cols, VIEWROW(w[2], i),
+	     w[2]->cols * sizeof(double));
+    }
+    matvec(w[1], matrixspace + out, matrixspace);
+    break;
+  default:
+    reduce(kernel, w[1], matrixspace);
+    break;
+  }
+
+  for (i = 0; i < w[0]->rows; i++) {
+    memcpy(VIEWROW(w[0], i), matrixspace + i * w[0]->cols,
+	   w[0]->cols * sizeof(double));
+  }
+}
+
+
+/*
+** Data files
+**
+** {csvin f c} {csvout f} {binin f} {binout f} move a range of the
+** array to or from the file f, a path without spaces. Whether getting
+** or putting, they take the top of the stack as a count and the one
+** below as the first element, like a maths function while putting.
+**
+** {csvin f c} reads the number in column c, 1 if not given, of each
+** row until count are read or the file ends, skipping rows where it
+** is not a number, such as headings. {binin f} reads doubles stored
+** little-endian. Both leave the count read on top of the stack.
+** {csvout f} writes a number a row, shortest first where it reads
+** back the same, and {binout f} little-endian doubles.
+**
+** A CSV file is mapped and its numbers parsed where they lie; a binary
+** one is read straight into the array.
+*/
+
+char *datanames[] = { "csvin", "csvout", "binin", "binout", NULL };
+
+#define DATA_CSVIN  0
+#define DATA_CSVOUT 1
+#define DATA_BININ  2
+#define DATA_BINOUT 3
+
+#define DATACOLUMNS 4096           /* highest column {csvin} reads      */
+#define DATABUFFER 65536           /* bytes written at a time           */
+#define DATABIGENDIAN (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+
+/* a call is the kind and, for {csvin}, the column counted from 0 */
+#define DATAKIND(call)   ((call) & 3)
+#define DATACOLUMN(call) ((call) >> 2)
+
+/* the powers of ten a double holds exactly */
+static const double datapowers[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/*
+** dataname
+**
+** Look up a data file call after a '{': its name, a space, the path
+** and for {csvin} perhaps a column. *len is set to the characters the
+** call and its '}' take up, *path and *pathlen to where the path is
+** in text, all left alone if there is no such call.
+** Returns the call, else -1.
+*/
+
+int dataname(char text[], int *len, int *path, int *pathlen) {
+
+  int n, kind, start, column;
+
+  for (n = 0; islower(text[n]); n++) {
+  }
+  for (kind = 0; datanames[kind] != NULL; kind++) {
+    if ((int) strlen(datanames[kind]) == n
+	&& strncmp(datanames[kind], text, n) == 0) {
+      break;
+    }
+  }
+  if (datanames[kind] == NULL || text[n] != ' ') {
+    return -1;
+  }
+
+  while (text[n] == ' ') {
+    n++;
+  }
+  start = n;
+  while (text[n] != '\0' && text[n] != ' ' && text[n] != '}') {
+    n++;
+  }
+  if (n == start) {
+    return -1;
+  }
+  *pathlen = n - start;
+  while (text[n] == ' ') {
+    n++;
+  }
+
+  column = 1;
+  if (kind == DATA_CSVIN && isdigit(text[n])) {
+    for (column = 0; isdigit(text[n]); n++) {
+      if (column <= DATACOLUMNS) {
+	column = column * 10 + text[n] - '0';
+      }
+    }
+    if (column < 1 || column > DATACOLUMNS) {
+      return -1;
+    }
+    while (text[n] == ' ') {
+      n++;
+    }
+  }
+  if (text[n] != '}') {
+    return -1;
+  }
+  *len = n + 1;
+  *path = start;
+  return kind | (column - 1) << 2;
+}
+
+
+/*
+** dataparse
+**
+** The number in s up to end, with spaces or double quotes round it,
+** else FALSE. Up to 19 digits are gathered in an integer; when that
+** is at most 2^53 and the power of ten at most 22, both are exact and
+** one multiply or divide rounds correctly. Anything else, including
+** inf and nan, is left to strtod().
+*/
+
+static int dataparse(char *s, char *end, double *x) {
+
+  char *p, *q;
+  char buf[64];
+  unsigned long long m;
+  int neg, any, digits, exp10, e, eneg;
+
+  while (s < end && (*s == ' ' || *s == '\t')) {
+    s++;
+  }
+  while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+    end--;
+  }
+  if (end - s >= 2 && *s == '"' && end[-1] == '"') {
+    s++;
+    end--;
+  }
+
+  p = s;
+  neg = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  m = 0;
+  any = FALSE;
+  digits = 0;
+  exp10 = 0;
+  for ( ; p < end && *p >= '0' && *p <= '9'; p++) {
+    if (digits == 19) {
+      goto slow;
+    }
+    m = m * 10 + (*p - '0');
+    digits += m != 0;
+    any = TRUE;
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (digits == 19) {
+	goto slow;
+      }
+      m = m * 10 + (*p - '0');
+      digits += m != 0;
+      exp10--;
+      any = TRUE;
+    }
+  }
+  if ( ! any) {
+    goto slow;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    eneg = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+      return FALSE;
+    }
+    for (e = 0; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (e < 10000) {
+	e = e * 10 + (*p - '0');
+      }
+    }
+    exp10 += eneg ? -e : e;
+  }
+  if (p != end) {
+    goto slow;
+  }
+
+  if (m <= 1ULL << 53 && exp10 >= -22 && exp10 <= 22) {
+    *x = exp10 < 0 ? (double) m / datapowers[-exp10]
+                   : (double) m * datapowers[exp10];
+    if (neg) {
+      *x = - *x;
+    }
+    return TRUE;
+  }
+
+ slow:
+  if (s == end || end - s >= (long) sizeof(buf)) {
+    return FALSE;
+  }
+  memcpy(buf, s, end - s);
+  buf[end - s] = '\0';
+  *x = strtod(buf, &q);
+  return q == buf + (end - s);
+}
+
+
+/*
+** csvread
+**
+** Up to n numbers from column column of the rows in buf, into to.
+** Returns how many were read.
+*/
+
+static long csvread(char *buf, long size, int column, double *to, long n) {
+
+  char *p, *end, *eol, *f, *fend;
+  long got;
+  int c;
+  double x;
+
+  got = 0;
+  end = buf + size;
+  for (p = buf; p < end && got < n; p = eol + 1) {
+    eol = memchr(p, '\n', end - p);
+    if (eol == NULL) {
+      eol = end;
+    }
+    f = p;
+    for (c = 0; c < column && f != NULL; c++) {
+      f = memchr(f, ',', eol - f);
+      if (f != NULL) {
+	f++;
+      }
+    }
+    if (f == NULL) {
+      continue;
+    }
+    fend = memchr(f, ',', eol - f);
+    if (dataparse(f, fend != NULL ? fend : eol, &x)) {
+      to[got++] = x;
+    }
+  }
+  return got;
+}
+
+
+/*
+** datamove
+**
+** Read or write all len bytes of buf, going round again for what a
+** call leaves. Returns FALSE if the file ends or fails first.
+*/
+
+static int datamove(int fd, char *buf, long len, int writing) {
+
+  long done;
+
+  while (len > 0) {
+    done = writing ? write(fd, buf, len) : read(fd, buf, len);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      return FALSE;
+    }
+    buf += done;
+    len -= done;
+  }
+  return TRUE;
+}
+
+
+/*
+** dataswap
+**
+** Reverse the bytes of n doubles, for a big-endian machine.
+*/
+
+static void dataswap(double *p, long n) {
+
+  unsigned char *b, t;
+  long i;
+  int k;
+
+  for (i = 0; i < n; i++) {
+    b = (unsigned char *) (p + i);
+    for (k = 0; k < 4; k++) {
+      t = b[k];
+      b[k] = b[7 - k];
+      b[7 - k] = t;
+    }
+  }
+}
+
+
+/*
+** csvformat
+**
+** Write x, which is not a whole number, at to as the fewest of 15, 16
+** or 17 significant digits that read back the same, the way %g would.
+** Between 2^-67 and 2^53 the digits are worked out exactly in 128-bit
+** integers and each shorter form checked the way dataparse() reads it,
+** or by strtod() when it is too long for that; anything else is left
+** to sprintf().
+** Returns the characters written.
+*/
+
+static int csvformat(double x, char *to) {
+
+  unsigned __int128 one, frac;
+  unsigned long long mant, whole, m;
+  char d[20];            /* the first 18 significant digits               */
+  char tmp[32];
+  int exp2, k, nd, dp, p, i, up, len;
+  double ax, y;
+
+  ax = fabs(x);
+  mant = (unsigned long long) ldexp(frexp(ax, &exp2), 53);
+  k = 53 - exp2;
+  if (ax == 0 || ! (ax < 9007199254740992.0) || k > 120) {
+    for (p = 15; p < 17; p++) {
+      len = sprintf(to, "%.*g", p, x);
+      if (strtod(to, NULL) == x) {
+	return len;
+      }
+    }
+    return sprintf(to, "%.17g", x);
+  }
+
+  /* ax is mant / 2^k: the digits of the whole part, then of the rest */
+  one = (unsigned __int128) 1 << k;
+  whole = (unsigned long long) (mant / one);
+  frac = mant & (one - 1);
+  for (dp = 0, m = whole; m != 0; m /= 10) {
+    dp++;
+  }
+  for (m = whole, i = dp - 1; i >= 0; i--, m /= 10) {
+    d[i] = '0' + m % 10;
+  }
+  nd = dp;
+  while (nd < 18) {
+    frac *= 10;
+    i = (int) (frac >> k);
+    frac &= one - 1;
+    if (nd == 0 && i == 0) {
+      dp--;
+    } else {
+      d[nd++] = '0' + i;
+    }
+  }
+
+  for (p = 15; p <= 17; p++) {
+    /* round to p digits, a tie to even */
+    up = d[p] > '5';
+    if (d[p] == '5') {
+      up = frac != 0 || (d[p - 1] - '0') % 2;
+      for (i = p + 1; i < 18; i++) {
+	up |= d[i] != '0';
+      }
+    }
+    for (m = 0, i = 0; i < p; i++) {
+      m = m * 10 + (d[i] - '0');
+    }
+    m += up;
+    if (p == 17) {
+      break;
+    }
+    if (m <= 1ULL << 53 && dp - p >= -22 && dp - p <= 22) {
+      y = dp - p < 0 ? (double) m / datapowers[p - dp]
+	             : (double) m * datapowers[dp - p];
+    } else {
+      sprintf(tmp, "%llue%d", m, dp - p);
+      y = strtod(tmp, NULL);
+    }
+    if (y == ax) {
+      break;
+    }
+  }
+
+  /* the digits of m, less trailing zeros, a carry making one more */
+  nd = 0;
+  for (k = 0; m != 0; m /= 10) {
+    if (m % 10 == 0 && nd == 0) {
+      k++;
+      continue;
+    }
+    d[nd++] = '0' + m % 10;
+  }
+  if (nd + k > p) {
+    dp++;
+  }
+
+  len = 0;
+  if (x < 0) {
+    to[len++] = '-';
+  }
+  if (dp < -3) {
+    to[len++] = d[nd - 1];
+    if (nd > 1) {
+      to[len++] = '.';
+    }
+    for (i = nd - 2; i >= 0; i--) {
+      to[len++] = d[i];
+    }
+    return len + sprintf(to + len, "e-%02d", 1 - dp);
+  }
+  if (dp <= 0) {
+    to[len++] = '0';
+    to[len++] = '.';
+    for (i = dp; i < 0; i++) {
+      to[len++] = '0';
+    }
+  }
+  for (i = nd - 1; i >= 0; i--) {
+    to[len++] = d[i];
+    if (i > 0 && nd - i == dp) {
+      to[len++] = '.';
+    }
+  }
+  for (i = nd; i < dp; i++) {
+    to[len++] = '0';
+  }
+  return len;
+}
+
+
+/*
+** csvwrite
+**
+** Write n numbers from from, one a row, gathered DATABUFFER bytes at a
+** time. Whole numbers are written out digit by digit, others by
+** csvformat().
+*/
+
+static int csvwrite(int fd, double *from, long n) {
+
+  char buf[DATABUFFER];
+  char digits[24];
+  long i, len, k;
+  unsigned long long u;
+  double x;
+
+  len = 0;
+  for (i = 0; i < n; i++) {
+    if (len > DATABUFFER - 64) {
+      if ( ! datamove(fd, buf, len, TRUE)) {
+	return FALSE;
+      }
+      len = 0;
+    }
+    x = from[i];
+    if (x == floor(x) && fabs(x) <= 9007199254740992.0
+	&& ! (x == 0 && signbit(x))) {
+      if (x < 0) {
+	buf[len++] = '-';
+      }
+      u = (unsigned long long) fabs(x);
+      k = 0;
+      do {
+	digits[k++] = '0' + u % 10;
+	u /= 10;
+      } while (u != 0);
+      while (k > 0) {
+	buf[len++] = digits[--k];
+      }
+    } else {
+      len += csvformat(x, buf + len);
+    }
+    buf[len++] = '\n';
+  }
+  return datamove(fd, buf, len, TRUE);
+}
+
+
+/*
+** datacall
+**
+** Run a data file call on the file path. A range out of the array or
+** a file that can not be opened, read or written stops the program.
+*/
+
+void datacall(char path[], int call) {
+
+  int kind, fd, ok;
+  long from, n, got, i;
+  struct stat st;
+  char *map;
+  double *buf;
+
+  kind = DATAKIND(call);
+  if ( ! mathbounds(compstack[compstackindex - 2],
+		    compstack[compstackindex - 1], &from, &n)) {
+    if (running && (kind == DATA_CSVIN || kind == DATA_BININ)) {
+      compstack[compstackindex - 1] = 0;
+    }
+    return;
+  }
+
+  if (kind == DATA_CSVIN || kind == DATA_BININ) {
+    fd = open(path, O_RDONLY);
+  } else {
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  }
+  if (fd < 0) {
+    printf("Tiny -- %lf {%s} can't open %s\n", exlino, datanames[kind], path);
+    running = FALSE;
+    return;
+  }
+
+  ok = TRUE;
+  switch (kind) {
+  case DATA_CSVIN:
+    got = 0;
+    ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size > 0) {
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = map != MAP_FAILED;
+      if (ok) {
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	got = csvread(map, st.st_size, DATACOLUMN(call), darray + from, n);
+	munmap(map, st.st_size);
+      }
+    }
+    compstack[compstackindex - 1] = got;
+    break;
+
+  case DATA_BININ:
+    got = 0;
+    ok = fstat(fd, &st) == 0;
+    if (ok) {
+      got = st.st_size / (long) sizeof(double) < n
+	    ? st.st_size / (long) sizeof(double) : n;
+      ok = datamove(fd, (char *) (darray + from), got * sizeof(double), FALSE);
+      if (DATABIGENDIAN) {
+	dataswap(darray + from, got);
+      }
+    }
+    compstack[compstackindex - 1] = got;
+    break;
+
+  case DATA_CSVOUT:
+    ok = csvwrite(fd, darray + from, n);
+    break;
+
+  case DATA_BINOUT:
+    if ( ! DATABIGENDIAN) {
+      ok = datamove(fd, (char *) (darray + from), n * sizeof(double), TRUE);
+      break;
+    }
+    buf = malloc(DATABUFFER);
+    for (i = 0; i < n && ok; i += got) {
+      got = n - i < DATABUFFER / (long) sizeof(double)
+	    ? n - i : DATABUFFER / (long) sizeof(double);
+      memcpy(buf, darray + from + i, got * sizeof(double));
+      dataswap(buf, got);
+      ok = datamove(fd, (char *) buf, got * sizeof(double), TRUE);
+    }
+    free(buf);
+    break;
+  }
+
+  if (close(fd) != 0) {
+    ok = FALSE;
+  }
+  if ( ! ok) {
+    printf("Tiny -- %lf {%s} can't %s %s\n", exlino, datanames[kind],
+	   kind == DATA_CSVIN || kind == DATA_BININ ? "read" : "write", path);
+    running = FALSE;
+  }
+}
+
+
+/*
+** Sorting
+**
+** [first count] {sort} sorts a range of the array in place. The rest
+** take one more number from the top of the stack:
+**
+**    {sortwith}  the first element of a second range, whose elements
+**                are moved with those of the range being sorted
+**    {select}    k, the element where sorting would put the k-th least
+**                counting from 0; only that one is put there, with
+**                the less before and the greater after, and it is
+**                left on the stack in place of k
+**    {search}    x, replaced by the index of the first element of a
+**                sorted range not less than x, or first + count
+**
+** Whether getting or putting, these leave the stack as it is but for
+** the top of {select} and {search}. Numbers are put in the order of
+** their bits made unsigned, which is < for numbers, with -0 before 0
+** and nan after inf.
+**
+** Sorts are radix sorts SORTBITS at a time, passing over digits all
+** the keys share. One of SORTPARALLEL or more is shared out between
+** --threads threads in pieces, which are then merged a pair to a
+** thread.
+*/
+
+char *sortnames[] = { "sort", "sortwith", "select", "search", NULL };
+char *sortneeds[] = { "a first and count", "a first, count and first",
+		      "a first, count and k", "a first, count and x" };
+
+#define SORT_SORT   0
+#define SORT_WITH   1
+#define SORT_SELECT 2
+#define SORT_SEARCH 3
+
+#define SORTSMALL 32               /* sorted by insertion below this    */
+#define SORTPARALLEL 65536         /* least sorted on --threads         */
+#define SORTBITS 11                /* bits of a radix digit             */
+#define SORTBUCKETS (1 << SORTBITS)
+#define SORTPASSES ((64 + SORTBITS - 1) / SORTBITS)
+
+typedef unsigned long long SORTKEY;
+
+/* A piece to radix sort, or a pair to merge, for one thread */
+typedef struct sortjob {
+  pthread_t thread;
+  int     made;                    /* thread was started                */
+  SORTKEY *key, *keyto;            /* keys, and room as big             */
+  double  *with, *withto;          /* ... the moved elements, or NULL   */
+  long    lo, mid, hi;             /* merge lo to mid with mid to hi,   */
+                                   /* or sort lo to hi if mid < 0       */
+} SORTJOB;
+
+
+/*
+** sortkey / sortvalue
+**
+** A number as a key that sorts as an unsigned integer, and back.
+*/
+
+static SORTKEY sortkey(double x) {
+
+  SORTKEY u;
+
+  memcpy(&u, &x, sizeof(u));
+  return u >> 63 ? ~u : u | 1ULL << 63;
+}
+
+static double sortvalue(SORTKEY u) {
+
+  double x;
+
+  u = u >> 63 ? u & ~(1ULL << 63) : ~u;
+  memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+
+/*
+** insertsort
+**
+** Sort n keys, and their elements if with is not NULL, by insertion.
+*/
+
+static void insertsort(SORTKEY *key, double *with, long n) {
+
+  long i, j;
+  SORTKEY k;
+  double w;
+
+  for (i = 1; i < n; i++) {
+    k = key[i];
+    w = with != NULL ? with[i] : 0;
+    for (j = i; j > 0 && key[j - 1] > k; j--) {
+      key[j] = key[j - 1];
+      if (with != NULL) {
+	with[j] = with[j - 1];
+      }
+    }
+    key[j] = k;
+    if (with != NULL) {
+      with[j] = w;
+    }
+  }
+}
+
+
+/*
+** radixsort
+**
+** Sort n keys, and their elements if with is not NULL, least digit
+** first, using keyto and withto as room. The counts for every digit
+** are made in one pass; a digit with all n in one bucket is left out.
+*/
+
+static void radixsort(SORTKEY *key, SORTKEY *keyto, double *with,
+		      double *withto, long n) {
+
+  long (*count)[SORTBUCKETS];
+  long i, at, c;
+  int pass, shift, d;
+  SORTKEY *ks, *kd, *kt;
+  double *ws, *wd, *wt;
+
+  if (n < SORTSMALL) {
+    insertsort(key, with, n);
+    return;
+  }
+
+  count = calloc(SORTPASSES, sizeof(*count));
+  for (i = 0; i < n; i++) {
+    for (pass = 0; pass < SORTPASSES; pass++) {
+      count[pass][(key[i] >> (pass * SORTBITS)) & (SORTBUCKETS - 1)]++;
+    }
+  }
+
+  ks = key;
+  kd = keyto;
+  ws = with;
+  wd = withto;
+  for (pass = 0; pass < SORTPASSES; pass++) {
+    shift = pass * SORTBITS;
+    if (count[pass][(ks[0] >> shift) & (SORTBUCKETS - 1)] == n) {
+      continue;
+    }
+    for (at = 0, d = 0; d < SORTBUCKETS; d++) {
+      c = count[pass][d];
+      count[pass][d] = at;
+      at += c;
+    }
+    for (i = 0; i < n; i++) {
+      at = count[pass][(ks[i] >> shift) & (SORTBUCKETS - 1)]++;
+      kd[at] = ks[i];
+      if (ws != NULL) {
+	wd[at] = ws[i];
+      }
+    }
+    kt = ks; ks = kd; kd = kt;
+    wt = ws; ws = wd; wd = wt;
+  }
+  free(count);
+
+  if (ks != key) {
+    memcpy(key, ks, n * sizeof(SORTKEY));
+    if (with != NULL) {
+      memcpy(with, ws, n * sizeof(double));
+    }
+  }
+}
+
+
+/*
+** sortwork
+**
+** Run a sort job, on a thread of its own or the program's.
+*/
+
+static void *sortwork(void *arg) {
+
+  SORTJOB *j;
+  long a, b, o;
+
+  j = arg;
+  if (j->mid < 0) {
+    radixsort(j->key + j->lo, j->keyto + j->lo,
+	      j->with != NULL ? j->with + j->lo : NULL,
+	      j->with != NULL ? j->withto + j->lo : NULL, j->hi - j->lo);
+    return NULL;
+  }
+
+  /* a stable merge into keyto, the left taken first on a tie */
+  a = j->lo;
+  b = j->mid;
+  for (o = j->lo; o < j->hi; o++) {
+    if (b == j->hi || (a < j->mid && j->key[a] <= j->key[b])) {
+      j->keyto[o] = j->key[a];
+      if (j->with != NULL) {
+	j->withto[o] = j->with[a];
+      }
+      a++;
+    } else {
+      j->keyto[o] = j->key[b];
+      if (j->with != NULL) {
+	j->withto[o] = j->with[b];
+      }
+      b++;
+    }
+  }
+  return NULL;
+}
+
+
+/*
+** sortrun
+**
+** Run jobs 1 to n - 1 on threads and job 0 here, then wait for them.
+** A thread that can't be made has its job run here instead.
+*/
+
+static void sortrun(SORTJOB *jobs, int n) {
+
+  int t;
+
+  for (t = 1; t < n; t++) {
+    jobs[t].made = pthread_create(&jobs[t].thread, NULL, sortwork,
+				  &jobs[t]) == 0;
+  }
+  sortwork(&jobs[0]);
+  for (t = 1; t < n; t++) {
+    if (jobs[t].made) {
+      pthread_join(jobs[t].thread, NULL);
+    } else {
+      sortwork(&jobs[t]);
+    }
+  }
+}
+
+
+/*
+** sortkeys
+**
+** Sort n keys, and their elements if with is not NULL, on --threads
+** threads if there are SORTPARALLEL or more: a piece for each to radix
+** sort, then rounds merging pairs of pieces, going from key to keyto
+** and back, until one is left.
+*/
+
+static void sortkeys(SORTKEY *key, SORTKEY *keyto, double *with,
+		     double *withto, long n) {
+
+  SORTJOB jobs[PARTHREADLIMIT];
+  long lo[PARTHREADLIMIT + 1];
+  int pieces, t;
+  SORTKEY *kt, *kfirst;
+  double *wt, *wfirst;
+
+  pieces = n < SORTPARALLEL ? 1 : parthreads;
+  if (pieces == 1) {
+    radixsort(key, keyto, with, withto, n);
+    return;
+  }
+
+  kfirst = key;
+  wfirst = with;
+  for (t = 0; t <= pieces; t++) {
+    lo[t] = n / pieces * t + (t < n % pieces ? t : n % pieces);
+  }
+  for (t = 0; t < pieces; t++) {
+    jobs[t].key = key;
+    jobs[t].keyto = keyto;
+    jobs[t].with = with;
+    jobs[t].withto = withto;
+    jobs[t].lo = lo[t];
+    jobs[t].mid = -1;
+    jobs[t].hi = lo[t + 1];
+  }
+  sortrun(jobs, pieces);
+
+  while (pieces > 1) {
+    for (t = 0; t < pieces / 2; t++) {
+      jobs[t].key = key;
+      jobs[t].keyto = keyto;
+      jobs[t].with = with;
+      jobs[t].withto = withto;
+      jobs[t].lo = lo[2 * t];
+      jobs[t].mid = lo[2 * t + 1];
+      jobs[t].hi = lo[2 * t + 2];
+    }
+    /* an odd piece out is merged with nothing, which copies it */
+    if (pieces % 2) {
+      jobs[t] = jobs[0];
+      jobs[t].lo = lo[pieces - 1];
+      jobs[t].mid = lo[pieces];
+      jobs[t].hi = lo[pieces];
+      t++;
+    }
+    sortrun(jobs, t);
+
+    for (t = 0; 2 * t < pieces; t++) {
+      lo[t] = lo[2 * t];
+    }
+    lo[t] = n;
+    pieces = t;
+    kt = key; key = keyto; keyto = kt;
+    wt = with; with = withto; withto = wt;
+  }
+
+  /* the merges may have left them in the room given */
+  if (key != kfirst) {
+    memcpy(kfirst, key, n * sizeof(SORTKEY));
+    if (with != NULL) {
+      memcpy(wfirst, with, n * sizeof(double));
+    }
+  }
+}
+
+
+/*
+** sortselect
+**
+** Put the k-th least of n keys where sorting would, the less before
+** it and the greater after, by partitioning round the middle of three.
+** Ranges that partition badly are radix sorted instead.
+*/
+
+static void sortselect(SORTKEY *key, SORTKEY *keyto, long n, long k) {
+
+  long lo, hi, i, j, rounds;
+  SORTKEY a, b, c, pivot, t;
+
+  lo = 0;
+  hi = n - 1;
+  for (rounds = 0; hi - lo >= SORTSMALL; rounds++) {
+    if (rounds == 64) {
+      radixsort(key + lo, keyto, NULL, NULL, hi - lo + 1);
+      return;
+    }
+    a = key[lo];
+    b = key[lo + (hi - lo) / 2];
+    c = key[hi];
+    pivot = a < b ? (b < c ? b : a < c ? c : a) : (a < c ? a : b < c ? c : b);
+    i = lo;
+    j = hi;
+    while (i <= j) {
+      while (key[i] < pivot) {
+	i++;
+      }
+      while (key[j] > pivot) {
+	j--;
+      }
+      if (i <= j) {
+	t = key[i];
+	key[i++] = key[j];
+	key[j--] = t;
+      }
+    }
+    if (k <= j) {
+      hi = j;
+    } else if (k >= i) {
+      lo = i;
+    } else {
+      return;
+    }
+  }
+  insertsort(key + lo, NULL, hi - lo + 1);
+}
+
+
+/*
+** sortcall
+**
+** Run a sorting call on the stack's range. A range out of the array,
+** or a k not in it, stops the program.
+*/
+
+void sortcall(int what) {
+
+  double *top;
+  long from, n, other, i, lo, hi, k;
+  SORTKEY *key, *keyto, x;
+  double *with, *withto;
+
+  top = &compstack[compstackindex - 1];
+  k = 0;
+  if (what == SORT_SORT) {
+    mathbounds(top[-1], top[0], &from, &n);
+  } else {
+    mathbounds(top[-2], top[-1], &from, &n);
+  }
+  if ( ! running) {
+    return;
+  }
+
+  switch (what) {
+  case SORT_SEARCH:
+    x = sortkey(*top);
+    lo = from;
+    hi = from + n;
+    while (lo < hi) {
+      i = lo + (hi - lo) / 2;
+      if (sortkey(darray[i]) < x) {
+	lo = i + 1;
+      } else {
+	hi = i;
+      }
+    }
+    *top = lo;
+    return;
+
+  case SORT_SELECT:
+    k = (long) *top;
+    if (k < 0 || k >= n || k != *top) {
+      printf("Tiny -- %lf {select} %g is not 0 to %ld\n", exlino, *top, n - 1);
+      running = FALSE;
+      return;
+    }
+    break;
+
+  case SORT_WITH:
+    if ( ! mathbounds(*top, top[-1], &other, &n)) {
+      return;
+    }
+    break;
+  }
+  if (n == 0) {
+    return;
+  }
+
+  key = malloc(2 * n * sizeof(SORTKEY));
+  keyto = key + n;
+  for (i = 0; i < n; i++) {
+    key[i] = sortkey(darray[from + i]);
+  }
+  with = NULL;
+  withto = NULL;
+  if (what == SORT_WITH) {
+    with = malloc(2 * n * sizeof(double));
+    withto = with + n;
+    memcpy(with, darray + other, n * sizeof(double));
+  }
+
+  if (what == SORT_SELECT) {
+    sortselect(key, keyto, n, k);
+    *top = sortvalue(key[k]);
+  } else {
+    sortkeys(key, keyto, with, withto, n);
+  }
+
+  for (i = 0; i < n; i++) {
+    darray[from + i] = sortvalue(key[i]);
+  }
+  if (with != NULL) {
+    memcpy(darray + other, with, n * sizeof(double));
+    free(with);
+  }
+  free(key);
+}
+
+
+/*
+** Hash table
+**
+**    [k v] {hput}                the table holds v for the key k
+**    [k] {hget}                  k, replaced by what the table holds
+**                                for it, 0 if nothing
+**    [k] {hhas}                  k, replaced by 1 if the table holds
+**                                it, else 0
+**    [k] {hdel}                  ... and k is taken out of the table
+**    {hcount}                    pushes how many keys the table holds
+**    [first count] {hkeys}       up to count keys into the array from
+**                                first, count replaced by how many
+**    [first count] {hvalues}     ... what they hold, in the same order
+**    {hclear}                    empty the table
+**
+** Whether getting or putting, these leave the stack as it is but for
+** the top of {hget} {hhas} {hdel} {hkeys} and {hvalues}. Keys are the
+** same if they are ==, so -0 is 0, and all nans are one key. Like the
+** array, the table keeps what it holds from one run to the next.
+**
+** The table is a flat array of key and value pairs, open addressed:
+** a key is found by looking on from the slot its hash gives to the
+** first that holds it or is empty. Taking a key out moves the keys
+** after it back rather than leaving a marker, so no lookup looks
+** further than it need. The table doubles when it is 3/4 full.
+*/
+
+char *hashnames[] = { "hput", "hget", "hhas", "hdel", "hcount", "hkeys",
+		      "hvalues", "hclear", NULL };
+char *hashneeds[] = { "a key and value", "a key", "a key", "a key", "",
+		      "a first and count", "a first and count", "" };
+int hashpops[] = { 2, 1, 1, 1, 0, 2, 2, 0 };
+
+#define HASH_PUT    0
+#define HASH_GET    1
+#define HASH_HAS    2
+#define HASH_DEL    3
+#define HASH_COUNT  4
+#define HASH_KEYS   5
+#define HASH_VALUES 6
+#define HASH_CLEAR  7
+
+#define HASHFIRST 16               /* slots of a new table, a power of 2 */
+#define HASHEMPTY (~0ULL)          /* key of an empty slot, a nan that  */
+                                   /* hashkey() never makes             */
+
+typedef struct hashslot {
+  unsigned long long key;          /* hashkey(), or HASHEMPTY           */
+  double value;
+} HASHSLOT;
+
+HASHSLOT *hashslots;               /* the table, NULL when empty        */
+long hashsize;                     /* slots, a power of 2               */
+long hashcount;                    /* keys held                         */
+
+
+/*
+** hashkey / hashnumber
+**
+** The bits a key is held as, one pattern for 0 and -0 and one for
+** every nan, and the number back from them.
+*/
+
+unsigned long long hashkey(double x) {
+
+  unsigned long long key;
+
+  if (x == 0) {
+    return 0;
+  }
+  if (x != x) {
+    return 0x7ff8000000000000ULL;
+  }
+  memcpy(&key, &x, sizeof(key));
+  return key;
+}
+
+
+double hashnumber(unsigned long long key) {
+
+  double x;
+
+  memcpy(&x, &key, sizeof(x));
+  return x;
+}
+
+
+/*
+** hashhome
+**
+** The slot a key is looked for from: its bits mixed so that keys
+** differing only in the low bits of a number, or only in its high
+** ones, are spread over the table.
+*/
+
+long hashhome(unsigned long long key) {
+
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return (long) (key & (hashsize - 1));
+}
+
+
+/*
+** hashfind
+**
+** The slot holding key, or the empty one where it would go.
+*/
+
+long hashfind(unsigned long long key) {
+
+  long i;
+
+  i = hashhome(key);
+  while (hashslots[i].key != key && hashslots[i].key != HASHEMPTY) {
+    i = (i + 1) & (hashsize - 1);
+  }
+  return i;
+}
+
+
+/*
+** hashgrow
+**
+** Double the table, or make it. Returns FALSE, having stopped the
+** program, if there is no memory for it.
+*/
+
+int hashgrow(void) {
+
+  HASHSLOT *old, *slot;
+  long oldsize, i;
+
+  old = hashslots;
+  oldsize = hashsize;
+  hashsize = oldsize == 0 ? HASHFIRST : oldsize * 2;
+  hashslots = malloc(hashsize * sizeof(HASHSLOT));
+  if (hashslots == NULL) {
+    printf("Tiny -- %lf no memory for {hput}'s %ld keys\n", exlino,
+	   hashcount + 1);
+    running = FALSE;
+    hashslots = old;
+    hashsize = oldsize;
+    return FALSE;
+  }
+  for (i = 0; i < hashsize; i++) {
+    hashslots[i].key = HASHEMPTY;
+  }
+  for (slot = old; slot < old + oldsize; slot++) {
+    if (slot->key != HASHEMPTY) {
+      hashslots[hashfind(slot->key)] = *slot;
+    }
+  }
+  free(old);
+  return TRUE;
+}
+
+
+/*
+** hashremove
+**
+** Empty slot i, moving back each key after it that can then be found
+** nearer its home.
+*/
+
+void hashremove(long i) {
+
+  long j, mask;
+
+  mask = hashsize - 1;
+  j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (hashslots[j].key == HASHEMPTY) {
+      break;
+    }
+    /* i lies between j's home and j */
+    if (((j - hashhome(hashslots[j].key)) & mask) >= ((j - i) & mask)) {
+      hashslots[i] = hashslots[j];
+      i = j;
+    }
+  }
+  hashslots[i].key = HASHEMPTY;
+  hashcount--;
+}
+
+
+/*
+** hashclear
+**
+** Empty the table.
+*/
+
+void hashclear(void) {
+
+  free(hashslots);
+  hashslots = NULL;
+  hashsize = 0;
+  hashcount = 0;
+}
+
+
+/*
+** hashcall
+**
+** Run a hash table call on the stack. A range out of the array stops
+** the program.
+*/
+
+void hashcall(int what) {
+
+  double *top;
+  unsigned long long key;
+  long i, from, n, k;
+
+  top = &compstack[compstackindex - 1];
+
+  switch (what) {
+  case HASH_PUT:
+    if (hashcount + 1 > hashsize / 4 * 3 && ! hashgrow()) {
+      return;
+    }
+    key = hashkey(top[-1]);
+    i = hashfind(key);
+    if (hashslots[i].key == HASHEMPTY) {
+      hashslots[i].key = key;
+      hashcount++;
+    }
+    hashslots[i].value = *top;
+    break;
+
+  case HASH_GET: case HASH_HAS: case HASH_DEL:
+    if (hashcount == 0) {
+      *top = 0;
+      break;
+    }
+    i = hashfind(hashkey(*top));
+    if (hashslots[i].key == HASHEMPTY) {
+      *top = 0;
+    } else if (what == HASH_GET) {
+      *top = hashslots[i].value;
+    } else {
+      if (what == HASH_DEL) {
+	hashremove(i);
+      }
+      *top = 1;
+    }
+    break;
+
+  case HASH_COUNT:
+    cpush(hashcount);
+    break;
+
+  case HASH_KEYS: case HASH_VALUES:
+    if ( ! mathbounds(top[-1], top[0], &from, &n)) {
+      return;
+    }
+    k = 0;
+    for (i = 0; i < hashsize && k < n; i++) {
+      if (hashslots[i].key != HASHEMPTY) {
+	darray[from + k++] = what == HASH_KEYS ? hashnumber(hashslots[i].key)
+	                                       : hashslots[i].value;
+      }
+    }
+    *top = k;
+    break;
+
+  case HASH_CLEAR:
+    hashclear();
+    break;
+  }
+}
+
+
+/*
+** execprogram
+** 
+** This executes the program that is currently loaded.
+**
+*/
+
+void execprogram(void) {
+
+  startrun();
+
+  /* Get first Line Number */
+  exlino = linos[0];
+
+  if (verifyprogram(0) > 0 && verifymode == VERIFY_STRICT) {
+    printf("Tiny -- not run, it can overflow\n");
+    running = FALSE;
+    limitstop();
+    return;
+  }
+  optimizeprogram(0);
+
+  samplestart();
+  runengine();
+  samplestop();
+  limitstop();
+
+  if (showstats) {
+    printstats();
+  }
+
+} /* execprogram */
+
+
+/*
+** runengine
+**
+** Run from the line in the @ register with the chosen engine. The
+** compiled engine runs in int64 when intprogram() says the result
+** will be the same as in double, and the float engine only runs a
+** program that floatprogram() says jumps the way it would in double.
+*/
+
+void runengine(void) {
+
+  switch (engine) {
+  case ENGINE_REFERENCE:  refprogram();               break;
+  case ENGINE_DOUBLE:     runprogram();               break;
+  case ENGINE_LONGDOUBLE: runtyped(runtyped_long);    break;
+  case ENGINE_FLOAT:
+    if (floatprogram()) {
+      runtyped(runtyped_float);
+    } else {
+      runprogram();
+    }
+    break;
+  default:
+    if (nmemosubs == 0 && nopthoists == 0 && intprogram()) {
+      runtyped(runtyped_int64);
+    } else {
+      runprogram();
+    }
+    break;
+  }
+}
+
+
+/*
+** runtyped
+**
+** Run with a typed engine from fltengine.h, and let the double engine
+** carry on from wherever the typed engine gave up.
+*/
+
+void runtyped(int (*typed)(int *stepp)) {
+
+  int step, first;
+
+  first = typed(&step);
+  if (first >= 0) {
+    runline(linecode[step], first);
+    if ( compstackindex < 0) {
+      printf("*** Tiny Comp Stack underflow \n");
+      running = FALSE;
+    }
+    if (tasking) {
+      schedule();
+    }
+    if (running && --limitleft <= 0 && limitcheck(step)) {
+      return;
+    }
+  }
+  if (first != TYPED_DONE && running) {
+    runprogram();
+  }
+}
+
+
+/*
+** intprogram
+**
+** Type inference for the int64 engine. Every line must be compiled
+** exactly, every constant and line number must be an integer, and
+** nothing may bring in a fraction: no divide, power, maths function,
+** matrix kernel, random number or input. Variables and stacks must
+** hold integers as well, all small enough that double holds them
+** exactly and none of them -0.
+** The _DYN forms of random and input, and array elements that are not
+** such integers, are caught when they are met.
+** Under --compile=lazy the lines not yet compiled make it FALSE, so
+** such a run is in double, rather than compile them all to find out.
+*/
+
+int intprogram(void) {
+
+  OPNODE *op, *end;
+  double *vals[3];
+  long counts[3];
+  double v;
+  int step, n;
+  long i;
+
+  for (step = 0; step < laststep; step++) {
+    if (linecode[step] == NULL || ! linecode[step]->exact
+	|| linos[step] != floor(linos[step]) || linos[step] > INTEXACT) {
+      return FALSE;
+    }
+    op = linecode[step]->ops;
+    for (end = op + linecode[step]->nops; op < end; op++) {
+      switch (op->code) {
+      case OP_NUM:
+	if (op->value != (double) op->arg) {
+	  return FALSE;
+	}
+	break;
+      case OP_DIV: case OP_POW: case OP_RAND: case OP_INPUT:
+      case OP_MATH: case OP_MATHRANGE: case OP_MATHDYN: case OP_DATA:
+	return FALSE;
+      case OP_MATRIX:
+	if (CALLKERNEL(op->arg) != MATRIX_VIEW) {
+	  return FALSE;
+	}
+	break;
+      }
+    }
+  }
+
+  vals[0] = varz;      counts[0] = VARCOUNT;
+  vals[1] = compstack; counts[1] = STACKLIMIT;
+  vals[2] = ustack;    counts[2] = STACKLIMIT;
+  for (n = 0; n < 3; n++) {
+    for (i = 0; i < counts[n]; i++) {
+      v = vals[n][i];
+      if (v != floor(v) || v > INTEXACT || v < -INTEXACT
+	  || (v == 0 && signbit(v))) {
+	return FALSE;
+      }
+    }
+  }
+  return TRUE;
+}
+
+
+/*
+** floatprogram
+**
+** The float engine holds line numbers on its stacks as float, so every
+** line number, and every constant on a line that jumps, uses the
+** return stack or names a line for a task or loop, must be one that
+** float holds exactly. Otherwise a jump to [100.1] would go to
+** 100.099998. Under --compile=lazy the lines not yet compiled make it
+** FALSE, as for intprogram().
+*/
+
+int floatprogram(void) {
+
+  OPNODE *op, *end;
+  int step, lines;
+
+  for (step = 0; step < laststep; step++) {
+    if (linecode[step] == NULL
+	|| (double) (float) linos[step] != linos[step]) {
+      return FALSE;
+    }
+    lines = FALSE;
+    op = linecode[step]->ops;
+    for (end = op + linecode[step]->nops; op < end; op++) {
+      switch (op->code) {
+      case OP_GETAT: case OP_JUMP: case OP_ATDYN:
+      case OP_PUSHU: case OP_POPU: case OP_USTKDYN:
+      case OP_TASK: case OP_PARALLEL:
+	lines = TRUE;
+	break;
+      }
+    }
+    if ( ! lines) {
+      continue;
+    }
+    op = linecode[step]->ops;
+    for (end = op + linecode[step]->nops; op < end; op++) {
+      if (op->code == OP_NUM && (double) (float) op->value != op->value) {
+	return FALSE;
+      }
+    }
+  }
+  return TRUE;
+}
+
+
+/*
+** startrun
+**
+** Reset the state that a run carries from line to line. Variables,
+** the array and both stacks are left as they are.
+*/
+
+void startrun(void) {
+
+  putget       = GET;
+  numbuild     = FALSE;
+  StringPrint  = FALSE;
+  indirect     = FALSE;
+  gatherformat = FALSE;
+  thenumber    = 0;
+  running      = TRUE;
+  suspended    = FALSE;
+  exitstatus   = 1;
+  if (tasking) {
+    taskreset();
+  }
+  limitstart();
+  optreset();
+  memoanalyse();
+}
+
+
+/*
+** findstep
+**
+** Locate a line number in program memory. An @ of zero finds the
+** empty step after the last line ( execute past end ). Returns -1
+** if the line does not exist.
+*/
+
+int findstep(double lino) {
+
+  int step;
+
+  step = findplace(lino);
+  if (step < laststep && linos[step] == lino) {
+    return step;
+  }
+
+  if (lino == 0) {
+    return laststep;
+  }
+  return -1;
+}
+
+
+/*
+** Tasks
+**
+** [lino] {spawn} starts a task at line lino and replaces the line
+** number with the task's number, or with 0 if all TASKLIMIT slots are
+** taken. {spawnlocal} starts one with its own copy of the variables
+** as they are then. {task} pushes the number of the task running, 0
+** for the program itself, and {yield} lets the next task run once
+** the line is done. Each task has its own stacks, @ register and
+** unfinished string, format or number. The array, the number format
+** and, unless spawned local, the variables are shared.
+**
+** Tasks take turns in the order they were started. The turn passes
+** at the end of a line after a {yield}, or after --slice lines, 100
+** unless set and never for 0. A task ends when it stops, at ':', an
+** error or the end of the program, and the run is over when every
+** task has ended.
+**
+** Each task's state lives in a slot, and the slots are made TASKBLOCK
+** at a time as tasks need them and kept from one run to the next, so
+** a slot costs under a kilobyte and only once. The slot of a task that
+** has ended is used again first. The stacks are used in place in the
+** slot, so a switch only saves and loads a few registers and points
+** the stacks elsewhere, and only a local task has its own variables.
+*/
+
+char *tasknames[] = { "spawn", "spawnlocal", "yield", "task", NULL };
+
+#define TASK_SPAWN      0
+#define TASK_SPAWNLOCAL 1
+#define TASK_YIELD      2
+#define TASK_SELF       3
+
+/*
+** taskreset
+**
+** Back to the program alone, with its own stacks. Made the first time.
+*/
+
+void taskreset(void) {
+
+  if (taskblocks[0] == NULL) {
+    taskblocks[0] = calloc(TASKBLOCK, sizeof(TASK));
+    freetasks = malloc(TASKLIMIT * sizeof(int));
+  } else if (thistask != 0) {
+    /* the program ended before the last task, take up its stacks */
+    compstackindex = TASKSLOT(0)->compstackindex;
+    ustackindex = TASKSLOT(0)->ustackindex;
+  }
+
+  tasktop = 1;
+  nfreetasks = 0;
+  thistask = 0;
+  TASKSLOT(0)->next = 0;
+  TASKSLOT(0)->prev = 0;
+  TASKSLOT(0)->local = FALSE;
+  stackspace = TASKSLOT(0)->stackspace;
+  ustack = TASKSLOT(0)->ustack;
+  tasking = FALSE;
+  yielding = FALSE;
+  sliceleft = taskslice;
+}
+
+
+/*
+** taskspawn
+**
+** Start a task at line lino, to take its first turn after the tasks
+** already running. Returns its number, or 0 if there is no slot.
+*/
+
+double taskspawn(double lino, int local) {
+
+  TASK *t;
+  int slot;
+
+  if (nfreetasks > 0) {
+    slot = freetasks[--nfreetasks];
+  } else if (tasktop < TASKLIMIT) {
+    slot = tasktop;
+    if (taskblocks[slot / TASKBLOCK] == NULL) {
+      taskblocks[slot / TASKBLOCK] = calloc(TASKBLOCK, sizeof(TASK));
+      if (taskblocks[slot / TASKBLOCK] == NULL) {
+	return 0;
+      }
+    }
+    tasktop++;
+  } else {
+    return 0;
+  }
+  t = TASKSLOT(slot);
+
+  memset(t->stackspace, 0, sizeof(t->stackspace));
+  memset(t->ustack, 0, sizeof(t->ustack));
+  t->compstackindex = 0;
+  t->ustackindex = 0;
+  t->exlino = lino;
+  t->thenumber = 0;
+  t->putget = GET;
+  t->indirect = FALSE;
+  t->numbuild = FALSE;
+  t->StringPrint = FALSE;
+  t->gatherformat = FALSE;
+  t->numstring[0] = '\0';
+  t->local = local;
+  if (local) {
+    if (t->varz == NULL) {
+      t->varz = malloc(sizeof(varz));
+    }
+    memcpy(t->varz, varz, sizeof(varz));
+  }
+
+  t->next = thistask;
+  t->prev = TASKSLOT(thistask)->prev;
+  TASKSLOT(t->prev)->next = slot;
+  TASKSLOT(thistask)->prev = slot;
+  tasking = TRUE;
+  return slot;
+}
+
+
+/*
+** taskout, taskin
+**
+** Save the running task's state in its slot, and load a task's state
+** from its slot to run it.
+*/
+
+void taskout(int slot) {
+
+  TASK *t;
+
+  t = TASKSLOT(slot);
+  t->compstackindex = compstackindex;
+  t->ustackindex = ustackindex;
+  t->exlino = exlino;
+  t->thenumber = thenumber;
+  t->putget = putget;
+  t->indirect = indirect;
+  t->numbuild = numbuild;
+  t->StringPrint = StringPrint;
+  t->gatherformat = gatherformat;
+  strcpy(t->numstring, numstring);
+  if (t->local) {
+    memcpy(t->varz, varz, sizeof(varz));
+    memcpy(varz, sharedvarz, sizeof(varz));
+  }
+}
+
+void taskin(int slot) {
+
+  TASK *t;
+
+  t = TASKSLOT(slot);
+  thistask = slot;
+  stackspace = t->stackspace;
+  ustack = t->ustack;
+  compstackindex = t->compstackindex;
+  ustackindex = t->ustackindex;
+  exlino = t->exlino;
+  thenumber = t->thenumber;
+  putget = t->putget;
+  indirect = t->indirect;
+  numbuild = t->numbuild;
+  StringPrint = t->StringPrint;
+  gatherformat = t->gatherformat;
+  strcpy(numstring, t->numstring);
+  if (t->local) {
+    memcpy(sharedvarz, varz, sizeof(varz));
+    memcpy(varz, t->varz, sizeof(varz));
+  }
+}
+
+
+/*
+** schedule
+**
+** Called by the engines at the end of each line once a task has been
+** started. Passes the turn on when the line yielded or the slice is
+** used up, and takes a task that has stopped out of the ring. The
+** run only stops when the last task does.
+*/
+
+void schedule(void) {
+
+  int from, next;
+
+  if (running && ! yielding && (taskslice == 0 || --sliceleft > 0)) {
+    return;
+  }
+  if ( ! running && exitstatus == LIMITSTATUS) {
+    /* a limit ends every task */
+    return;
+  }
+  yielding = FALSE;
+  sliceleft = taskslice;
+
+  from = thistask;
+  next = TASKSLOT(from)->next;
+  if (running && next == from) {
+    return;
+  }
+
+  taskout(from);
+  if ( ! running) {
+    TASKSLOT(TASKSLOT(from)->prev)->next = next;
+    TASKSLOT(next)->prev = TASKSLOT(from)->prev;
+    if (from != 0) {
+      freetasks[nfreetasks++] = from;
+    }
+    if (next == from) {
+      return;
+    }
+    running = TRUE;
+  }
+  taskin(next);
+}
+
+
+/*
+** taskcall
+**
+** Run {spawn} {spawnlocal} {yield} or {task}.
+*/
+
+void taskcall(int what) {
+
+  switch (what) {
+  case TASK_SPAWN:
+  case TASK_SPAWNLOCAL:
+    cpush(taskspawn(cpop(), what == TASK_SPAWNLOCAL));
+    break;
+  case TASK_YIELD:
+    yielding = tasking;
+    break;
+  default:
+    cpush((double) thistask);
+    break;
+  }
+}
+
+
+/*
+** Memoization
+**
+** A subroutine called as [@]$ [lino]@ that runs straight through to
+** a [$] @ line, each line starting with '[', and does nothing but
+** arithmetic, maths functions and setting variables, is a function of
+** the variables it reads before setting them. memoanalyse() finds
+** these before each run, and the double engine then looks each call
+** up in memotable, keyed by those variables. A hit sets the variables
+** the subroutine would have set and returns at once; a miss runs the
+** lines and keeps what they set.
+**
+** A comment on the first line of the subroutine of #memo lets it read
+** the array too, which is taken not to change while the program runs.
+** #nomemo leaves it alone, as does --memo=off for every subroutine.
+*/
+
+
+/*
+** memonote
+**
+** The annotation in a line's comment: 1 for #memo, -1 for #nomemo,
+** else 0.
+*/
+
+int memonote(char text[]) {
+
+  char *p;
+
+  p = strrchr(text, '#');
+  if (p == NULL) {
+    return 0;
+  }
+  for (p++; *p == ' '; p++) {
+  }
+  if (strncmp(p, "memo", 4) == 0 && ! isalpha(p[4])) {
+    return 1;
+  }
+  if (strncmp(p, "nomemo", 6) == 0 && ! isalpha(p[6])) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/*
+** memosub
+**
+** See whether the subroutine starting at step first can be memoized,
+** and if so add it to memosubs. Returns its index, else MEMOREJECT.
+*/
+
+int memosub(int first) {
+
+  MEMOSUB *sub;
+  CODENODE *code;
+  OPNODE *op, *end;
+  int note, step, v;
+  int seen[VARCOUNT];    /* variable read or set so far                   */
+
+  note = memonote(linetext(first));
+  if (note < 0 || nmemosubs == MEMOSUBLIMIT) {
+    return MEMOREJECT;
+  }
+
+  sub = &memosubs[nmemosubs];
+  sub->first = first;
+  sub->nin = 0;
+  sub->nout = 0;
+  sub->hasconst = FALSE;
+  sub->calls = 0;
+  sub->hits = 0;
+  memset(seen, 0, sizeof(seen));
+
+  for (step = first; step < laststep; step++) {
+    code = linecode[step];
+    if (code == NULL || ! code->exact || lineflags[step] != NOBREAKPOINT
+	|| code->nops == 0 || code->ops[0].code != OP_CLEAR
+	|| code->mindepth != 0 || code->hoist != NULL) {
+      return MEMOREJECT;
+    }
+
+    /* [$] @ */
+    if (code->nops == 4 && code->ops[1].code == OP_POPU
+	&& code->ops[2].code == OP_PUTMODE && code->ops[3].code == OP_JUMP) {
+      sub->last = step;
+      return nmemosubs++;
+    }
+
+    for (op = code->ops, end = op + code->nops; op < end; op++) {
+      switch (op->code) {
+      case OP_NUM: case OP_CLEAR: case OP_PUTMODE: case OP_INDIRECT:
+      case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+      case OP_INT: case OP_NOT: case OP_NEG: case OP_LT: case OP_GT:
+      case OP_EQ: case OP_AND: case OP_OR: case OP_MATH:
+	break;
+
+      case OP_FETCH: case OP_ELEMENT:
+	if (note == 0) {
+	  return MEMOREJECT;
+	}
+	break;
+
+      case OP_GETVAR:
+	v = op->arg;
+	if ( ! seen[v]) {
+	  if (sub->nin == MEMOVARS) {
+	    return MEMOREJECT;
+	  }
+	  sub->in[sub->nin++] = v;
+	  seen[v] = TRUE;
+	}
+	break;
+
+      case OP_PUTVAR:
+	v = op->arg;
+	if (seen[v] != 2) {
+	  if (sub->nout == MEMOVARS) {
+	    return MEMOREJECT;
+	  }
+	  sub->out[sub->nout++] = v;
+	  seen[v] = 2;
+	}
+	break;
+
+      default:
+	return MEMOREJECT;
+      }
+    }
+    if (code->hasconst) {
+      sub->hasconst = TRUE;
+      sub->lastconst = code->lastconst;
+    }
+  }
+  return MEMOREJECT;
+}
+
+
+/*
+** memoanalyse
+**
+** Find the subroutines to memoize, from the lines that call them.
+** Returns how many there are.
+*/
+
+int memoanalyse(void) {
+
+  CODENODE *code;
+  OPNODE *op;
+  int step, target;
+
+  nmemosubs = 0;
+  memogen++;
+  for (step = 0; step < laststep; step++) {
+    if (linecode[step] != NULL) {
+      linecode[step]->memo = MEMONONE;
+    }
+  }
+  if ( ! memoing || engine == ENGINE_REFERENCE) {
+    return 0;
+  }
+
+  for (step = 0; step < laststep; step++) {
+    code = linecode[step];
+    if (code == NULL || code->nops < 4) {
+      continue;
+    }
+
+    /* a line that pushes @ on the $ stack and ends in [lino]@ */
+    op = code->ops + code->nops - 1;
+    if (op[0].code != OP_JUMP || op[-1].code != OP_PUTMODE
+	|| op[-2].code != OP_NUM || op[-3].code != OP_CLEAR) {
+      continue;
+    }
+    for (op = code->ops; op->code != OP_PUSHU && op->code != OP_USTKDYN
+	   && op < code->ops + code->nops - 3; op++) {
+    }
+    if (op->code != OP_PUSHU) {
+      continue;
+    }
+
+    target = findstep(code->ops[code->nops - 3].value);
+    if (target >= 0 && target < laststep && linecode[target] != NULL
+	&& linecode[target]->memo == MEMONONE) {
+      linecode[target]->memo = memosub(target);
+    }
+  }
+
+  if (nmemosubs > 0 && memotable == NULL) {
+    memotable = calloc(MEMOSIZE, sizeof(MEMOENTRY));
+  }
+  return nmemosubs;
+}
+
+
+/*
+** memocall
+**
+** Run subroutine m, which the @ register has just reached, through
+** memotable. The lines run as runprogram() would run them.
+*/
+
+void memocall(int m) {
+
+  MEMOSUB *sub;
+  MEMOENTRY *e;
+  double in[MEMOVARS];
+  unsigned long hash;
+  int i, step;
+  double x;
+
+  sub = &memosubs[m];
+  sub->calls++;
+  for (i = 0; i < sub->nin; i++) {
+    in[i] = varz[sub->in[i]];
+  }
+  hash = hashtext((char *) in, sub->nin * sizeof(double)) + m;
+  e = &memotable[hash & (MEMOSIZE - 1)];
+
+  if (e->gen == memogen && e->sub == m
+      && memcmp(e->in, in, sub->nin * sizeof(double)) == 0) {
+    sub->hits++;
+    for (i = 0; i < sub->nout; i++) {
+      varz[sub->out[i]] = e->out[i];
+    }
+    if (sub->hasconst) {
+      thenumber = sub->lastconst;
+    }
+
+    /* what [$] @ does */
+    thisstep = (long) linos[sub->last];
+    exlino = linos[sub->last + 1];
+    compstackindex = 0;
+    x = spop();
+    cpush(x);
+    putget = PUT;
+    indirect = FALSE;
+    if (x != 0) {
+      exlino = x;
+    }
+    return;
+  }
+
+  for (step = sub->first; step <= sub->last; step++) {
+    thisstep = (long) exlino;
+    exlino = linos[step + 1];
+    runline(linecode[step], 0);
+    if ( compstackindex < 0) {
+      printf("*** Tiny Comp Stack underflow \n");
+      running = FALSE;
+    }
+    if ( ! running) {
+      /* stopped by an error, nothing to keep */
+      return;
+    }
+  }
+
+  e->gen = memogen;
+  e->sub = m;
+  memcpy(e->in, in, sub->nin * sizeof(double));
+  for (i = 0; i < sub->nout; i++) {
+    e->out[i] = varz[sub->out[i]];
+  }
+}
+
+
+/*
+** printstats
+**
+** --stats, on stderr after a run.
+*/
+
+void printstats(void) {
+
+  int m, step, proven, compiled;
+  MEMOSUB *sub;
+
+  proven = 0;
+  compiled = 0;
+  for (step = 0; step < laststep; step++) {
+    if (linecode[step] != NULL && linecode[step]->proven) {
+      proven++;
+    }
+    if (linecode[step] != NULL) {
+      compiled++;
+    }
+  }
+  fprintf(stderr, "Tiny -- stats: %d of %d lines compiled\n", compiled,
+	  laststep);
+  fprintf(stderr, "Tiny -- stats: %d of %d lines proven\n", proven, laststep);
+  fprintf(stderr, "Tiny -- stats: optimizer folded %ld, reused %ld, "
+	  "removed %ld stores, hoisted %ld\n",
+	  optfolded, optreused, optstores, opthoisted);
+
+  for (m = 0; m < nmemosubs; m++) {
+    sub = &memosubs[m];
+    fprintf(stderr, "Tiny -- stats: subroutine %012.4f calls %ld hits %ld (%.1f%%)\n",
+	    linos[sub->first], sub->calls, sub->hits,
+	    sub->calls > 0 ? 100.0 * sub->hits / sub->calls : 0.0);
+  }
+}
+
+
+/*
+** Parallel loops
+**
+**    [lino first count] {pfor i}      run the subroutine at lino once
+**                                     for each i from first on
+**    [lino first count] {psum i r}    ... and r = the sum of what each
+**                                     run left in r
+**    {pmin i r} {pmax i r}            ... the least or greatest
+**
+** The subroutine is one memosub() could take, that may also store in
+** the array: lines each starting with '[', running straight on to a
+** [$] @ line, doing nothing but arithmetic, maths functions and
+** setting variables and elements. Each run starts from the variables
+** as they were at the call, with i set, and only what it stores in the
+** array and, for a reduction, r is kept. The three numbers are left
+** on the stack.
+**
+** The runs are shared out on --threads threads, the program's own
+** being one, as at most PARBLOCKS blocks of consecutive i. Each thread
+** starts with a share of the blocks and, when it has run them, takes
+** half of what another has left. A thread runs the lines itself,
+** with its own stack and variables, against the shared array.
+**
+** A reduction adds up each block in order of i. --reduce=ordered then
+** adds up the blocks in order too, so the result is the same however
+** many threads there are and whichever ran what; otherwise each thread
+** adds up the blocks it ran and then the threads are added up.
+*/
+
+char *parallelnames[] = { "pfor", "psum", "pmin", "pmax", NULL };
+
+#define PAR_FOR 0
+#define PAR_SUM 1
+#define PAR_MIN 2
+#define PAR_MAX 3
+
+/* a call is the kind and its variables, packed in an OPNODE arg */
+#define CALLLOOP(call)   ((call) & 255)
+#define CALLINDEX(call)  (((call) >> 8) & 31)
+#define CALLRESULT(call) (((call) >> 13) & 31)
+
+/* A thread of the pool and the blocks left to it */
+typedef struct parworker {
+  pthread_t thread;
+  pthread_mutex_t lock;            /* over lo and hi                    */
+  long lo, hi;                     /* blocks lo to hi - 1               */
+  double part;                     /* its reduction, unless ordered     */
+  int  parts;                      /* ... blocks in it                  */
+} PARWORKER;
+
+/* The loop being run */
+typedef struct parjob {
+  int    first, last;              /* steps, last is the [$] @ line     */
+  int    kind, index, result;
+  double from;                     /* i of the first run                */
+  long   count, blocks, blocksize;
+  int    nout;
+  int    out[VARCOUNT];            /* variables the lines set           */
+  double varz[VARCOUNT];           /* as they were at the call          */
+  double part[PARBLOCKS];          /* each block's reduction            */
+  volatile int failed;             /* a run stopped, runs no more       */
+  char   error[120];               /* ... why, from the first to stop   */
+} PARJOB;
+
+PARWORKER *parworkers;             /* made the first time it is needed  */
+PARJOB parjob;
+long pargen;                       /* loops started, wakes the pool     */
+int parbusy;                       /* threads of the pool still running */
+pthread_mutex_t parlock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t parwake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t pardone = PTHREAD_COND_INITIALIZER;
+
+
+/*
+** parallelname
+**
+** Look up a parallel loop after a '{': its name and one or two
+** variables separated by spaces. *len is set to the characters the
+** call and its '}' take up, and left alone if there is no such call.
+** Returns the call, else -1.
+*/
+
+int parallelname(char text[], int *len) {
+
+  int n, k, kind, call;
+
+  for (n = 0; islower(text[n]); n++) {
+  }
+  for (kind = 0; parallelnames[kind] != NULL; kind++) {
+    if ((int) strlen(parallelnames[kind]) == n
+	&& strncmp(parallelnames[kind], text, n) == 0) {
+      break;
+    }
+  }
+  if (parallelnames[kind] == NULL) {
+    return -1;
+  }
+
+  call = kind;
+  for (k = 0; k < (kind == PAR_FOR ? 1 : 2); k++) {
+    if (text[n] != ' ') {
+      return -1;
+    }
+    while (text[n] == ' ') {
+      n++;
+    }
+    if ( ! islower(text[n]) || isalpha(text[n + 1])) {
+      return -1;
+    }
+    call |= (text[n] - 'a') << (8 + 5 * k);
+    n++;
+  }
+  while (text[n] == ' ') {
+    n++;
+  }
+  if (text[n] != '}') {
+    return -1;
+  }
+  *len = n + 1;
+  return call;
+}
+
+
+/*
+** parbody
+**
+** See whether the subroutine starting at step first can be run in
+** parallel, and if so set up parjob's lines and the variables they
+** set. Returns FALSE if it can't.
+*/
+
+int parbody(int first) {
+
+  CODENODE *code;
+  OPNODE *op, *end;
+  int step, seen[VARCOUNT];
+
+  parjob.first = first;
+  parjob.nout = 0;
+  memset(seen, 0, sizeof(seen));
+
+  for (step = first; step < laststep; step++) {
+    code = linecompile(step);
+    if (code == NULL || ! code->exact || lineflags[step] != NOBREAKPOINT
+	|| code->nops == 0 || code->ops[0].code != OP_CLEAR
+	|| code->mindepth != 0 || code->maxentry < 0) {
+      return FALSE;
+    }
+
+    /* [$] @ */
+    if (code->nops == 4 && code->ops[1].code == OP_POPU
+	&& code->ops[2].code == OP_PUTMODE && code->ops[3].code == OP_JUMP) {
+      parjob.last = step;
+      return TRUE;
+    }
+
+    for (op = code->ops, end = op + code->nops; op < end; op++) {
+      switch (op->code) {
+      case OP_NUM: case OP_CLEAR: case OP_PUTMODE: case OP_INDIRECT:
+      case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+      case OP_INT: case OP_NOT: case OP_NEG: case OP_LT: case OP_GT:
+      case OP_EQ: case OP_AND: case OP_OR: case OP_MATH: case OP_GETVAR:
+      case OP_FETCH: case OP_STORE: case OP_ELEMENT: case OP_ELEMSTORE:
+	break;
+
+      case OP_PUTVAR:
+	if ( ! seen[op->arg]) {
+	  parjob.out[parjob.nout++] = op->arg;
+	  seen[op->arg] = TRUE;
+	}
+	break;
+
+      default:
+	return FALSE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+
+/*
+** parfail
+**
+** Stop the loop, keeping the first reason given.
+*/
+
+static void parfail(int step, char what[], double *vz) {
+
+  pthread_mutex_lock(&parlock);
+  if ( ! parjob.failed) {
+    snprintf(parjob.error, sizeof(parjob.error), "Tiny -- %lf %s at %c = %g\n",
+	     linos[step], what, 'a' + parjob.index, vz[parjob.index]);
+    parjob.failed = TRUE;
+  }
+  pthread_mutex_unlock(&parlock);
+}
+
+
+/*
+** parrun
+**
+** Run the lines once, as runline() would, with stack cs and
+** variables vz. Returns FALSE if they stopped.
+*/
+
+static int parrun(double *cs, double *vz) {
+
+  CODENODE *code;
+  OPNODE *op, *end;
+  int step, sp;
+  double x;
+  long k;
+
+  for (step = parjob.first; step < parjob.last; step++) {
+    code = linecode[step];
+    sp = 0;
+    for (op = code->ops, end = op + code->nops; op < end; op++) {
+      switch (op->code) {
+
+      case OP_NUM:     cs[sp++] = op->value;                   break;
+      case OP_GETVAR:  cs[sp++] = vz[op->arg];                 break;
+      case OP_PUTVAR:  vz[op->arg] = cs[sp - 1];               break;
+      case OP_CLEAR:   sp = 0;                                 break;
+      case OP_NOT:     cs[sp - 1] = ! cs[sp - 1];              break;
+      case OP_EQ:      sp--; cs[sp - 1] = cs[sp - 1] == cs[sp]; break;
+      case OP_LT:      sp--; cs[sp - 1] = cs[sp - 1] < cs[sp];  break;
+      case OP_GT:      sp--; cs[sp - 1] = cs[sp - 1] > cs[sp];  break;
+      case OP_ADD:     sp--; cs[sp - 1] = cs[sp - 1] + cs[sp];  break;
+      case OP_SUB:     sp--; cs[sp - 1] = cs[sp - 1] - cs[sp];  break;
+      case OP_MUL:     sp--; cs[sp - 1] = cs[sp - 1] * cs[sp];  break;
+      case OP_NEG:     cs[sp - 1] = cs[sp - 1] * -1;           break;
+      case OP_POW:     sp--; cs[sp - 1] = pow(cs[sp - 1], cs[sp]); break;
+      case OP_MATH:    cs[sp - 1] = mathone(op->arg, cs[sp - 1]); break;
+
+      case OP_AND:
+	sp--;
+	cs[sp - 1] = logical(cs[sp - 1]) == 1 && logical(cs[sp]) == 1;
+	break;
+
+      case OP_OR:
+	sp--;
+	cs[sp - 1] = logical(cs[sp - 1]) == 1 || logical(cs[sp]) == 1;
+	break;
+
+      case OP_DIV:
+	if (cs[sp - 1] == 0) {
+	  parfail(step, "div by zero! Black hole forming!", vz);
+	  return FALSE;
+	}
+	sp--;
+	cs[sp - 1] = cs[sp - 1] / cs[sp];
+	break;
+
+      case OP_INT:
+	x = cs[sp - 1];
+	cs[sp - 1] = x < 0 ? ceil(x) : floor(x);
+	break;
+
+      case OP_FETCH:
+	x = cs[sp - 1];
+	if ( ! (x > -1 && x < arrayelements)) {
+	  parfail(step, "no such array element", vz);
+	  return FALSE;
+	}
+	cs[sp - 1] = darray[(long) x];
+	break;
+
+      case OP_STORE:
+	x = cs[--sp];
+	if ( ! (x > -1 && x < arrayelements)) {
+	  parfail(step, "no such array element", vz);
+	  return FALSE;
+	}
+	darray[(long) x] = cs[sp - 1];
+	break;
+
+      case OP_ELEMENT:
+	k = viewindex(op->arg, cs[sp - 2], cs[sp - 1], FALSE);
+	if (k < 0) {
+	  parfail(step, "no such view element", vz);
+	  return FALSE;
+	}
+	sp--;
+	cs[sp - 1] = darray[k];
+	break;
+
+      case OP_ELEMSTORE:
+	k = viewindex(op->arg, cs[sp - 2], cs[sp - 1], FALSE);
+	if (k < 0) {
+	  parfail(step, "no such view element", vz);
+	  return FALSE;
+	}
+	sp -= 2;
+	darray[k] = cs[sp - 1];
+	break;
+      }
+    }
+  }
+  return TRUE;
+}
+
+
+/*
+** parreduce
+**
+** Take x into a reduction of n values so far.
+*/
+
+static double parreduce(double part, long n, double x) {
+
+  if (n == 0) {
+    return x;
+  }
+  switch (parjob.kind) {
+  case PAR_SUM: return part + x;
+  case PAR_MIN: return x < part ? x : part;
+  case PAR_MAX: return x > part ? x : part;
+  }
+  return part;
+}
+
+
+/*
+** partake
+**
+** The next block for thread t to run: its own next one, or else the
+** first of the half it takes of what another has left. Returns -1 when
+** none are left to take.
+*/
+
+static long partake(int t) {
+
+  PARWORKER *w, *v;
+  long b, n, hi;
+  int k;
+
+  w = &parworkers[t];
+  pthread_mutex_lock(&w->lock);
+  b = w->lo < w->hi ? w->lo++ : -1;
+  pthread_mutex_unlock(&w->lock);
+  if (b >= 0) {
+    return b;
+  }
+
+  for (k = 1; k < parthreads; k++) {
+    v = &parworkers[(t + k) % parthreads];
+    pthread_mutex_lock(&v->lock);
+    n = (v->hi - v->lo + 1) / 2;
+    hi = v->hi;
+    v->hi -= n;
+    pthread_mutex_unlock(&v->lock);
+    if (n > 0) {
+      pthread_mutex_lock(&w->lock);
+      w->lo = hi - n + 1;
+      w->hi = hi;
+      pthread_mutex_unlock(&w->lock);
+      return hi - n;
+    }
+  }
+  return -1;
+}
+
+
+/*
+** parwork
+**
+** Thread t's part of the loop: run blocks until there are none left.
+*/
+
+static void parwork(int t) {
+
+  PARWORKER *w;
+  double cs[STACKLIMIT], vz[VARCOUNT], part;
+  long b, i, end;
+  int k;
+
+  w = &parworkers[t];
+  w->parts = 0;
+  memcpy(vz, parjob.varz, sizeof(vz));
+
+  while ( ! parjob.failed && (b = partake(t)) >= 0) {
+    i = b * parjob.blocksize;
+    end = i + parjob.blocksize < parjob.count ? i + parjob.blocksize
+                                              : parjob.count;
+    part = 0;
+    for ( ; i < end; i++) {
+      for (k = 0; k < parjob.nout; k++) {
+	vz[parjob.out[k]] = parjob.varz[parjob.out[k]];
+      }
+      vz[parjob.index] = parjob.from + i;
+      if ( ! parrun(cs, vz)) {
+	return;
+      }
+      part = parreduce(part, i - b * parjob.blocksize, vz[parjob.result]);
+    }
+    if (parjob.kind != PAR_FOR) {
+      parjob.part[b] = part;
+      w->part = parreduce(w->part, w->parts++, part);
+    }
+  }
+}
+
+
+/*
+** parthread
+**
+** A thread of the pool, waiting for each loop to start.
+*/
+
+static void *parthread(void *arg) {
+
+  long gen;
+  int t;
+
+  t = (int) (long) arg;
+  gen = 0;
+  for (;;) {
+    pthread_mutex_lock(&parlock);
+    while (pargen == gen) {
+      pthread_cond_wait(&parwake, &parlock);
+    }
+    gen = pargen;
+    pthread_mutex_unlock(&parlock);
+
+    parwork(t);
+
+    pthread_mutex_lock(&parlock);
+    if (--parbusy == 0) {
+      pthread_cond_signal(&pardone);
+    }
+    pthread_mutex_unlock(&parlock);
+  }
+  return NULL;
+}
+
+
+/*
+** parstart
+**
+** Make the pool, the first time a loop is run. Any thread that can't
+** be made is left out.
+*/
+
+static void parstart(void) {
+
+  int t;
+
+  parworkers = calloc(parthreads, sizeof(PARWORKER));
+  for (t = 0; t < parthreads; t++) {
+    pthread_mutex_init(&parworkers[t].lock, NULL);
+  }
+  for (t = 1; t < parthreads; t++) {
+    if (pthread_create(&parworkers[t].thread, NULL, parthread,
+		       (void *) (long) t) != 0) {
+      break;
+    }
+  }
+  parthreads = t;
+}
+
+
+/*
+** parallelcall
+**
+** Run a {pfor} {psum} {pmin} or {pmax}, with the line, first i and
+** count on top of the stack.
+*/
+
+void parallelcall(int call) {
+
+  double lino, first, count, r;
+  int step, t, threads;
+  long b, n;
+
+  lino = compstack[compstackindex - 3];
+  first = compstack[compstackindex - 2];
+  count = floor(compstack[compstackindex - 1]);
+  if (count < 1) {
+    if (CALLLOOP(call) == PAR_SUM) {
+      varz[CALLRESULT(call)] = 0;
+    }
+    return;
+  }
+
+  step = findstep(lino);
+  if (step < 0 || step >= laststep) {
+    printf("Tiny -- %lf {%s} no line %g\n", exlino,
+	   parallelnames[CALLLOOP(call)], lino);
+    running = FALSE;
+    return;
+  }
+  if ( ! parbody(step)) {
+    printf("Tiny -- %lf {%s} can't run the lines at %g in parallel\n",
+	   exlino, parallelnames[CALLLOOP(call)], lino);
+    running = FALSE;
+    return;
+  }
+  if (count > LONG_MAX / 2) {
+    count = LONG_MAX / 2;
+  }
+
+  parjob.kind = CALLLOOP(call);
+  parjob.index = CALLINDEX(call);
+  parjob.result = CALLRESULT(call);
+  parjob.from = first;
+  parjob.count = (long) count;
+  parjob.blocks = parjob.count < PARBLOCKS ? parjob.count : PARBLOCKS;
+  parjob.blocksize = (parjob.count + parjob.blocks - 1) / parjob.blocks;
+  parjob.blocks = (parjob.count + parjob.blocksize - 1) / parjob.blocksize;
+  memcpy(parjob.varz, varz, sizeof(parjob.varz));
+  parjob.failed = FALSE;
+
+  if (parworkers == NULL) {
+    parstart();
+  }
+
+  /* each thread starts with an equal share of the blocks */
+  threads = parjob.blocks < parthreads ? (int) parjob.blocks : parthreads;
+  for (t = 0; t < parthreads; t++) {
+    parworkers[t].lo = t < threads ? parjob.blocks * t / threads : 0;
+    parworkers[t].hi = t < threads ? parjob.blocks * (t + 1) / threads : 0;
+    parworkers[t].part = 0;
+    parworkers[t].parts = 0;
+  }
+
+  if (threads > 1) {
+    pthread_mutex_lock(&parlock);
+    parbusy = parthreads - 1;
+    pargen++;
+    pthread_cond_broadcast(&parwake);
+    pthread_mutex_unlock(&parlock);
+  }
+  parwork(0);
+  if (threads > 1) {
+    pthread_mutex_lock(&parlock);
+    while (parbusy > 0) {
+      pthread_cond_wait(&pardone, &parlock);
+    }
+    pthread_mutex_unlock(&parlock);
+  }
+
+  if (parjob.failed) {
+    printf("%s", parjob.error);
+    running = FALSE;
+    return;
+  }
+
+  if (parjob.kind != PAR_FOR) {
+    r = 0;
+    n = 0;
+    if (parordered) {
+      for (b = 0; b < parjob.blocks; b++) {
+	r = parreduce(r, n++, parjob.part[b]);
+      }
+    } else {
+      for (t = 0; t < parthreads; t++) {
+	if (parworkers[t].parts > 0) {
+	  r = parreduce(r, n++, parworkers[t].part);
+	}
+      }
+    }
+    varz[parjob.result] = r;
+  }
+}
+
+
+/*
+** runprogram
+**
+** Run lines starting with the line in the @ register until something
+** stops the program. Lines are run from their compiled form unless the
+** line could not be compiled exactly, or the previous line left a
+** string, format or number unfinished. Those are interpreted.
+*/
+
+void runprogram(void) {
+
+  int step;              /* index into program memory                     */
+  CODENODE *code;        /* compiled line                                 */
+  char *xtext;           /* Program text being interpreted                */
+
+  step = -1;
+  do {
+
+    /* the line just run, when --sample's timer has ticked */
+    if (sampledue && step >= 0) {
+      sample(step);
+    }
+
+    /* ... and when the lines between limitcheck()s have run */
+    if (step >= 0 && --limitleft <= 0 && limitcheck(step)) {
+      break;
+    }
+
+    /* locate line from @, usually it is just the next line */
+    if (step + 1 <= laststep && linos[step + 1] == exlino) {
+      step++;
+    } else {
+      step = findstep(exlino);
+      if (step < 0) {
+	printf("Tiny-- Attempt to jump to %lf, line not found\n",exlino);
+	running = FALSE;
+	step = laststep + 1;
+      }
+    }
+
+    /* a subroutine to look up rather than run */
+    code = linecompile(step);
+    if (code != NULL && code->memo >= 0 && ! StringPrint && ! gatherformat
+	&& ! numbuild && ! tasking && ! nowstepping && ! (debugging && traceing)
+	&& ustackindex > 0) {
+      memocall(code->memo);
+      continue;
+    }
+
+    /* fetch line */
+    xtext = linetext(step);
+
+    if (xtext[0] == '\0') {
+      printf("Tiny-- Execute past end of program\n");
+      running = FALSE;
+    }
+
+    thisstep = (long) exlino;
+
+    if (debugging && traceing) {
+      printf("\033[s\033[H---------- Trace: %012.4f\033[u",exlino);
+    }
+
+    if (lineflags[step] == TRACEPOINT) {
+      traceing = ! traceing;
+    }
+
+    if (lineflags[step] == BREAKHERE) {
+      nowstepping = TRUE;
+    }
+
+    if ( nowstepping ) {
+      debugprompt(xtext);
+    }
+
+    /* set @ to line number of next line */
+    exlino = linos[step + 1];
+
+    /* run line */
+    code = linecode[step];
+    if (code != NULL && code->exact
+	&& ! StringPrint && ! gatherformat && ! numbuild && safeline(code)) {
+      runline(code, 0);
+    } else {
+      interpretline(xtext);
+    }
+    if (code != NULL && code->hoist != NULL && running) {
+      runhoist(code);
+    }
+
+    /* a proven line is only left short by a divide by zero */
+    if ( compstackindex < 0) {
+      printf("*** Tiny Comp Stack underflow \n");
+      running = FALSE;
+    }
+
+    if (tasking) {
+      schedule();
+    }
+
+  } while ( running );   /* execute do loop */
+}
+
+
+/*
+** refprogram
+**
+** The reference engine, chosen with --engine=reference. This is the
+** original run loop: every jump searches program memory from the top
+** and every line is interpreted a character at a time. Other engines
+** must behave exactly like it; see difftest().
+*/
+
+void refprogram(void) {
+
+  int progmemstep;       /* index into program memory                     */
+  char *xtext;           /* Program text being interpreted                */
+
+  progmemstep = -1;
+  do {
+
+    /* the line just run, when --sample's timer has ticked */
+    if (sampledue && progmemstep >= 0) {
+      sample(progmemstep);
+    }
+
+    /* ... and when the lines between limitcheck()s have run */
+    if (progmemstep >= 0 && --limitleft <= 0 && limitcheck(progmemstep)) {
+      break;
+    }
+
+    /* locate line from @ */
+    progmemstep = 0;
+    while (linos[progmemstep] != exlino) {
+      progmemstep++;
+    
+      /* if past lastline then error message stop */
+      if (progmemstep > laststep) {
+	printf("Tiny-- Attempt to jump to %lf, line not found\n",exlino);
+	running = FALSE;
+	break;
+      }
+    }
+
+
+    /* fetch line */
+    xtext = linetext(progmemstep);
+
+    if (strlen(xtext) == 0) {
+      printf("Tiny-- Execute past end of program\n");
+      running = FALSE;
+    }
+
+    thisstep = (long) exlino;
+
+    if (debugging && traceing) {
+      printf("\033[s\033[H---------- Trace: %012.4f\033[u",exlino);
+    }
+
+    if (lineflags[progmemstep] == TRACEPOINT) {
+      traceing = ! traceing;
+    }
+
+    if (lineflags[progmemstep] == BREAKHERE) {
+      nowstepping = TRUE;
+    }
+
+    if ( nowstepping ) {
+      debugprompt(xtext);
+    }
+
+
+    /* set @ to line number of next line */
+    exlino = linos[progmemstep+1];
+
+    /* interpret line */
+    interpretline(xtext);
+
+    if ( compstackindex < 0) {
+      printf("*** Tiny Comp Stack underflow \n");
+      running = FALSE;
+    }
+
+    if (tasking) {
+      schedule();
+    }
+
+  } while ( running );   /* execute do loop */
+}
+
+
+/*
+** immediateline
+**
+** Run a line typed without a line number against the current
+** variables, array and stacks. If the line sets @ the program is
+** run from that line.
+*/
+
+void immediateline(char text[]) {
+
+  CODENODE *code;
+
+  startrun();
+  exlino = 0;
+  verifyprogram(-1);
+  optimizeprogram(-1);
+
+  code = compileline(text);
+  if (code->exact && engine != ENGINE_REFERENCE && safeline(code)) {
+    runline(code, 0);
+  } else {
+    interpretline(text);
+  }
+  freecode(code);
+
+  if ( compstackindex < 0) {
+    printf("*** Tiny Comp Stack underflow \n");
+    running = FALSE;
+  }
+
+  if (running && exlino != 0) {
+    runengine();
+  }
+  limitstop();
+  printf("\n");
+}
+
+
+/*
+** debugprompt
+**
+** Single stepping. Show the line about to run and take debugging
+** commands until one of them lets the program go on.
+*/
+
+void debugprompt(char xtext[]) {
+
+  int debugstopped;      /* Flag used in debugging prompt                 */
+  char debugcommand[80]; /* Holds debugging input string                  */
+
+  printf("\033[u\033[H\033[K %012.4f %s\033[u",exlino,xtext);
+  do {
+
+    /*Assume its a short stop, get a deubgging command*/
+    debugstopped = FALSE;
+    printf("%s",DEBUGPROMPT);
+    outflush();
+    if (fgets(debugcommand,80,stdin) == NULL) {
+      /* no more input, stop the program */
+      running = FALSE;
+      nowstepping = FALSE;
+      break;
+    }
+
+    /* Debugging help */
+    if (tolower(debugcommand[0]) == '?') {
+      printf(" l list                  \n");
+      printf(" q quit                  \n");
+      printf(" n disable breakpoints   \n");
+      printf(" g go to next breakpoint \n");
+      printf(" b set a breakpoint      \n");
+      printf(" v view a variable       \n");
+      printf(" a view an array element \n");
+    }
+
+    /* Re-print current program step */
+    if (tolower(debugcommand[0] == 'l')) {
+      printf("\033[u\033[H\033[K %012.4f %s\033[u",exlino,xtext);
+      debugstopped = TRUE;
+    }	
+
+    /* Return to command prompt */
+    if (tolower(debugcommand[0]) == 'q') {
+      running = FALSE;
+    }
+
+    /* Disable breakpoints  */
+    if (tolower(debugcommand[0]) == 'n') {
+      debugging = FALSE;
+      nowstepping = FALSE;
+    }
+
+    /* Run to next breakpoint */ 
+    if (tolower(debugcommand[0]) == 'g') {
+      nowstepping = FALSE;
+    }
+
+    /* Set a breakpoint */
+    if (tolower(debugcommand[0]) == 'b') {
+      debugstopped = TRUE;
+    }
+
+    /*Examine a variable*/
+    if (tolower(debugcommand[0]) == 'v') {
+      double v;
+
+      if (debugcommand[1] <='z' && debugcommand[1] >= 'a') {
+
+	v = varz[tolower(debugcommand[1])-'a'];
+	printf("\033[s\033[H\033[K Variable %c = %lf \033[u",
+	       debugcommand[1],v);
+      }	    
+      debugstopped = TRUE;
+    }
+
+
+    /*Examine an array location*/
+    if (tolower(debugcommand[0]) == 'a') {
+      int i,j;
+
+      j = 0;
+      for (i=2; i<=(int) strlen(debugcommand); i++) {
+	if (debugcommand[i] <= '9' && debugcommand[i] >= '0') {
+	  j = (j * 10) + (debugcommand[i] - '0');
+	}
+	printf("\033[s\033[H\033[K Array(%d) = %lf \033[u",j,darray[j]);
+      }
+      debugstopped = TRUE;
+    }
+
+  } while (debugstopped);
+}
+
+
+/*
+** interpretline
+**
+** The character at a time interpreter. Runs one line of program
+** text against the current execution state.
+*/
+
+void interpretline(char xtext[]) {
+
+  interpretfrom(xtext, 0);
+}
+
+
+/*
+** interpretfrom
+**
+** Interpret a line from character first, where resumeprogram() carries
+** on a line that stopped for input.
+*/
+
+void interpretfrom(char xtext[], int first) {
+
+  double x,y;            /* Temporary                                     */
+  int  place;            /* used in numeric constant collection           */
+  char xchar;            /* actual char being interpreted                 */
+  char xstr[2];          /* when we need a string xchar instead           */
+  int i;                 /* loop indexes                                  */
+  int fn;                /* maths function                                */
+  int call;              /* matrix call                                   */
+  int task;              /* task call                                     */
+  int loop;              /* parallel loop call                            */
+  int data;              /* data file call                                */
+  int path, pathlen;     /* ... and its file in xtext                     */
+  int sort;              /* sorting call                                  */
+  int hash;              /* hash table call                               */
+  char *file;
+  long k;                /* array element                                 */
+
+  for (i=first; i < (int)strlen(xtext); i++) {
+
+    xchar = xtext[i];
+
+    if (xchar == '#') {
+      break;
+    }
+
+
+    if (gatherformat) {
+      if (xchar == '\'') {
+	xchar = '\0';
+	gatherformat = FALSE;
+      } else {
+	xstr[0] = xchar;
+	xstr[1] = '\0';
+	if (strlen(numberformat) < sizeof(numberformat) - 1) {
+	  strcat (numberformat, xstr);
+	}
+	xchar = '\0';
+      }
+    }
+
+    if (xchar == '\'') {
+      /* 
+      ** when first we notice a single qoute, clear the numberformat
+      ** and begin to gather new characters in
+      */
+      gatherformat = TRUE;
+      strcpy(numberformat,"\0");
+    }
+
+
+    if (StringPrint) {
+	
+
+      if (xchar == '\\') {
+	i++;
+	xchar = xtext[i];
+	switch ( xchar ) { 
+	case 'n':  printf("\n");   break;
+	case 't':  printf("\t");   break;
+	case '\\': printf("\\");   break;
+	case 'e':  printf("\033"); break;
+	case '"':  printf("\"");   break;
+	case '\'': printf("'");    break;
+	case '.':  printf(".");    break;
+	case 'a':  printf("\a");   break;
+	default:   printf("\nTiny -- **backslash what? %c\n",xchar);
+	}
+
+      } else {
+	if (xchar == '"') {
+	  StringPrint = FALSE;
+	} else {
+	  printf("%c",xchar);
+	}
+      }
+    } else {
+
+      /* ':' is the "stop program " */
+      if (xchar == ':') {
+	running = FALSE;
+	break;
+      }
+
+
+      /* 
+      ** Constants in programs 
+      **  Here is the code that accepts constants in program
+      **  statements
+      */
+
+      if (isdigit(xchar) || (xchar == '.' )) {
+	
+	if ( numbuild ) {
+
+	  place = strlen(numstring);
+	  if (place < (int) sizeof(numstring) - 1) {
+	    numstring[place] = xchar;
+	    numstring[place+1] = '\0';
+	  }
+	} else {
+	  numbuild = TRUE;
+	  numstring[0] = xchar;
+	  numstring[1] = '\0';
+	}	
+      } 
+	
+      /* 
+      ** first non digit after a number 
+      */
+
+      if (numbuild && (! isdigit(xchar)) && (! (xchar == '.')) ) {
+
+	sscanf(numstring,"%lf",&thenumber);
+	cpush(thenumber);
+	numbuild = FALSE;
+      }
+       
+      /* Get/Put Variables */
+      xchar = tolower(xchar);
+      if (xchar <= 'z' && 'a' <= xchar) {
+	if (putget == GET || indirect == TRUE) {
+
+	  cpush(varz[xchar - 'a']);
+	    
+	} else {
+	  /* putget == Put && indirect == FALSE */
+	  varz[xchar - 'a'] = cpop();
+	  cpush(varz[xchar - 'a']);
+	   
+	}
+      }
+
+      
+      switch (xchar) {
+      case '[':
+	compstackindex = 0;
+	putget = GET;
+	indirect = FALSE;
+	break;
+
+      case ']': putget = PUT;           break;
+      case '"': StringPrint = TRUE;     break;
+      case '+': cpush(cpop() + cpop()); break;
+      case '*': cpush(cpop() * cpop()); break;
+      case '!': cpush( ! cpop());       break;
+      case '_': cpush(cpop() * -1);     break;
+
+      case '(':
+	if (putget == GET) {
+
+	  /* does Nothing */
+
+	} else { /* put */
+
+	  /* Raises indirect flag variables will be fetched */
+	  indirect = TRUE;
+
+	}
+	break;
+
+
+
+      case ')':
+	if (putget == GET) {
+
+	  /* 
+	  ** Replace top of stack with array pointed to by top of stack,
+	  ** Lowers Indirect flag
+	  */
+	  indirect = FALSE;
+	  k = arrayindex(cpop());
+	  cpush(k < 0 ? 0 : darray[k]);
+	    
+
+	} else { /* put */
+
+	  /* lower indirect, stores 2nd in array(top), trash top */
+	  indirect = FALSE;
+	  k = arrayindex(cpop());
+	  y = cpop();
+	  if (k >= 0) {
+	    darray[k] = y;
+	  }
+	  cpush(y);
+
+	}
+	break;
+
+
+	/* to be replaced with an int function */
+      case '%':
+	x = cpop();
+	if (x < 0 ) {
+	  cpush(ceil(x));
+	} else {
+	  cpush(floor(x));
+	}
+	break; 
+	  
+
+      case '^': 
+	x = cpop();
+	y = cpop();
+	cpush((double) pow( (double) y, (double) x) );
+	break;
+
+      case '-': 
+	x = cpop();
+	y = cpop();
+	cpush(y - x); 
+	break;
+
+      case '/': 
+	x = cpop();
+	y = cpop();
+	if (x == 0) {
+	  printf("Tiny -- %lf div by zero! Black hole forming!\n",exlino);
+	  running = FALSE;
+	} else {
+	  cpush(y/x);
+	}
+	break;
+
+      case '<': 
+	x = cpop();
+	y = cpop();
+	cpush(y<x);
+	break;
+
+      case '>': 
+	x = cpop();
+	y = cpop();
+	cpush(y>x);
+	break;
+
+      case '=': 
+	cpush(cpop() == cpop());
+	break;
+
+
+      case '&': 
+	x = logical(cpop());
+	y = logical(cpop());
+	if ((x == 1) && (y == 1)) {
+	  cpush(1);
+	} else {
+	  cpush(0);
+	}
+	break;
+
+
+      case '|': 
+	x = logical(cpop());
+	y = logical(cpop());
+	if ((x == 1) || (y == 1)) {
+	  cpush(1);
+	} else {
+	  cpush(0);
+	}
+	break;
+
+
+	/* Special Variables */
+      case '~':
+	if (putget == GET) {
+
+	  cpush(pipi());
+
+	} else {
+	  x = cpop();
+	  cpush(x);
+	  spipi(seedvalue(x));
+	}
+	break;
+
+      case '?':
+	if (putget == GET) {
+	  printf("%s",NUMPROMPT);
+	  if (inputended()) {
+	    suspendtext(xtext, i + 1);
+	    return;
+	  }
+	  x = inputnumber();
+	  cpush(x);
+	} else {
+	  x = cpop();
+	  cpush(x);
+	  printf(numberformat,x);
+	}
+	break;
+
+      case '@':
+	if (putget == GET) {
+	  cpush(exlino);
+	} else {
+
+	  x = cpop();
+	  cpush(x);
+	  if (x != 0) {
+	    exlino = x;
+	  }
+	}
+	break;
+
+
+      case '$':
+	if (putget == GET) {
+	  cpush(spop());
+	} else {
+	  x = cpop();
+	  cpush(x);
+	  spush(x);
+	}
+	break;
+
+      case '{':
+	fn = mathname(xtext + i + 1, &place);
+	call = fn < 0 ? matrixname(xtext + i + 1, &place) : -1;
+	task = fn < 0 && call < 0 ? findname(tasknames, xtext + i + 1, &place)
+	                          : -1;
+	loop = fn < 0 && call < 0 && task < 0
+	       ? parallelname(xtext + i + 1, &place) : -1;
+	data = fn < 0 && call < 0 && task < 0 && loop < 0
+	       ? dataname(xtext + i + 1, &place, &path, &pathlen) : -1;
+	sort = fn < 0 && call < 0 && task < 0 && loop < 0 && data < 0
+	       ? findname(sortnames, xtext + i + 1, &place) : -1;
+	hash = fn < 0 && call < 0 && task < 0 && loop < 0 && data < 0
+	       && sort < 0 ? findname(hashnames, xtext + i + 1, &place) : -1;
+	if (hash >= 0) {
+	  if (compstackindex < hashpops[hash]) {
+	    printf("Tiny -- %lf {%s} needs %s\n", exlino, hashnames[hash],
+		   hashneeds[hash]);
+	    running = FALSE;
+	  } else {
+	    hashcall(hash);
+	  }
+	} else if (sort >= 0) {
+	  if (compstackindex < (sort == SORT_SORT ? 2 : 3)) {
+	    printf("Tiny -- %lf {%s} needs %s\n", exlino, sortnames[sort],
+		   sortneeds[sort]);
+	    running = FALSE;
+	  } else {
+	    sortcall(sort);
+	  }
+	} else if (data >= 0) {
+	  if (compstackindex < 2) {
+	    printf("Tiny -- %lf {%s} needs a first and count\n", exlino,
+		   datanames[DATAKIND(data)]);
+	    running = FALSE;
+	  } else {
+	    file = malloc(pathlen + 1);
+	    memcpy(file, xtext + i + 1 + path, pathlen);
+	    file[pathlen] = '\0';
+	    datacall(file, data);
+	    free(file);
+	  }
+	} else if (loop >= 0) {
+	  if (compstackindex < 3) {
+	    printf("Tiny -- %lf {%s} needs a line, first and count\n", exlino,
+		   parallelnames[CALLLOOP(loop)]);
+	    running = FALSE;
+	  } else {
+	    parallelcall(loop);
+	  }
+	} else if (task >= 0) {
+	  taskcall(task);
+	} else if (call >= 0) {
+	  switch (CALLKERNEL(call)) {
+	  case MATRIX_ELEMENT:
+	    y = cpop();
+	    x = cpop();
+	    k = viewindex(CALLVIEW(call, 0), x, y, TRUE);
+	    if (k >= 0 && putget == GET) {
+	      cpush(darray[k]);
+	    } else if (k >= 0) {
+	      darray[k] = compstack[compstackindex - 1];
+	    }
+	    break;
+	  case MATRIX_VIEW:
+	    viewdefine(CALLVIEW(call, 0), compstack[compstackindex - 4],
+		       compstack[compstackindex - 3],
+		       compstack[compstackindex - 2],
+		       compstack[compstackindex - 1], TRUE);
+	    break;
+	  default:
+	    matrixcall(call);
+	    break;
+	  }
+	} else if (fn < 0) {
+	  printf("Tiny -- %lf no function {%.*s\n",exlino,place,xtext + i + 1);
+	  running = FALSE;
+	} else if (putget == GET) {
+	  cpush(mathone(fn, cpop()));
+	} else {
+	  x = cpop();
+	  y = cpop();
+	  cpush(y);
+	  cpush(x);
+	  mathrange(fn, y, x);
+	}
+	i += place;
+	break;
+
+      }
+    }
+
+    /* an error stops the line where it happened */
+    if ( ! running) {
+      break;
+    }
+  }
+} /* interpretfrom */
+
+
+/*
+** compileline
+**
+** Translate one line of program text into operations. This follows
+** interpretline() character for character, but what it would do is
+** recorded rather than done. Putting and getting is followed as far
+** as the line shows it. A line that would leave a string, format or
+** number unfinished for the next line, or that mixes a format quote
+** into a string, is marked inexact and left to interpretline().
+*/
+
+CODENODE *compileline(char text[]) {
+
+  CODENODE *code;        /* the compiled line                             */
+  OPNODE *op;            /* operation being filled in                     */
+  int  len;              /* length of text                                */
+  int  nstr;             /* bytes used in code->strings                   */
+  int  strstart;         /* offset of string being collected              */
+  char numstr[40];       /* numeric constant being built                  */
+  char fmt[20];          /* format being gathered                         */
+  char xchar;            /* actual char being compiled                    */
+  double number;         /* numeric constant                              */
+  int  sp, gf, nb;       /* StringPrint, gatherformat, numbuild           */
+  int  pg, ind;          /* putget and indirect, or UNKNOWN               */
+  int  i, place, call, task, loop, data, path, pathlen, sort, hash;
+
+  len = strlen(text);
+  code = malloc(sizeof(CODENODE));
+  code->ops = malloc((2 * len + 1) * sizeof(OPNODE));
+  code->strings = malloc(48 * len + 1);
+  code->nops = 0;
+  code->exact = TRUE;
+  code->hasconst = FALSE;
+  code->memo = MEMONONE;
+  code->proven = FALSE;
+  code->lastconst = 0;
+  code->plain = NULL;
+  code->nplain = 0;
+  code->hoist = NULL;
+  code->nhoist = 0;
+
+  nstr = 0;
+  strstart = 0;
+  sp = FALSE;
+  gf = FALSE;
+  nb = FALSE;
+  pg = UNKNOWN;
+  ind = UNKNOWN;
+  fmt[0] = '\0';
+  numstr[0] = '\0';
+
+  for (i = 0; i < len && code->exact; i++) {
+
+    xchar = text[i];
+
+    if (xchar == '#') {
+      break;
+    }
+
+    if (gf) {
+      if (xchar == '\'') {
+	xchar = '\0';
+	gf = FALSE;
+	op = &code->ops[code->nops++];
+	op->code = OP_FORMAT;
+	op->arg = nstr;
+	strcpy(code->strings + nstr, fmt);
+	nstr += strlen(fmt) + 1;
+      } else {
+	place = strlen(fmt);
+	if (place < (int) sizeof(fmt) - 1) {
+	  fmt[place] = xchar;
+	  fmt[place + 1] = '\0';
+	}
+	xchar = '\0';
+      }
+    }
+
+    if (xchar == '\'') {
+      gf = TRUE;
+      fmt[0] = '\0';
+    }
+
+    if (sp) {
+
+      /* a format quote inside a string prints NULs, leave it be */
+      if (gf) {
+	code->exact = FALSE;
+      }
+
+      if (xchar == '\\') {
+	i++;
+	xchar = text[i];
+	switch ( xchar ) { 
+	case 'n':  code->strings[nstr++] = '\n';   break;
+	case 't':  code->strings[nstr++] = '\t';   break;
+	case '\\': code->strings[nstr++] = '\\';   break;
+	case 'e':  code->strings[nstr++] = '\033'; break;
+	case '"':  code->strings[nstr++] = '"';    break;
+	case '\'': code->strings[nstr++] = '\'';   break;
+	case '.':  code->strings[nstr++] = '.';    break;
+	case 'a':  code->strings[nstr++] = '\a';   break;
+	case '\0': code->exact = FALSE;            break;
+	default:
+	  nstr += sprintf(code->strings + nstr,
+			  "\nTiny -- **backslash what? %c\n",xchar);
+	}
+
+      } else {
+	if (xchar == '"') {
+	  sp = FALSE;
+	  code->strings[nstr++] = '\0';
+	  if (nstr - 1 > strstart) {
+	    op = &code->ops[code->nops++];
+	    op->code = OP_PRINT;
+	    op->arg = strstart;
+	  } else {
+	    nstr = strstart;
+	  }
+	} else {
+	  code->strings[nstr++] = xchar;
+	}
+      }
+    } else {
+
+      if (xchar == ':') {
+	op = &code->ops[code->nops++];
+	op->code = OP_STOP;
+	nb = FALSE;
+	break;
+      }
+
+      if (isdigit(xchar) || (xchar == '.' )) {
+	if ( nb ) {
+	  place = strlen(numstr);
+	  if (place < (int) sizeof(numstr) - 1) {
+	    numstr[place] = xchar;
+	    numstr[place+1] = '\0';
+	  }
+	} else {
+	  nb = TRUE;
+	  numstr[0] = xchar;
+	  numstr[1] = '\0';
+	}	
+      } 
+
+      if (nb && (! isdigit(xchar)) && (! (xchar == '.')) ) {
+	op = &code->ops[code->nops++];
+	if (sscanf(numstr,"%lf",&number) == 1) {
+	  code->hasconst = TRUE;
+	  code->lastconst = number;
+	}
+	if (code->hasconst) {
+	  op->code = OP_NUM;
+	  op->value = code->lastconst;
+	  op->arg = 0;
+	  if (op->value <= INT_MAX && op->value == floor(op->value)) {
+	    op->arg = (int) op->value;
+	  }
+	} else {
+	  /* a lone '.' pushes whatever constant came before */
+	  op->code = OP_LASTNUM;
+	}
+	nb = FALSE;
+      }
+
+      xchar = tolower(xchar);
+      if (xchar <= 'z' && 'a' <= xchar) {
+	op = &code->ops[code->nops++];
+	op->arg = xchar - 'a';
+	if (pg == GET || ind == TRUE) {
+	  op->code = OP_GETVAR;
+	} else if (pg == PUT && ind == FALSE) {
+	  op->code = OP_PUTVAR;
+	} else {
+	  op->code = OP_VARDYN;
+	}
+      }
+
+      op = &code->ops[code->nops];
+      op->code = 0;
+      switch (xchar) {
+      case '[': op->code = OP_CLEAR; pg = GET; ind = FALSE; break;
+      case ']': op->code = OP_PUTMODE; pg = PUT;           break;
+      case '"': sp = TRUE; strstart = nstr;                break;
+      case '+': op->code = OP_ADD;                         break;
+      case '-': op->code = OP_SUB;                         break;
+      case '*': op->code = OP_MUL;                         break;
+      case '/': op->code = OP_DIV;                         break;
+      case '^': op->code = OP_POW;                         break;
+      case '%': op->code = OP_INT;                         break;
+      case '!': op->code = OP_NOT;                         break;
+      case '_': op->code = OP_NEG;                         break;
+      case '<': op->code = OP_LT;                          break;
+      case '>': op->code = OP_GT;                          break;
+      case '=': op->code = OP_EQ;                          break;
+      case '&': op->code = OP_AND;                         break;
+      case '|': op->code = OP_OR;                          break;
+
+      case '(':
+	if (pg == PUT) {
+	  op->code = OP_INDIRECT;
+	  ind = TRUE;
+	} else if (pg == UNKNOWN) {
+	  op->code = OP_LPARDYN;
+	  if (ind != TRUE) {
+	    ind = UNKNOWN;
+	  }
+	}
+	break;
+
+      case ')':
+	if (pg == GET) {
+	  op->code = OP_FETCH;
+	} else if (pg == PUT) {
+	  op->code = OP_STORE;
+	} else {
+	  op->code = OP_RPARDYN;
+	}
+	ind = FALSE;
+	break;
+
+      case '~': op->code = pg == GET ? OP_RAND :
+	                   pg == PUT ? OP_SEED : OP_RANDDYN;  break;
+      case '?': op->code = pg == GET ? OP_INPUT :
+	                   pg == PUT ? OP_OUTPUT : OP_IODYN;  break;
+      case '@': op->code = pg == GET ? OP_GETAT :
+	                   pg == PUT ? OP_JUMP : OP_ATDYN;    break;
+      case '$': op->code = pg == GET ? OP_POPU :
+	                   pg == PUT ? OP_PUSHU : OP_USTKDYN; break;
+
+      case '{':
+	/* an unknown function is reported by interpretline() */
+	op->arg = mathname(text + i + 1, &place);
+	op->code = pg == GET ? OP_MATH :
+	           pg == PUT ? OP_MATHRANGE : OP_MATHDYN;
+	call = op->arg < 0 ? matrixname(text + i + 1, &place) : -1;
+	task = op->arg < 0 && call < 0 ? findname(tasknames, text + i + 1, &place)
+	                               : -1;
+	loop = op->arg < 0 && call < 0 && task < 0
+	       ? parallelname(text + i + 1, &place) : -1;
+	data = op->arg < 0 && call < 0 && task < 0 && loop < 0
+	       ? dataname(text + i + 1, &place, &path, &pathlen) : -1;
+	sort = op->arg < 0 && call < 0 && task < 0 && loop < 0 && data < 0
+	       ? findname(sortnames, text + i + 1, &place) : -1;
+	hash = op->arg < 0 && call < 0 && task < 0 && loop < 0 && data < 0
+	       && sort < 0 ? findname(hashnames, text + i + 1, &place) : -1;
+	if (hash >= 0) {
+	  op->arg = hash;
+	  op->code = OP_HASH;
+	} else if (sort >= 0) {
+	  op->arg = sort;
+	  op->code = OP_SORT;
+	} else if (data >= 0) {
+	  op->arg = nstr;
+	  op->value = data;
+	  op->code = OP_DATA;
+	  memcpy(code->strings + nstr, text + i + 1 + path, pathlen);
+	  nstr += pathlen;
+	  code->strings[nstr++] = '\0';
+	} else if (loop >= 0) {
+	  op->arg = loop;
+	  op->code = OP_PARALLEL;
+	} else if (task >= 0) {
+	  op->arg = task;
+	  op->code = OP_TASK;
+	} else if (call >= 0 && CALLKERNEL(call) == MATRIX_ELEMENT) {
+	  op->arg = CALLVIEW(call, 0);
+	  op->code = pg == GET ? OP_ELEMENT :
+	             pg == PUT ? OP_ELEMSTORE : OP_ELEMDYN;
+	} else if (call >= 0) {
+	  op->arg = call;
+	  op->code = OP_MATRIX;
+	} else if (op->arg < 0) {
+	  code->exact = FALSE;
+	}
+	i += place;
+	break;
+      }
+      if (op->code != 0) {
+	code->nops++;
+      }
+    }
+  }
+
+  /* anything left open would carry over into the next line */
+  if (sp || gf || nb) {
+    code->exact = FALSE;
+  }
+
+  code->ops = realloc(code->ops, (code->nops + 1) * sizeof(OPNODE));
+  code->strings = realloc(code->strings, nstr + 1);
+  stackdepth(code);
+  return code;
+}
+
+
+/*
+** stackdepth
+**
+** Work out how deep the computation stack may be when the line starts
+** without any operation reading below the bottom of the stack or
+** writing past the top. Until the first '[' depths are counted from
+** the depth on entry, after it they are known. Where the line only
+** says at run time whether it is putting or getting, the depth is
+** kept as a range that covers both. A line that goes wrong at any
+** depth gets a mindepth past STACKLIMIT. A divide is taken to push
+** its result, so a divide by zero has to be left to runline().
+**
+** The $ stack is only counted from its depth on entry: upops is the
+** most the line takes off below that and urise the most it adds.
+*/
+
+void stackdepth(CODENODE *code) {
+
+  OPNODE *op, *end;
+  int lo, hi;            /* depth range after each operation              */
+  int known;             /* depths are absolute, a '[' has been seen      */
+  int pops;              /* most an operation pops                        */
+  int least, most;       /* least and most it changes the depth by        */
+  int ulo, uhi;          /* $ stack depth range, from the depth on entry  */
+
+  code->mindepth = 0;
+  code->maxentry = STACKLIMIT;
+  code->upops = 0;
+  code->urise = 0;
+  lo = 0;
+  hi = 0;
+  ulo = 0;
+  uhi = 0;
+  known = FALSE;
+
+  for (op = code->ops, end = op + code->nops; op < end; op++) {
+    switch (op->code) {
+    case OP_POPU:    ulo--; uhi--; break;
+    case OP_PUSHU:   ulo++; uhi++; break;
+    case OP_USTKDYN: ulo--; uhi++; break;
+    }
+    if (-ulo > code->upops) {
+      code->upops = -ulo;
+    }
+    if (uhi > code->urise) {
+      code->urise = uhi;
+    }
+
+    switch (op->code) {
+
+    case OP_CLEAR:
+      lo = 0;
+      hi = 0;
+      known = TRUE;
+      continue;
+
+    case OP_STOP:
+      return;
+
+    case OP_NUM: case OP_LASTNUM: case OP_GETVAR: case OP_GETAT:
+    case OP_INPUT: case OP_RAND: case OP_POPU:
+      pops = 0; least = 1; most = 1;
+      break;
+
+    case OP_VARDYN: case OP_RANDDYN: case OP_IODYN: case OP_ATDYN:
+    case OP_USTKDYN:
+      pops = 1; least = 0; most = 1;
+      break;
+
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+    case OP_LT: case OP_GT: case OP_EQ: case OP_AND: case OP_OR:
+    case OP_STORE:
+      pops = 2; least = -1; most = -1;
+      break;
+
+    case OP_RPARDYN:
+      pops = 2; least = -1; most = 0;
+      break;
+
+    case OP_PUTVAR: case OP_INT: case OP_NOT: case OP_NEG: case OP_FETCH:
+    case OP_SEED: case OP_OUTPUT: case OP_JUMP: case OP_PUSHU: case OP_MATH:
+      pops = 1; least = 0; most = 0;
+      break;
+
+    case OP_MATHRANGE: case OP_MATHDYN: case OP_DATA:
+      pops = 2; least = 0; most = 0;
+      break;
+
+    case OP_MATRIX:
+      pops = CALLKERNEL(op->arg) == MATRIX_VIEW ? 4 : 0; least = 0; most = 0;
+      break;
+
+    case OP_PARALLEL:
+      pops = 3; least = 0; most = 0;
+      break;
+
+    case OP_SORT:
+      pops = op->arg == SORT_SORT ? 2 : 3; least = 0; most = 0;
+      break;
+
+    case OP_HASH:
+      pops = hashpops[op->arg];
+      least = op->arg == HASH_COUNT ? 1 : 0;
+      most = least;
+      break;
+
+    case OP_ELEMENT:
+      pops = 2; least = -1; most = -1;
+      break;
+
+    case OP_ELEMSTORE:
+      pops = 3; least = -2; most = -2;
+      break;
+
+    case OP_ELEMDYN:
+      pops = 3; least = -2; most = -1;
+      break;
+
+    case OP_TASK:
+      pops = op->arg <= TASK_SPAWNLOCAL ? 1 : 0;
+      least = op->arg == TASK_SELF ? 1 : 0;
+      most = least;
+      break;
+
+    default:
+      pops = 0; least = 0; most = 0;
+      break;
+    }
+
+    if (known) {
+      if (lo < pops || hi + most > STACKLIMIT) {
+	code->mindepth = STACKLIMIT + 1;
+	return;
+      }
+    } else {
+      if (pops - lo > code->mindepth) {
+	code->mindepth = pops - lo;
+      }
+      if (STACKLIMIT - hi - most < code->maxentry) {
+	code->maxentry = STACKLIMIT - hi - most;
+      }
+    }
+    lo += least;
+    hi += most;
+  }
+}
+
+
+/*
+** Verification
+**
+** verifyprogram() runs the program on stack contents alone before
+** each run, to find the lines that can't go past either end of a
+** stack however they are reached. The values it follows are only the
+** ones that say where control goes: constants, the @ register's line
+** numbers saved on the $ stack, and a comparison times a line number
+** as in the Loop and Subroutine Idioms. Everything else is unknown.
+** A state is a line with the contents of both stacks, and each state
+** reached is walked once, so a subroutine is walked once for each
+** different $ stack it is called with.
+**
+** A jump or {spawn} to where it can't follow, an interpreted line, or
+** a line that reads below the computation stack means any line may be
+** reached any way, and nothing is proven. Otherwise a line that did
+** not go past a stack in any state it was reached in is proven, and
+** runs with no checks at all. A line found to overflow a stack is
+** reported; --verify=strict then refuses to run the program.
+*/
+
+
+/*
+** vneeds
+**
+** How many an operation, not a _DYN one, takes from the computation
+** stack.
+*/
+
+int vneeds(int opcode, int arg) {
+
+  switch (opcode) {
+  case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+  case OP_LT: case OP_GT: case OP_EQ: case OP_AND: case OP_OR:
+  case OP_STORE: case OP_ELEMENT: case OP_MATHRANGE: case OP_DATA:
+    return 2;
+  case OP_PUTVAR: case OP_INT: case OP_NOT: case OP_NEG: case OP_FETCH:
+  case OP_SEED: case OP_OUTPUT: case OP_JUMP: case OP_PUSHU: case OP_MATH:
+  case OP_TASK:
+    return 1;
+  case OP_ELEMSTORE:
+    return 3;
+  case OP_MATRIX:
+    return CALLKERNEL(arg) == MATRIX_VIEW ? 4 : 0;
+  case OP_PARALLEL:
+    return 3;
+  case OP_SORT:
+    return arg == SORT_SORT ? 2 : 3;
+  case OP_HASH:
+    return hashpops[arg];
+  }
+  return 0;
+}
+
+
+/*
+** vpush / vpop
+**
+** Computation stack operations on a state. vpush returns FALSE, and
+** marks the line, if the stack would overflow.
+*/
+
+int vpush(VERIFY *v, VSTATE *s, int kind, double value) {
+
+  if (s->csp == STACKLIMIT) {
+    v->lines[s->step] |= VUNSAFE | VCOMPOVER;
+    return FALSE;
+  }
+  s->cs[s->csp].kind = kind;
+  s->cs[s->csp].v = value;
+  s->csp++;
+  return TRUE;
+}
+
+ABSVAL vpop(VSTATE *s) {
+  return s->cs[--s->csp];
+}
+
+
+/*
+** vadd
+**
+** Add the state of a line about to start to those to walk, unless it
+** has been walked already.
+*/
+
+void vadd(VERIFY *v, VSTATE *s) {
+
+  CODENODE *code;
+  int64_t key[VSTATEWORDS];        /* a double fits each word           */
+  int64_t *old;
+  long n, h, i;
+
+  code = linecode[s->step];
+  if (code != NULL && code->exact && code->nops > 0
+      && code->ops[0].code == OP_CLEAR) {
+    /* '[' forgets the rest */
+    s->csp = 0;
+    s->putget = GET;
+    s->indirect = FALSE;
+  }
+
+  n = 0;
+  key[n++] = s->step;
+  key[n++] = s->putget;
+  key[n++] = s->indirect;
+  key[n++] = s->csp;
+  key[n++] = s->usp;
+  for (i = 0; i < s->csp; i++) {
+    key[n++] = s->cs[i].kind;
+    memcpy(&key[n++], &s->cs[i].v, sizeof(double));
+  }
+  for (i = 0; i < s->usp; i++) {
+    key[n++] = s->us[i].kind;
+    memcpy(&key[n++], &s->us[i].v, sizeof(double));
+  }
+
+  /* seen before? */
+  h = hashtext((char *) key, n * sizeof(int64_t)) & (VTABLESIZE - 1);
+  while (v->table[h] >= 0) {
+    old = v->keys + v->table[h];
+    if (old[0] == n && memcmp(old + 1, key, n * sizeof(int64_t)) == 0) {
+      return;
+    }
+    h = (h + 1) & (VTABLESIZE - 1);
+  }
+
+  if (v->nstates == VERIFYSTATES) {
+    v->failed = TRUE;
+    return;
+  }
+  v->nstates++;
+
+  if (v->used + n + 1 > v->size) {
+    v->size = 2 * (v->size + n + 1);
+    v->keys = realloc(v->keys, v->size * sizeof(int64_t));
+  }
+  v->table[h] = v->used;
+  v->work[v->nwork++] = v->used;
+  v->keys[v->used] = n;
+  memcpy(v->keys + v->used + 1, key, n * sizeof(int64_t));
+  v->used += n + 1;
+}
+
+
+/*
+** vwalk
+**
+** Walk the line of state s from operation k, as runline() would run
+** it, and add the states it leads to. A jump that may or may not be
+** taken walks the rest of the line both ways.
+*/
+
+void vwalk(VERIFY *v, VSTATE *s, int k) {
+
+  CODENODE *code;
+  OPNODE *op, *end;
+  VSTATE *other;
+  ABSVAL x, y;
+  int opcode, next;
+
+  code = linecode[s->step];
+  if (code == NULL || ! code->exact) {
+    v->failed = TRUE;
+    return;
+  }
+
+  for (op = code->ops + k, end = code->ops + code->nops; op < end; op++) {
+
+    /* what a _DYN operation is in this state */
+    opcode = op->code;
+    switch (opcode) {
+    case OP_VARDYN:
+      opcode = s->putget == GET || s->indirect ? OP_GETVAR : OP_PUTVAR;
+      break;
+    case OP_LPARDYN:  opcode = s->putget == PUT ? OP_INDIRECT : 0;   break;
+    case OP_RPARDYN:  opcode = s->putget == GET ? OP_FETCH : OP_STORE; break;
+    case OP_RANDDYN:  opcode = s->putget == GET ? OP_RAND : OP_SEED;  break;
+    case OP_IODYN:    opcode = s->putget == GET ? OP_INPUT : OP_OUTPUT; break;
+    case OP_ATDYN:    opcode = s->putget == GET ? OP_GETAT : OP_JUMP; break;
+    case OP_USTKDYN:  opcode = s->putget == GET ? OP_POPU : OP_PUSHU; break;
+    case OP_MATHDYN:
+      opcode = s->putget == GET ? OP_MATH : OP_MATHRANGE;
+      break;
+    case OP_ELEMDYN:
+      opcode = s->putget == GET ? OP_ELEMENT : OP_ELEMSTORE;
+      break;
+    }
+
+    switch (opcode) {
+
+    case OP_CLEAR:
+      s->csp = 0;
+      s->putget = GET;
+      s->indirect = FALSE;
+      continue;
+
+    case OP_PUTMODE:
+      s->putget = PUT;
+      continue;
+
+    case OP_INDIRECT:
+      s->indirect = TRUE;
+      continue;
+
+    case OP_NUM:
+      if ( ! vpush(v, s, AV_CONST, op->value)) {
+	return;
+      }
+      continue;
+
+    case OP_GETAT:
+      if ( ! vpush(v, s, AV_CONST, s->exlino)) {
+	return;
+      }
+      continue;
+
+    case OP_LASTNUM: case OP_GETVAR: case OP_RAND: case OP_INPUT:
+      if ( ! vpush(v, s, AV_UNKNOWN, 0)) {
+	return;
+      }
+      continue;
+
+    case OP_HASH:
+      if (op->arg == HASH_COUNT) {
+	if ( ! vpush(v, s, AV_UNKNOWN, 0)) {
+	  return;
+	}
+	continue;
+      }
+      break;
+
+    case OP_POPU:
+      if (s->usp == 0) {
+	/* spop() stops the program */
+	v->lines[s->step] |= VUNSAFE;
+	return;
+      }
+      x = s->us[--s->usp];
+      if ( ! vpush(v, s, x.kind, x.v)) {
+	return;
+      }
+      continue;
+
+    case OP_TASK:
+      if (op->arg == TASK_SELF) {
+	if ( ! vpush(v, s, AV_UNKNOWN, 0)) {
+	  return;
+	}
+	continue;
+      }
+      if (op->arg == TASK_YIELD) {
+	continue;
+      }
+      break;
+
+    case OP_STOP:
+      return;
+    }
+
+    /* the rest take from the stack */
+    if (s->csp < vneeds(opcode, op->arg)) {
+      v->failed = TRUE;
+      return;
+    }
+
+    switch (opcode) {
+
+    case OP_MUL:
+      y = vpop(s);
+      x = vpop(s);
+      if (x.kind == AV_CONST && y.kind == AV_CONST) {
+	vpush(v, s, AV_CONST, x.v * y.v);
+      } else if (x.kind == AV_BOOL && y.kind == AV_CONST && y.v != 0) {
+	vpush(v, s, AV_CHOICE, y.v);
+      } else if (x.kind == AV_CONST && y.kind == AV_BOOL && x.v != 0) {
+	vpush(v, s, AV_CHOICE, x.v);
+      } else {
+	vpush(v, s, AV_UNKNOWN, 0);
+      }
+      break;
+
+    case OP_LT: case OP_GT: case OP_EQ: case OP_AND: case OP_OR:
+      s->csp--;
+      s->cs[s->csp - 1].kind = AV_BOOL;
+      break;
+
+    case OP_NOT:
+      s->cs[s->csp - 1].kind = AV_BOOL;
+      break;
+
+    case OP_ADD: case OP_SUB: case OP_DIV: case OP_POW: case OP_ELEMENT:
+      s->csp--;
+      s->cs[s->csp - 1].kind = AV_UNKNOWN;
+      break;
+
+    case OP_INT: case OP_NEG: case OP_MATH: case OP_DATA:
+      s->cs[s->csp - 1].kind = AV_UNKNOWN;
+      break;
+
+    case OP_FETCH:
+      s->indirect = FALSE;
+      s->cs[s->csp - 1].kind = AV_UNKNOWN;
+      break;
+
+    case OP_STORE:
+      s->indirect = FALSE;
+      s->csp--;
+      break;
+
+    case OP_ELEMSTORE:
+      s->csp -= 2;
+      break;
+
+    case OP_SORT:
+      if (op->arg == SORT_SELECT || op->arg == SORT_SEARCH) {
+	s->cs[s->csp - 1].kind = AV_UNKNOWN;
+      }
+      break;
+
+    case OP_HASH:
+      if (op->arg != HASH_PUT && hashpops[op->arg] > 0) {
+	s->cs[s->csp - 1].kind = AV_UNKNOWN;
+      }
+      break;
+
+    case OP_PUSHU:
+      if (s->usp == STACKLIMIT) {
+	v->lines[s->step] |= VUNSAFE | VUSTKOVER;
+	return;
+      }
+      s->us[s->usp++] = s->cs[s->csp - 1];
+      break;
+
+    case OP_TASK:
+      /* {spawn} starts a task with empty stacks at the line on top */
+      x = s->cs[s->csp - 1];
+      if (x.kind != AV_CONST) {
+	v->failed = TRUE;
+	return;
+      }
+      next = findstep(x.v);
+      if (next >= 0 && next < laststep) {
+	other = malloc(sizeof(VSTATE));
+	other->step = next;
+	other->putget = GET;
+	other->indirect = FALSE;
+	other->csp = 0;
+	other->usp = 0;
+	vadd(v, other);
+	free(other);
+      }
+      s->cs[s->csp - 1].kind = AV_UNKNOWN;
+      break;
+
+    case OP_JUMP:
+      x = s->cs[s->csp - 1];
+      if (x.kind == AV_CONST) {
+	if (x.v != 0) {
+	  s->exlino = x.v;
+	}
+      } else if (x.kind == AV_CHOICE || x.kind == AV_BOOL) {
+	/* walk on without jumping, then jump */
+	other = malloc(sizeof(VSTATE));
+	memcpy(other, s, sizeof(VSTATE));
+	vwalk(v, other, op - code->ops + 1);
+	free(other);
+	s->exlino = x.kind == AV_BOOL ? 1 : x.v;
+      } else {
+	v->failed = TRUE;
+	return;
+      }
+      break;
+    }
+  }
+
+  /* on to the line in @, as runprogram() finds it */
+  if (s->step + 1 <= laststep && linos[s->step + 1] == s->exlino) {
+    next = s->step + 1;
+  } else {
+    next = findstep(s->exlino);
+  }
+  if (next >= 0 && next < laststep) {
+    if (v->nedges == v->edgesize) {
+      v->edgesize = 2 * v->edgesize + 64;
+      v->edges = realloc(v->edges, 2 * v->edgesize * sizeof(int));
+    }
+    v->edges[2 * v->nedges] = s->step;
+    v->edges[2 * v->nedges + 1] = next;
+    v->nedges++;
+    s->step = next;
+    vadd(v, s);
+  }
+}
+
+
+/*
+** vedgecmp
+**
+** qsort() order of edges, by the line they leave then the one they
+** go to.
+*/
+
+int vedgecmp(const void *a, const void *b) {
+
+  const int *x = a, *y = b;
+
+  if (x[0] != y[0]) {
+    return x[0] < y[0] ? -1 : 1;
+  }
+  return x[1] < y[1] ? -1 : x[1] > y[1];
+}
+
+
+/*
+** verifyprogram
+**
+** Work out which lines are proven for a run starting at step root
+** with the stacks as they are, and report the lines that can
+** overflow. A root of -1 proves nothing, for a run that may start
+** anywhere, and nor does --compile=lazy, which would have to compile
+** every line to walk them. Returns the number of lines reported.
+**
+** The lines each line was found to go on to are left in flowedges
+** for optimizeprogram(), unless the walk failed.
+*/
+
+int verifyprogram(int root) {
+
+  VERIFY v;
+  VSTATE *s;
+  int64_t *key;
+  long i, n, at;
+  int step, reported;
+
+  for (step = 0; step < laststep; step++) {
+    if (linecode[step] != NULL) {
+      linecode[step]->proven = FALSE;
+    }
+  }
+  free(flowedges);
+  flowedges = NULL;
+  nflowedges = -1;
+  if (root < 0 || root >= laststep || verifymode == VERIFY_OFF || lazycompile
+      || compstackindex < 0 || compstackindex > STACKLIMIT
+      || ustackindex < 0 || ustackindex > STACKLIMIT) {
+    return 0;
+  }
+
+  v.lines = calloc(laststep, sizeof(int));
+  v.table = malloc(VTABLESIZE * sizeof(long));
+  memset(v.table, 0xff, VTABLESIZE * sizeof(long));
+  v.work = malloc(VERIFYSTATES * sizeof(long));
+  v.nwork = 0;
+  v.size = 64 * VSTATEWORDS;
+  v.keys = malloc(v.size * sizeof(int64_t));
+  v.used = 0;
+  v.nstates = 0;
+  v.failed = FALSE;
+  v.edges = NULL;
+  v.nedges = 0;
+  v.edgesize = 0;
+  s = malloc(sizeof(VSTATE));
+
+  /* the stacks as the run finds them */
+  s->step = root;
+  s->putget = GET;
+  s->indirect = FALSE;
+  s->csp = compstackindex;
+  s->usp = ustackindex;
+  for (i = 0; i < s->csp; i++) {
+    s->cs[i].kind = AV_UNKNOWN;
+  }
+  for (i = 0; i < s->usp; i++) {
+    s->us[i].kind = AV_UNKNOWN;
+  }
+  vadd(&v, s);
+
+  while (v.nwork > 0 && ! v.failed) {
+    at = v.work[--v.nwork];
+    key = v.keys + at + 1;
+    s->step = key[0];
+    s->putget = key[1];
+    s->indirect = key[2];
+    s->csp = key[3];
+    s->usp = key[4];
+    n = 5;
+    for (i = 0; i < s->csp; i++) {
+      s->cs[i].kind = key[n++];
+      memcpy(&s->cs[i].v, &key[n++], sizeof(double));
+    }
+    for (i = 0; i < s->usp; i++) {
+      s->us[i].kind = key[n++];
+      memcpy(&s->us[i].v, &key[n++], sizeof(double));
+    }
+    s->exlino = linos[s->step + 1];
+    v.lines[s->step] |= VREACHED;
+    vwalk(&v, s, 0);
+  }
+
+  reported = 0;
+  for (step = 0; step < laststep; step++) {
+    if (v.lines[step] & VCOMPOVER) {
+      printf("Tiny -- line %012.4f can overflow the stack\n", linos[step]);
+      reported++;
+    } else if (v.lines[step] & VUSTKOVER) {
+      printf("Tiny -- line %012.4f can overflow the $ stack\n", linos[step]);
+      reported++;
+    } else if ((v.lines[step] & (VREACHED | VUNSAFE)) == VREACHED
+	       && ! v.failed) {
+      linecode[step]->proven = TRUE;
+    }
+  }
+
+  /* each edge once */
+  if ( ! v.failed) {
+    qsort(v.edges, v.nedges, 2 * sizeof(int), vedgecmp);
+    n = 0;
+    for (i = 0; i < v.nedges; i++) {
+      if (n == 0 || v.edges[2 * i] != v.edges[2 * n - 2]
+	  || v.edges[2 * i + 1] != v.edges[2 * n - 1]) {
+	v.edges[2 * n] = v.edges[2 * i];
+	v.edges[2 * n + 1] = v.edges[2 * i + 1];
+	n++;
+      }
+    }
+    flowedges = v.edges;
+    nflowedges = n;
+  } else {
+    free(v.edges);
+  }
+
+  free(s);
+  free(v.lines);
+  free(v.table);
+  free(v.work);
+  free(v.keys);
+  return reported;
+}
+
+
+void freecode(CODENODE *code) {
+
+  if (code != NULL) {
+    free(code->ops);
+    free(code->plain);
+    free(code->hoist);
+    free(code->strings);
+    free(code);
+  }
+}
+
+
+/*
+** Optimizer
+**
+** optimizeprogram() rewrites the compiled lines for a run, once
+** verifyprogram() has found where each line can go next. What a line
+** computes is named by value numbers, in SSA form: a variable holds
+** the value the line that set it made, the value of a number or of an
+** operation on values has one number wherever it is made, and where
+** lines that leave a variable holding different values meet, it holds
+** a new value named for the line they meet at ( a phi ). Following
+** the lines from the first until nothing changes gives the value each
+** variable holds as each line starts, and with that each line is
+** written again:
+**
+**    constant propagation  arithmetic on numbers, and variables known
+**                          to hold a number, become the number
+**    common subexpressions arithmetic whose value a variable holds
+**                          already becomes that variable
+**    dead stores           setting a variable to what it holds goes,
+**                          as does setting one that the line sets
+**                          again before anything reads it or could
+**                          stop the program
+**    loop invariants       arithmetic in a loop on values made before
+**                          it is worked out once, as the line before
+**                          the loop finishes, into a register the loop
+**                          then reads; a loop is lines entered only at
+**                          one line from one line that goes nowhere
+**                          else
+**
+** Only arithmetic on numbers and variables is replaced, so output,
+** input, random numbers, the array and the $ stack keep their order,
+** and a divide is only moved or folded when it is by a number that is
+** not 0. The registers are variables after the accumulator that only
+** hoisted lines set. Without the lines' flow, for a run that may start
+** anywhere or one verifyprogram() could not follow, or in a program
+** with tasks or parallel loops, each line is only rewritten on its
+** own. The float and long double engines run the program as compiled,
+** and optreset() puts it back as compiled before the next run.
+*/
+
+#define OV_CONST  0                /* the number value                  */
+#define OV_ENTRY  1                /* variable b as line a starts       */
+#define OV_OP     2                /* op, with arg, on values a and b   */
+#define OV_OPAQUE 3                /* unknown, made at line a by b      */
+
+#define OPTHOISTOPS 64             /* most operations a hoist takes     */
+
+typedef struct optvalue {
+  int    kind;
+  int    op, arg;
+  int    a, b;
+  double value;
+} OPTVALUE;
+
+typedef struct optop {             /* what optwalk() found of an op     */
+  int    value;                    /* pushed, -1 for nothing            */
+  int    start;                    /* first op of the arithmetic making */
+                                   /* it, -1 if it was there before     */
+  int    pure;                     /* ... with nothing else among them  */
+  int    holder;                   /* a variable that holds it, or -1   */
+  int    same;                     /* PUTVAR of what the variable holds */
+} OPTOP;
+
+typedef struct opthoist {          /* a loop invariant, worked out ...  */
+  int    step;                     /* ... after this line               */
+  int    reg;                      /* ... into this variable            */
+  int    value;
+  OPNODE ops[OPTHOISTOPS];
+  int    nops;
+} OPTHOIST;
+
+OPTVALUE *optvalues;               /* values by number                  */
+int noptvalues, optvaluesize;
+int *opttable;                     /* ... hashed, -1 for none           */
+int opttablesize;
+int *optin;                        /* each variable's value as each     */
+                                   /* line starts, -1 if not reached    */
+int *optsucc, *optsuccfrom;        /* lines each line goes on to, and   */
+int *optpred, *optpredfrom;        /* ... comes from, by flowedges      */
+OPTHOIST opthoists[OPTREGS];
+
+
+/*
+** optvalue
+**
+** The number of a value, made if it is new.
+*/
+
+int optvalue(int kind, int op, int arg, int a, int b, double value) {
+
+  OPTVALUE key;
+  unsigned long h;
+  int i;
+
+  memset(&key, 0, sizeof(key));
+  key.kind = kind;
+  key.op = op;
+  key.arg = arg;
+  key.a = a;
+  key.b = b;
+  key.value = value;
+
+  if (2 * (noptvalues + 1) > opttablesize) {
+    opttablesize = opttablesize == 0 ? 4096 : 2 * opttablesize;
+    free(opttable);
+    opttable = malloc(opttablesize * sizeof(int));
+    memset(opttable, 0xff, opttablesize * sizeof(int));
+    for (i = 0; i < noptvalues; i++) {
+      h = hashtext((char *) &optvalues[i], sizeof(OPTVALUE))
+	& (opttablesize - 1);
+      while (opttable[h] >= 0) {
+	h = (h + 1) & (opttablesize - 1);
+      }
+      opttable[h] = i;
+    }
+  }
+
+  h = hashtext((char *) &key, sizeof(key)) & (opttablesize - 1);
+  while ((i = opttable[h]) >= 0) {
+    if (memcmp(&optvalues[i], &key, sizeof(key)) == 0) {
+      return i;
+    }
+    h = (h + 1) & (opttablesize - 1);
+  }
+
+  if (noptvalues == optvaluesize) {
+    optvaluesize = 2 * optvaluesize + 1024;
+    optvalues = realloc(optvalues, optvaluesize * sizeof(OPTVALUE));
+  }
+  memcpy(&optvalues[noptvalues], &key, sizeof(key));
+  opttable[h] = noptvalues;
+  return noptvalues++;
+}
+
+
+/*
+** optfold
+**
+** Work out op on the values x and y ( -1 for one that takes only x )
+** as runline() would, into r, if they are numbers. A divide by 0, or
+** a result of -0 that OP_NUM could not carry for the int64 engine, is
+** left to run.
+*/
+
+int optfold(int op, int arg, int x, int y, double *r) {
+
+  double a, b;
+
+  if (optvalues[x].kind != OV_CONST
+      || (y >= 0 && optvalues[y].kind != OV_CONST)) {
+    return FALSE;
+  }
+  a = optvalues[x].value;
+  b = y >= 0 ? optvalues[y].value : 0;
+
+  switch (op) {
+  case OP_ADD: *r = a + b;                                    break;
+  case OP_SUB: *r = a - b;                                    break;
+  case OP_MUL: *r = a * b;                                    break;
+  case OP_POW: *r = pow(a, b);                                break;
+  case OP_LT:  *r = a < b;                                    break;
+  case OP_GT:  *r = a > b;                                    break;
+  case OP_EQ:  *r = a == b;                                   break;
+  case OP_AND: *r = logical(a) == 1 && logical(b) == 1;       break;
+  case OP_OR:  *r = logical(a) == 1 || logical(b) == 1;       break;
+  case OP_INT: *r = a < 0 ? ceil(a) : floor(a);               break;
+  case OP_NOT: *r = ! a;                                      break;
+  case OP_NEG: *r = a * -1;                                   break;
+  case OP_MATH: *r = mathone(arg, a);                         break;
+  case OP_DIV:
+    if (b == 0) {
+      return FALSE;
+    }
+    *r = a / b;
+    break;
+  default:
+    return FALSE;
+  }
+  return ! (*r == 0 && signbit(*r));
+}
+
+
+/*
+** optsafediv
+**
+** TRUE if y, a divisor, is a number other than 0, so the divide can
+** not stop the program.
+*/
+
+int optsafediv(int y) {
+
+  return optvalues[y].kind == OV_CONST && optvalues[y].value != 0;
+}
+
+
+/*
+** optholder
+**
+** The first variable in vars holding value, or -1.
+*/
+
+int optholder(int vars[], int value) {
+
+  int u;
+
+  for (u = 0; u < VARCOUNT; u++) {
+    if (vars[u] == value) {
+      return u;
+    }
+  }
+  return -1;
+}
+
+
+/*
+** optwalk
+**
+** Follow line step as it runs with vars holding the value of each
+** variable as it starts, leaving them holding the values it leaves.
+** With made, what each operation pushes is kept there, with the
+** variable that holds it already. Returns how
+** many operations from the first may be rewritten, the rest of the
+** line after a divide that may be by 0 being left alone, as that
+** leaves the stack short; or -1 for a line that can't be followed,
+** one with _DYN operations, tasks or too much on the stack.
+*/
+
+#define OPTPUSH(v, s, p)						\
+  if (sp == STACKLIMIT) {						\
+    return -1;								\
+  }									\
+  st[sp].value = (v);							\
+  st[sp].start = (s);							\
+  st[sp].pure = (p);							\
+  if (made != NULL && k < frozen) {					\
+    made[k].value = st[sp].value;					\
+    made[k].start = st[sp].start;					\
+    made[k].pure = st[sp].pure;						\
+  }									\
+  sp++
+
+/* a variable holding what arithmetic made, which can stand for it */
+#define OPTHOLD(v)							\
+  if (made != NULL && k < frozen && made[k].pure && made[k].start < k) { \
+    made[k].holder = optholder(vars, v);				\
+  }
+
+#define OPTPOP(x)							\
+  if (sp > 0) {								\
+    x = st[--sp];							\
+  } else {								\
+    x.value = optvalue(OV_OPAQUE, 0, 0, step, -1 - below++, 0);	\
+    x.start = -1;							\
+    x.pure = FALSE;							\
+  }
+
+int optwalk(int step, int vars[], OPTOP made[]) {
+
+  CODENODE *code;
+  OPNODE *op;
+  OPTOP st[STACKLIMIT], keep[4], x, y, z;
+  int sp, below, barrier, frozen, k, n, r, u;
+  double c;
+
+  code = linecode[step];
+  frozen = code->nops;
+  if (made != NULL) {
+    for (k = 0; k < code->nops; k++) {
+      made[k].value = -1;
+      made[k].holder = -1;
+      made[k].same = FALSE;
+    }
+  }
+
+  sp = 0;
+  below = 0;
+  barrier = -1;                    /* last op that is not arithmetic    */
+  for (k = 0; k < code->nops; k++) {
+    op = &code->ops[k];
+    switch (op->code) {
+
+    case OP_NUM:
+      OPTPUSH(optvalue(OV_CONST, 0, 0, 0, 0, op->value), k, TRUE);
+      break;
+
+    case OP_GETVAR:
+      OPTPUSH(vars[op->arg], k, TRUE);
+      break;
+
+    case OP_LASTNUM: case OP_GETAT:
+      OPTPUSH(optvalue(OV_OPAQUE, 0, 0, step, k, 0), k, TRUE);
+      break;
+
+    case OP_INT: case OP_NOT: case OP_NEG: case OP_MATH:
+      OPTPOP(x);
+      n = op->code == OP_MATH ? op->arg : 0;
+      if (optfold(op->code, n, x.value, -1, &c)) {
+	r = optvalue(OV_CONST, 0, 0, 0, 0, c);
+      } else {
+	r = optvalue(OV_OP, op->code, n, x.value, -1, 0);
+      }
+      OPTPUSH(r, x.start, x.pure && x.start > barrier);
+      OPTHOLD(r);
+      break;
+
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_POW:
+    case OP_LT: case OP_GT: case OP_EQ: case OP_AND: case OP_OR:
+      OPTPOP(y);
+      OPTPOP(x);
+      if (optfold(op->code, 0, x.value, y.value, &c)) {
+	r = optvalue(OV_CONST, 0, 0, 0, 0, c);
+      } else {
+	r = optvalue(OV_OP, op->code, 0, x.value, y.value, 0);
+      }
+      OPTPUSH(r, x.start, x.pure && y.pure && x.start > barrier);
+      OPTHOLD(r);
+      if (op->code == OP_DIV && ! optsafediv(y.value)) {
+	barrier = k;
+	if (frozen > k + 1) {
+	  frozen = k + 1;
+	}
+      }
+      break;
+
+    case OP_PUTVAR:
+      OPTPOP(x);
+      if (made != NULL && k < frozen) {
+	made[k].same = vars[op->arg] == x.value;
+      }
+      vars[op->arg] = x.value;
+      barrier = k;
+      OPTPUSH(x.value, x.start, FALSE);
+      break;
+
+    case OP_CLEAR:
+      sp = 0;
+      barrier = k;
+      break;
+
+    case OP_PUTMODE: case OP_INDIRECT: case OP_PRINT: case OP_FORMAT:
+      barrier = k;
+      break;
+
+    case OP_FETCH:
+      OPTPOP(x);
+      barrier = k;
+      OPTPUSH(optvalue(OV_OPAQUE, 0, 0, step, k, 0), x.start, FALSE);
+      break;
+
+    case OP_RAND: case OP_INPUT: case OP_POPU:
+      barrier = k;
+      OPTPUSH(optvalue(OV_OPAQUE, 0, 0, step, k, 0), k, FALSE);
+      break;
+
+    case OP_SEED: case OP_OUTPUT: case OP_JUMP: case OP_PUSHU:
+      OPTPOP(x);
+      barrier = k;
+      OPTPUSH(x.value, x.start, FALSE);
+      break;
+
+    case OP_STORE:
+      OPTPOP(y);
+      OPTPOP(x);
+      barrier = k;
+      OPTPUSH(x.value, x.start, FALSE);
+      break;
+
+    case OP_MATHRANGE: case OP_MATRIX: case OP_PARALLEL: case OP_DATA:
+    case OP_SORT: case OP_HASH:
+      /* these leave what they use on the stack */
+      n = vneeds(op->code, op->arg);
+      for (u = n - 1; u >= 0; u--) {
+	OPTPOP(keep[u]);
+      }
+      barrier = k;
+      if (op->code == OP_DATA || (op->code == OP_SORT
+				  && (op->arg == SORT_SELECT
+				      || op->arg == SORT_SEARCH))
+	  || (op->code == OP_HASH && op->arg != HASH_PUT && n > 0)) {
+	/* but for the top, which becomes what they found */
+	keep[n - 1].value = optvalue(OV_OPAQUE, 0, 0, step, k, 0);
+      }
+      for (u = 0; u < n; u++) {
+	OPTPUSH(keep[u].value, keep[u].start, FALSE);
+      }
+      if (op->code == OP_HASH && op->arg == HASH_COUNT) {
+	OPTPUSH(optvalue(OV_OPAQUE, 0, 0, step, k, 0), k, FALSE);
+      }
+      if (op->code == OP_PARALLEL && CALLLOOP(op->arg) != PAR_FOR) {
+	vars[CALLRESULT(op->arg)] = optvalue(OV_OPAQUE, 0, 0, step, k, 0);
+      }
+      break;
+
+    case OP_ELEMENT:
+      OPTPOP(y);
+      OPTPOP(x);
+      barrier = k;
+      OPTPUSH(optvalue(OV_OPAQUE, 0, 0, step, k, 0), x.start, FALSE);
+      break;
+
+    case OP_ELEMSTORE:
+      OPTPOP(y);
+      OPTPOP(x);
+      OPTPOP(z);
+      barrier = k;
+      OPTPUSH(z.value, z.start, FALSE);
+      break;
+
+    case OP_STOP:
+      return frozen;
+
+    default:
+      return -1;
+    }
+  }
+  return frozen;
+}
+
+#undef OPTPUSH
+#undef OPTHOLD
+#undef OPTPOP
+
+
+/*
+** optopaque
+**
+** What a line optwalk() can't follow leaves in vars: anything it may
+** set is unknown.
+*/
+
+void optopaque(int step, int vars[]) {
+
+  OPNODE *op, *end;
+
+  op = linecode[step]->ops;
+  for (end = op + linecode[step]->nops; op < end; op++) {
+    if (op->code == OP_PUTVAR || op->code == OP_VARDYN) {
+      vars[op->arg] = optvalue(OV_OPAQUE, 0, 0, step, -1000 - op->arg, 0);
+    }
+  }
+}
+
+
+/*
+** optflow
+**
+** Work out optin from the line at root, with the hoists made so far
+** setting their registers.
+*/
+
+void optflow(int root) {
+
+  int *work, *inwork, *in, vars[VARCOUNT];
+  int nwork, step, next, i, h, v, entry;
+
+  for (i = 0; i < laststep * VARCOUNT; i++) {
+    optin[i] = -1;
+  }
+  for (v = 0; v < VARCOUNT; v++) {
+    optin[root * VARCOUNT + v] = optvalue(OV_ENTRY, 0, 0, root, v, 0);
+  }
+  work = malloc(laststep * sizeof(int));
+  inwork = calloc(laststep, sizeof(int));
+  work[0] = root;
+  inwork[root] = TRUE;
+  nwork = 1;
+
+  while (nwork > 0) {
+    step = work[--nwork];
+    inwork[step] = FALSE;
+    memcpy(vars, optin + step * VARCOUNT, sizeof(vars));
+    if (optwalk(step, vars, NULL) < 0) {
+      optopaque(step, vars);
+    }
+    for (h = 0; h < nopthoists; h++) {
+      if (opthoists[h].step == step) {
+	vars[opthoists[h].reg] = opthoists[h].value;
+      }
+    }
+
+    /* where they meet, values that differ become the line's own */
+    for (i = optsuccfrom[step]; i < optsuccfrom[step + 1]; i++) {
+      next = optsucc[i];
+      in = optin + next * VARCOUNT;
+      for (v = 0; v < VARCOUNT; v++) {
+	if (in[v] == vars[v]) {
+	  continue;
+	}
+	entry = optvalue(OV_ENTRY, 0, 0, next, v, 0);
+	if (in[v] == entry) {
+	  continue;
+	}
+	in[v] = in[v] < 0 ? vars[v] : entry;
+	if ( ! inwork[next]) {
+	  work[nwork++] = next;
+	  inwork[next] = TRUE;
+	}
+      }
+    }
+  }
+
+  free(work);
+  free(inwork);
+}
+
+
+/*
+** optinvariant
+**
+** TRUE if value is made only from values made outside the lines
+** marked in inloop, and by no divide that may be by 0.
+*/
+
+int optinvariant(int value, char inloop[]) {
+
+  OPTVALUE *v;
+
+  v = &optvalues[value];
+  switch (v->kind) {
+  case OV_CONST:
+    return TRUE;
+  case OV_ENTRY: case OV_OPAQUE:
+    return ! inloop[v->a];
+  }
+  if (v->op == OP_DIV && ! optsafediv(v->b)) {
+    return FALSE;
+  }
+  return optinvariant(v->a, inloop)
+    && (v->b < 0 || optinvariant(v->b, inloop));
+}
+
+
+/*
+** optmaterial
+**
+** Add to hoist the operations that push value, from the variables as
+** vars has them, at stack depth depth. FALSE if it can't be done.
+*/
+
+int optmaterial(OPTHOIST *hoist, int value, int vars[], int depth) {
+
+  OPTVALUE *v;
+  OPNODE *op;
+  int u;
+
+  if (hoist->nops == OPTHOISTOPS || depth == STACKLIMIT) {
+    return FALSE;
+  }
+  op = &hoist->ops[hoist->nops];
+  for (u = 0; u < VARCOUNT; u++) {
+    if (vars[u] == value) {
+      op->code = OP_GETVAR;
+      op->arg = u;
+      op->value = 0;
+      hoist->nops++;
+      return TRUE;
+    }
+  }
+
+  v = &optvalues[value];
+  if (v->kind == OV_CONST) {
+    op->code = OP_NUM;
+    op->value = v->value;
+    op->arg = 0;
+    hoist->nops++;
+    return TRUE;
+  }
+  if (v->kind != OV_OP
+      || ! optmaterial(hoist, v->a, vars, depth)
+      || (v->b >= 0 && ! optmaterial(hoist, v->b, vars, depth + 1))
+      || hoist->nops == OPTHOISTOPS) {
+    return FALSE;
+  }
+  op = &hoist->ops[hoist->nops++];
+  op->code = v->op;
+  op->arg = v->arg;
+  op->value = 0;
+  return TRUE;
+}
+
+
+/*
+** opthoistloop
+**
+** If line head starts a loop, hoist what its lines work out from
+** values made before it. Returns how many were hoisted.
+*/
+
+int opthoistloop(int head, int root, char inloop[], int *work) {
+
+  OPTOP *made;
+  OPTHOIST *hoist;
+  int vars[VARCOUNT], outer, nwork, step, i, j, k, u, hoisted;
+
+  /* the loop: lines that come back to head without passing it */
+  memset(inloop, 0, laststep);
+  inloop[head] = TRUE;
+  nwork = 0;
+  for (i = optpredfrom[head]; i < optpredfrom[head + 1]; i++) {
+    step = optpred[i];
+    if (step >= head && ! inloop[step]) {
+      inloop[step] = TRUE;
+      work[nwork++] = step;
+    }
+  }
+  if (nwork == 0) {
+    return 0;
+  }
+  while (nwork > 0) {
+    step = work[--nwork];
+    for (i = optpredfrom[step]; i < optpredfrom[step + 1]; i++) {
+      if ( ! inloop[optpred[i]]) {
+	inloop[optpred[i]] = TRUE;
+	work[nwork++] = optpred[i];
+      }
+    }
+  }
+
+  /* entered only at head, from one line that goes nowhere else */
+  if (inloop[root]) {
+    return 0;
+  }
+  outer = -1;
+  for (step = 0; step < laststep; step++) {
+    if ( ! inloop[step]) {
+      continue;
+    }
+    for (i = optpredfrom[step]; i < optpredfrom[step + 1]; i++) {
+      if (inloop[optpred[i]]) {
+	continue;
+      }
+      if (step != head || (outer >= 0 && outer != optpred[i])) {
+	return 0;
+      }
+      outer = optpred[i];
+    }
+  }
+  if (outer < 0 || optsuccfrom[outer + 1] - optsuccfrom[outer] != 1
+      || optin[outer * VARCOUNT] < 0) {
+    return 0;
+  }
+  memcpy(vars, optin + outer * VARCOUNT, sizeof(vars));
+  if (optwalk(outer, vars, NULL) < 0) {
+    return 0;
+  }
+  for (i = 0; i < nopthoists; i++) {
+    if (opthoists[i].step == outer) {
+      vars[opthoists[i].reg] = opthoists[i].value;
+    }
+  }
+
+  /* the outermost invariant arithmetic in each line */
+  hoisted = 0;
+  for (step = 0; step < laststep && nopthoists < OPTREGS; step++) {
+    if ( ! inloop[step] || optin[step * VARCOUNT] < 0) {
+      continue;
+    }
+    made = malloc(linecode[step]->nops * sizeof(OPTOP) + 1);
+    memcpy(work, optin + step * VARCOUNT, VARCOUNT * sizeof(int));
+    j = optwalk(step, work, made);
+    for (k = j - 1; k > 0 && nopthoists < OPTREGS; k--) {
+      if (made[k].value < 0 || ! made[k].pure || made[k].start >= k
+	  || optvalues[made[k].value].kind != OV_OP
+	  || ! optinvariant(made[k].value, inloop)) {
+	continue;
+      }
+      /* not one held already, in the loop or in a register */
+      u = 27;
+      while (u < VARCOUNT && vars[u] != made[k].value) {
+	u++;
+      }
+      if (made[k].holder < 0 && u == VARCOUNT) {
+	hoist = &opthoists[nopthoists];
+	hoist->step = outer;
+	hoist->reg = 27 + nopthoists;
+	hoist->value = made[k].value;
+	hoist->nops = 0;
+	if ( ! optmaterial(hoist, hoist->value, vars, 0)
+	    || hoist->nops == OPTHOISTOPS) {
+	  continue;
+	}
+	hoist->ops[hoist->nops].code = OP_PUTVAR;
+	hoist->ops[hoist->nops].arg = hoist->reg;
+	hoist->ops[hoist->nops].value = 0;
+	hoist->nops++;
+	vars[hoist->reg] = hoist->value;
+	nopthoists++;
+	hoisted++;
+      }
+      k = made[k].start;
+    }
+    free(made);
+  }
+  return hoisted;
+}
+
+
+/*
+** optline
+**
+** Write line step again from in, the value of each variable as it
+** starts. Returns TRUE if it changed.
+*/
+
+int optline(int step, int in[]) {
+
+  CODENODE *code;
+  OPTOP *made;
+  OPNODE *ops, *op;
+  OPTVALUE *v;
+  int vars[VARCOUNT], pending[VARCOUNT];
+  int frozen, n, head, i, j, k, u;
+  char *dead;
+
+  code = linecode[step];
+  made = malloc(code->nops * sizeof(OPTOP) + 1);
+  memcpy(vars, in, sizeof(vars));
+  frozen = optwalk(step, vars, made);
+  if (frozen < 0) {
+    free(made);
+    return FALSE;
+  }
+
+  /* each run of arithmetic, the longest first, as a number or a
+     variable holding it */
+  ops = malloc((code->nops + 1) * sizeof(OPNODE));
+  n = 0;
+  for (j = 0; j < frozen; j++) {
+    for (k = frozen - 1; k >= j; k--) {
+      if (made[k].value < 0 || made[k].start != j || ! made[k].pure) {
+	continue;
+      }
+      v = &optvalues[made[k].value];
+      if (v->kind == OV_CONST && (k > j || code->ops[j].code != OP_NUM)) {
+	ops[n].code = OP_NUM;
+	ops[n].value = v->value;
+	ops[n].arg = v->value == floor(v->value) && v->value <= INT_MAX
+	  && v->value >= INT_MIN ? (int) v->value : 0;
+	n++;
+	optfolded++;
+	break;
+      }
+      if (made[k].holder >= 0 && k > j) {
+	ops[n].code = OP_GETVAR;
+	ops[n].arg = made[k].holder;
+	ops[n].value = 0;
+	n++;
+	optreused++;
+	break;
+      }
+    }
+    if (k >= j) {
+      j = k;
+    } else if (code->ops[j].code == OP_PUTVAR && made[j].same) {
+      optstores++;
+    } else {
+      ops[n++] = code->ops[j];
+    }
+  }
+  head = n;
+  free(made);
+
+  /* a variable set again before it is read, or anything else could
+     stop the program, was set for nothing */
+  dead = calloc(head + 1, 1);
+  for (u = 0; u < VARCOUNT; u++) {
+    pending[u] = -1;
+  }
+  for (i = 0; i < head; i++) {
+    op = &ops[i];
+    switch (op->code) {
+    case OP_PUTVAR:
+      if (pending[op->arg] >= 0) {
+	dead[pending[op->arg]] = TRUE;
+      }
+      pending[op->arg] = i;
+      break;
+    case OP_GETVAR:
+      pending[op->arg] = -1;
+      break;
+    case OP_NUM: case OP_LASTNUM: case OP_GETAT: case OP_CLEAR:
+    case OP_PUTMODE: case OP_INDIRECT: case OP_PRINT: case OP_FORMAT:
+    case OP_OUTPUT: case OP_ADD: case OP_SUB: case OP_MUL: case OP_POW:
+    case OP_INT: case OP_NOT: case OP_NEG: case OP_LT: case OP_GT:
+    case OP_EQ: case OP_AND: case OP_OR: case OP_MATH:
+      break;
+    case OP_DIV:
+      if (i > 0 && ops[i - 1].code == OP_NUM && ops[i - 1].value != 0) {
+	break;
+      }
+      /* fall through */
+    default:
+      for (u = 0; u < VARCOUNT; u++) {
+	pending[u] = -1;
+      }
+      break;
+    }
+  }
+  n = 0;
+  for (i = 0; i < head; i++) {
+    if (dead[i]) {
+      optstores++;
+    } else {
+      ops[n++] = ops[i];
+    }
+  }
+  free(dead);
+  for (k = frozen; k < code->nops; k++) {
+    ops[n++] = code->ops[k];
+  }
+
+  if (n == code->nops
+      && memcmp(ops, code->ops, n * sizeof(OPNODE)) == 0) {
+    free(ops);
+    return FALSE;
+  }
+  code->plain = code->ops;
+  code->nplain = code->nops;
+  code->ops = ops;
+  code->nops = n;
+  return TRUE;
+}
+
+
+/*
+** optimizeprogram
+**
+** Optimize the program for a run from step root, or -1 for one that
+** may start anywhere; see Optimizer above.
+*/
+
+void optimizeprogram(int root) {
+
+  OPNODE *op, *end;
+  CODENODE *code;
+  char *inloop;
+  int *work, vars[VARCOUNT];
+  int step, i, v, changed, flows, hoisted;
+
+  if ( ! optimizing
+      || (engine != ENGINE_COMPILED && engine != ENGINE_DOUBLE)) {
+    return;
+  }
+  optfolded = 0;
+  optreused = 0;
+  optstores = 0;
+  opthoisted = 0;
+  noptvalues = 0;
+  if (opttable != NULL) {
+    memset(opttable, 0xff, opttablesize * sizeof(int));
+  }
+
+  /* the flow of the lines, unless tasks or parallel loops can run
+     lines that verifyprogram() did not follow there */
+  flows = root >= 0 && nflowedges >= 0;
+  for (step = 0; step < laststep && flows; step++) {
+    if (linecode[step] == NULL) {
+      continue;
+    }
+    op = linecode[step]->ops;
+    for (end = op + linecode[step]->nops; op < end; op++) {
+      if (op->code == OP_TASK || op->code == OP_PARALLEL) {
+	flows = FALSE;
+      }
+    }
+  }
+
+  changed = FALSE;
+  if ( ! flows) {
+    for (step = 0; step < laststep; step++) {
+      if (linecode[step] != NULL && linecode[step]->exact) {
+	for (v = 0; v < VARCOUNT; v++) {
+	  vars[v] = optvalue(OV_ENTRY, 0, 0, step, v, 0);
+	}
+	changed |= optline(step, vars);
+      }
+    }
+  } else {
+    optsuccfrom = calloc(laststep + 1, sizeof(int));
+    optpredfrom = calloc(laststep + 1, sizeof(int));
+    optsucc = malloc((nflowedges + 1) * sizeof(int));
+    optpred = malloc((nflowedges + 1) * sizeof(int));
+    for (i = 0; i < nflowedges; i++) {
+      optsuccfrom[flowedges[2 * i] + 1]++;
+      optpredfrom[flowedges[2 * i + 1] + 1]++;
+    }
+    for (step = 0; step < laststep; step++) {
+      optsuccfrom[step + 1] += optsuccfrom[step];
+      optpredfrom[step + 1] += optpredfrom[step];
+    }
+    work = malloc((laststep + VARCOUNT) * sizeof(int));
+    memcpy(work, optpredfrom, laststep * sizeof(int));
+    for (i = 0; i < nflowedges; i++) {
+      optsucc[i] = flowedges[2 * i + 1];
+      optpred[work[flowedges[2 * i + 1]]++] = flowedges[2 * i];
+    }
+    optin = malloc(laststep * VARCOUNT * sizeof(int));
+    inloop = malloc(laststep + 1);
+
+    nopthoists = 0;
+    optflow(root);
+    hoisted = 0;
+    for (step = 0; step < laststep && nopthoists < OPTREGS; step++) {
+      if (optin[step * VARCOUNT] >= 0) {
+	hoisted += opthoistloop(step, root, inloop, work);
+      }
+    }
+    if (hoisted > 0) {
+      optflow(root);
+    }
+
+    for (step = 0; step < laststep; step++) {
+      if (optin[step * VARCOUNT] >= 0) {
+	changed |= optline(step, optin + step * VARCOUNT);
+      }
+    }
+
+    /* each hoist after the line it follows */
+    for (i = 0; i < nopthoists; i++) {
+      code = linecode[opthoists[i].step];
+      code->hoist = realloc(code->hoist, (code->nhoist + opthoists[i].nops)
+			    * sizeof(OPNODE));
+      memcpy(code->hoist + code->nhoist, opthoists[i].ops,
+	     opthoists[i].nops * sizeof(OPNODE));
+      code->nhoist += opthoists[i].nops;
+      opthoisted++;
+      changed = TRUE;
+    }
+
+    free(inloop);
+    free(optin);
+    free(work);
+    free(optsucc);
+    free(optpred);
+    free(optsuccfrom);
+    free(optpredfrom);
+    optin = NULL;
+  }
+
+  if (changed) {
+    memoanalyse();
+  }
+}
+
+
+/*
+** optreset
+**
+** Put every line back as compiled, and clear the registers.
+*/
+
+void optreset(void) {
+
+  CODENODE *code;
+  int step, v;
+
+  for (step = 0; step < laststep; step++) {
+    code = linecode[step];
+    if (code == NULL) {
+      continue;
+    }
+    if (code->plain != NULL) {
+      free(code->ops);
+      code->ops = code->plain;
+      code->nops = code->nplain;
+      code->plain = NULL;
+    }
+    free(code->hoist);
+    code->hoist = NULL;
+    code->nhoist = 0;
+  }
+  nopthoists = 0;
+  for (v = 27; v < VARCOUNT; v++) {
+    varz[v] = 0;
+  }
+}
+
+
+/*
+** runhoist
+**
+** Work out the loop invariants hoisted to after this line.
+*/
+
+void runhoist(CODENODE *code) {
+
+  OPNODE *op, *end;
+  double st[STACKLIMIT], x;
+  int sp;
+
+  sp = 0;
+  for (op = code->hoist, end = op + code->nhoist; op < end; op++) {
+    switch (op->code) {
+    case OP_NUM:    st[sp++] = op->value;                      break;
+    case OP_GETVAR: st[sp++] = varz[op->arg];                  break;
+    case OP_PUTVAR: varz[op->arg] = st[--sp];                  break;
+    case OP_ADD:    sp--; st[sp - 1] = st[sp - 1] + st[sp];    break;
+    case OP_SUB:    sp--; st[sp - 1] = st[sp - 1] - st[sp];    break;
+    case OP_MUL:    sp--; st[sp - 1] = st[sp - 1] * st[sp];    break;
+    case OP_DIV:    sp--; st[sp - 1] = st[sp - 1] / st[sp];    break;
+    case OP_POW:    sp--; st[sp - 1] = pow(st[sp - 1], st[sp]); break;
+    case OP_LT:     sp--; st[sp - 1] = st[sp - 1] < st[sp];    break;
+    case OP_GT:     sp--; st[sp - 1] = st[sp - 1] > st[sp];    break;
+    case OP_EQ:     sp--; st[sp - 1] = st[sp - 1] == st[sp];   break;
+    case OP_NOT:    st[sp - 1] = ! st[sp - 1];                 break;
+    case OP_NEG:    st[sp - 1] = st[sp - 1] * -1;              break;
+    case OP_MATH:   st[sp - 1] = mathone(op->arg, st[sp - 1]); break;
+
+    case OP_AND:
+      sp--;
+      st[sp - 1] = logical(st[sp - 1]) == 1 && logical(st[sp]) == 1;
+      break;
+
+    case OP_OR:
+      sp--;
+      st[sp - 1] = logical(st[sp - 1]) == 1 || logical(st[sp]) == 1;
+      break;
+
+    case OP_INT:
+      x = st[sp - 1];
+      st[sp - 1] = x < 0 ? ceil(x) : floor(x);
+      break;
+    }
+  }
+}
+
+
+/*
+** lpop, lspop, lpush, lspush
+**
+** The stack operations of runline(), which is only given a line that
+** fits the stacks, see safeline(), so they need not check.
+*/
+
+static double lpop(void) {
+  return compstack[--compstackindex];
+}
+
+static double lspop(void) {
+  return ustack[--ustackindex];
+}
+
+static void lpush(double in) {
+  compstack[compstackindex++] = in;
+}
+
+static void lspush(double in) {
+  ustack[ustackindex++] = in;
+}
+
+
+/*
+** safeline
+**
+** Whether a compiled line can run with runline() at the present stack
+** depths: verifyprogram() has proven it can, or the depths are in the
+** ranges stackdepth() found. Other lines are interpreted, which
+** checks each operation.
+*/
+
+int safeline(CODENODE *code) {
+
+  return code->proven
+    || (compstackindex >= code->mindepth && compstackindex <= code->maxentry
+	&& ustackindex >= code->upops
+	&& ustackindex <= STACKLIMIT - code->urise);
+}
+
+
+/*
+** runline
+**
+** Run one compiled line against the current execution state, from
+** operation first on. Only a typed engine handing over part way
+** through a line starts anywhere but 0. The line has to fit the
+** stacks, see safeline().
+*/
+
+void runline(CODENODE *code, int first) {
+
+  OPNODE *op, *end;
+  double x,y;
+  long k;
+
+  for (op = code->ops + first, end = code->ops + code->nops; op < end; op++) {
+    switch (op->code) {
+
+    case OP_NUM:     lpush(op->value);          break;
+    case OP_LASTNUM: lpush(thenumber);          break;
+    case OP_GETVAR:  lpush(varz[op->arg]);      break;
+
+    case OP_PUTVAR:
+      varz[op->arg] = lpop();
+      lpush(varz[op->arg]);
+      break;
+
+    case OP_VARDYN:
+      if (putget == GET || indirect == TRUE) {
+	lpush(varz[op->arg]);
+      } else {
+	varz[op->arg] = lpop();
+	lpush(varz[op->arg]);
+      }
+      break;
+
+    case OP_CLEAR:
+      compstackindex = 0;
+      putget = GET;
+      indirect = FALSE;
+      break;
+
+    case OP_PUTMODE: putget = PUT;                               break;
+    case OP_PRINT:   fputs(code->strings + op->arg, stdout);     break;
+    case OP_FORMAT:  strcpy(numberformat, code->strings + op->arg); break;
+    case OP_ADD:     lpush(lpop() + lpop());                     break;
+    case OP_MUL:     lpush(lpop() * lpop());                     break;
+    case OP_NOT:     lpush( ! lpop());                           break;
+    case OP_NEG:     lpush(lpop() * -1);                         break;
+    case OP_EQ:      lpush(lpop() == lpop());                    break;
+
+    case OP_SUB: x = lpop(); y = lpop(); lpush(y - x);           break;
+    case OP_LT:  x = lpop(); y = lpop(); lpush(y < x);           break;
+    case OP_GT:  x = lpop(); y = lpop(); lpush(y > x);           break;
+    case OP_POW: x = lpop(); y = lpop(); lpush(pow(y, x));       break;
+
+    case OP_DIV:
+      x = lpop();
+      y = lpop();
+      if (x == 0) {
+	printf("Tiny -- %lf div by zero! Black hole forming!\n",exlino);
+	running = FALSE;
+      } else {
+	lpush(y/x);
+      }
+      break;
+
+    case OP_INT:
+      x = lpop();
+      if (x < 0 ) {
+	lpush(ceil(x));
+      } else {
+	lpush(floor(x));
+      }
+      break; 
+
+    case OP_AND:
+      x = logical(lpop());
+      y = logical(lpop());
+      lpush((x == 1) && (y == 1));
+      break;
+
+    case OP_OR:
+      x = logical(lpop());
+      y = logical(lpop());
+      lpush((x == 1) || (y == 1));
+      break;
+
+    case OP_LPARDYN:
+      if (putget == PUT) {
+	indirect = TRUE;
+      }
+      break;
+
+    case OP_INDIRECT:
+      indirect = TRUE;
+      break;
+
+    case OP_RPARDYN:
+      if (putget == GET) {
+	goto fetch;
+      }
+      goto store;
+
+    case OP_FETCH:
+    fetch:
+      indirect = FALSE;
+      k = arrayindex(lpop());
+      lpush(k < 0 ? 0 : darray[k]);
+      break;
+
+    case OP_STORE:
+    store:
+      indirect = FALSE;
+      k = arrayindex(lpop());
+      y = lpop();
+      if (k >= 0) {
+	darray[k] = y;
+      }
+      lpush(y);
+      break;
+
+    case OP_RANDDYN:
+      if (putget == PUT) {
+	goto seed;
+      }
+      /* fall through */
+    case OP_RAND:
+      lpush(pipi());
+      break;
+
+    case OP_SEED:
+    seed:
+      x = lpop();
+      lpush(x);
+      spipi(seedvalue(x));
+      break;
+
+    case OP_IODYN:
+      if (putget == PUT) {
+	goto output;
+      }
+      /* fall through */
+    case OP_INPUT:
+      printf("%s",NUMPROMPT);
+      if (inputended()) {
+	suspendline(code, op + 1 - code->ops);
+	return;
+      }
+      x = inputnumber();
+      lpush(x);
+      break;
+
+    case OP_OUTPUT:
+    output:
+      x = lpop();
+      lpush(x);
+      printf(numberformat,x);
+      break;
+
+    case OP_ATDYN:
+      if (putget == PUT) {
+	goto jump;
+      }
+      /* fall through */
+    case OP_GETAT:
+      lpush(exlino);
+      break;
+
+    case OP_JUMP:
+    jump:
+      x = lpop();
+      lpush(x);
+      if (x != 0) {
+	exlino = x;
+      }
+      break;
+
+    case OP_USTKDYN:
+      if (putget == PUT) {
+	goto pushu;
+      }
+      /* fall through */
+    case OP_POPU:
+      lpush(lspop());
+      break;
+
+    case OP_PUSHU:
+    pushu:
+      x = lpop();
+      lpush(x);
+      lspush(x);
+      break;
+
+    case OP_MATHDYN:
+      if (putget == PUT) {
+	goto mathrange;
+      }
+      /* fall through */
+    case OP_MATH:
+      lpush(mathone(op->arg, lpop()));
+      break;
+
+    case OP_MATHRANGE:
+    mathrange:
+      x = lpop();
+      y = lpop();
+      lpush(y);
+      lpush(x);
+      mathrange(op->arg, y, x);
+      break;
+
+    case OP_MATRIX:
+      if (CALLKERNEL(op->arg) == MATRIX_VIEW) {
+	viewdefine(CALLVIEW(op->arg, 0), compstack[compstackindex - 4],
+		   compstack[compstackindex - 3], compstack[compstackindex - 2],
+		   compstack[compstackindex - 1], TRUE);
+      } else {
+	matrixcall(op->arg);
+      }
+      break;
+
+    case OP_ELEMDYN:
+      if (putget == PUT) {
+	goto elemstore;
+      }
+      /* fall through */
+    case OP_ELEMENT:
+      y = lpop();
+      x = lpop();
+      k = viewindex(op->arg, x, y, TRUE);
+      if (k >= 0) {
+	lpush(darray[k]);
+      }
+      break;
+
+    case OP_ELEMSTORE:
+    elemstore:
+      y = lpop();
+      x = lpop();
+      k = viewindex(op->arg, x, y, TRUE);
+      if (k >= 0) {
+	darray[k] = compstack[compstackindex - 1];
+      }
+      break;
+
+    case OP_TASK:
+      taskcall(op->arg);
+      break;
+
+    case OP_PARALLEL:
+      parallelcall(op->arg);
+      break;
+
+    case OP_DATA:
+      datacall(code->strings + op->arg, (int) op->value);
+      break;
+
+    case OP_SORT:
+      sortcall(op->arg);
+      break;
+
+    case OP_HASH:
+      hashcall(op->arg);
+      break;
+
+    case OP_STOP:
+      running = FALSE;
+      return;
+    }
+
+    /* an error stops the line where it happened */
+    if ( ! running) {
+      return;
+    }
+  }
+
+  if (code->hasconst) {
+    thenumber = code->lastconst;
+  }
+} /* runline */
+
+
+/*
+** The typed engines, see fltengine.h
+*/
+
+#define NUM          long long
+#define ENGINE(n)    n ## _int64
+#define NUMINT       1
+#define NUMCONST(op) ((long long) (op)->arg)
+#define NUMPRINT(x)  printf(numberformat, (double) (x))
+#define NUMPOW       pow
+#define NUMFLOOR     floor
+#define NUMCEIL      ceil
+#include "fltengine.h"
+
+#define NUM          float
+#define ENGINE(n)    n ## _float
+#define NUMINT       0
+#define NUMCONST(op) ((float) (op)->value)
+#define NUMPRINT(x)  printf(numberformat, (double) (x))
+#define NUMPOW       powf
+#define NUMFLOOR     floorf
+#define NUMCEIL      ceilf
+#define NUMMATH(fn, x) ((float) mathone(fn, (double) (x)))
+#include "fltengine.h"
+
+#define NUM          long double
+#define ENGINE(n)    n ## _long
+#define NUMINT       0
+#define NUMCONST(op) ((long double) (op)->value)
+#define NUMPRINT(x)  printlong(x)
+#define NUMPOW       powl
+#define NUMFLOOR     floorl
+#define NUMCEIL      ceill
+#define NUMMATH(fn, x) mathlong(fn, x)
+#include "fltengine.h"
+
+
+/*
+** printlong
+**
+** Print a long double with numberformat, which is written for a
+** double: an f, e, g or a conversion is given the L it needs. Other
+** formats get the value as a double.
+*/
+
+void printlong(long double x) {
+
+  char fmt[sizeof(numberformat) + 1];
+  char *p, *q;
+
+  p = strchr(numberformat, '%');
+  if (p != NULL) {
+    for (p++; *p != '\0' && strchr("-+ #0123456789.", *p) != NULL; p++) {
+    }
+    for (q = p; *q == 'l' || *q == 'L'; q++) {
+    }
+    if (*q != '\0' && strchr("fFeEgGaA", *q) != NULL
+	&& strchr(q, '%') == NULL) {
+      memcpy(fmt, numberformat, p - numberformat);
+      fmt[p - numberformat] = 'L';
+      strcpy(fmt + (p - numberformat) + 1, q);
+      printf(fmt, x);
+      return;
+    }
+  }
+  printf(numberformat, (double) x);
+}
+
+
+/*
+** Lanes
+**
+** fltiny --batch sets prog.flt runs the program once for each line of
+** the file sets, which presets variables for that run, as a=1.5 b=2.
+** The runs go LANES at a time through laneline(), where each variable,
+** stack entry and array element is a vector with one lane for each run
+** and most operations work on every lane at once.
+**
+** Each lane goes its own way through @. Every line is run for the
+** lanes waiting at the first line any lane is waiting at, with the rest
+** masked off, so lanes that went different ways meet again at the line
+** where their paths join. A lane runs only with lanes whose stack
+** depths and put or get mode are the same as its own.
+**
+** A lane that meets what laneline() does not do -- a line to interpret,
+** input, a divide by zero, an array index out of range, a {name} other
+** than a maths function, a breakpoint -- is handed to the double engine
+** at that operation and finishes alone, as the typed engines hand over.
+** Each run's output is kept apart and printed after a line --- run n.
+*/
+
+typedef double LANEVEC __attribute__ ((vector_size (LANES * sizeof(double))));
+typedef long LANEMASK __attribute__ ((vector_size (LANES * sizeof(long))));
+
+LANEVEC lanevarz[VARCOUNT];        /* variables, a lane for each run    */
+LANEVEC lanestack[STACKLIMIT];     /* computational stack               */
+LANEVEC laneustack[STACKLIMIT];    /* $ stack                           */
+LANEVEC *lanearray;                /* arrayelements, made on first use  */
+LANEVEC lanethenumber;             /* last numeric constant parsed      */
+double laneexlino[LANES];          /* each lane's @ register            */
+int lanestep[LANES];               /* ... and the step it found         */
+int lanesp[LANES];                 /* stack indexes                     */
+int laneusp[LANES];
+int laneputget[LANES];
+int laneindirect[LANES];
+int lanerunning[LANES];            /* FALSE once the run has ended      */
+int lanestatus[LANES];             /* exitstatus the run ended with     */
+double laneseed[LANES];            /* pipirandseed                      */
+char laneformat[LANES][20];        /* numberformat                      */
+VIEW laneviews[26];                /* views as the runs start           */
+FILE *laneout[LANES];              /* what the run prints, kept in      */
+char *lanebuf[LANES];              /* ... memory until the batch is     */
+size_t lanelen[LANES];             /* ... done                          */
+
+/* true lanes as 1, false as 0 */
+#define LANETRUTH(t) __builtin_convertvector(-(t), LANEVEC)
+
+/* each lane in the mask m */
+#define EACHLANE(l) for ((l) = 0; (l) < LANES; (l)++) if (m[l])
+
+/* set the masked lanes of dst */
+#define LANESET(dst, val)						\
+  do {									\
+    lanenew = (val);							\
+    if (full) {								\
+      (dst) = lanenew;							\
+    } else {								\
+      (dst) = (LANEVEC) (((LANEMASK) lanenew & m)			\
+			 | ((LANEMASK) (dst) & ~m));			\
+    }									\
+  } while (0)
+
+
+/*
+** laneline
+**
+** Run a line for the lanes in mask, all of them if full. lead is
+** one of them, whose stack depths and modes they all share. Returns
+** -1 when the line is done, or else the operation to hand them over
+** to the double engine at.
+*/
+
+int laneline(CODENODE *code, LANEMASK *mask, int full, int lead) {
+
+  LANEVEC *s, *u, *vz;   /* stacks and variables                          */
+  LANEVEC lanenew;       /* value LANESET() is setting                    */
+  LANEMASK m;
+  OPNODE *op, *end;
+  int sp, usp, pg, ind;  /* the lanes' stack indexes and modes            */
+  int l, result;
+  double x;
+
+  m = *mask;
+  s = lanestack;
+  u = laneustack;
+  vz = lanevarz;
+  sp = lanesp[lead];
+  usp = laneusp[lead];
+  pg = laneputget[lead];
+  ind = laneindirect[lead];
+  result = -1;
+
+  for (op = code->ops, end = op + code->nops; op < end; op++) {
+    switch (op->code) {
+
+    case OP_NUM:     LANESET(s[sp], (LANEVEC) {} + op->value); sp++;  break;
+    case OP_LASTNUM: LANESET(s[sp], lanethenumber); sp++;           break;
+    case OP_GETVAR:  LANESET(s[sp], vz[op->arg]); sp++;             break;
+    case OP_PUTVAR:  LANESET(vz[op->arg], s[sp - 1]);               break;
+
+    case OP_VARDYN:
+      if (pg == GET || ind == TRUE) {
+	LANESET(s[sp], vz[op->arg]);
+	sp++;
+      } else {
+	LANESET(vz[op->arg], s[sp - 1]);
+      }
+      break;
+
+    case OP_CLEAR:
+      sp = 0;
+      pg = GET;
+      ind = FALSE;
+      break;
+
+    case OP_PUTMODE:
+      pg = PUT;
+      break;
+
+    case OP_PRINT:
+      EACHLANE(l) {
+	fputs(code->strings + op->arg, laneout[l]);
+      }
+      break;
+
+    case OP_FORMAT:
+      EACHLANE(l) {
+	strcpy(laneformat[l], code->strings + op->arg);
+      }
+      break;
+
+    case OP_ADD: sp--; LANESET(s[sp - 1], s[sp - 1] + s[sp]);          break;
+    case OP_SUB: sp--; LANESET(s[sp - 1], s[sp - 1] - s[sp]);          break;
+    case OP_MUL: sp--; LANESET(s[sp - 1], s[sp - 1] * s[sp]);          break;
+    case OP_NEG: LANESET(s[sp - 1], s[sp - 1] * -1.0);                 break;
+    case OP_NOT: LANESET(s[sp - 1], LANETRUTH(s[sp - 1] == 0));        break;
+    case OP_EQ:  sp--; LANESET(s[sp - 1], LANETRUTH(s[sp - 1] == s[sp])); break;
+    case OP_LT:  sp--; LANESET(s[sp - 1], LANETRUTH(s[sp - 1] < s[sp]));  break;
+    case OP_GT:  sp--; LANESET(s[sp - 1], LANETRUTH(s[sp - 1] > s[sp]));  break;
+
+    case OP_AND:
+      sp--;
+      LANESET(s[sp - 1], LANETRUTH((s[sp - 1] != 0) & (s[sp] != 0)));
+      break;
+
+    case OP_OR:
+      sp--;
+      LANESET(s[sp - 1], LANETRUTH((s[sp - 1] != 0) | (s[sp] != 0)));
+      break;
+
+    case OP_DIV:
+      EACHLANE(l) {
+	if (s[sp - 1][l] == 0) {
+	  goto handover;
+	}
+      }
+      sp--;
+      LANESET(s[sp - 1], s[sp - 1] / s[sp]);
+      break;
+
+    case OP_POW:
+      sp--;
+      EACHLANE(l) {
+	s[sp - 1][l] = pow(s[sp - 1][l], s[sp][l]);
+      }
+      break;
+
+    case OP_INT:
+      EACHLANE(l) {
+	x = s[sp - 1][l];
+	s[sp - 1][l] = x < 0 ? ceil(x) : floor(x);
+      }
+      break;
+
+    case OP_MATHDYN:
+      if (pg == PUT) {
+	goto handover;
+      }
+      /* fall through */
+    case OP_MATH:
+      EACHLANE(l) {
+	s[sp - 1][l] = mathone(op->arg, s[sp - 1][l]);
+      }
+      break;
+
+    case OP_LPARDYN:
+      if (pg == PUT) {
+	ind = TRUE;
+      }
+      break;
+
+    case OP_INDIRECT:
+      ind = TRUE;
+      break;
+
+    case OP_RPARDYN:
+      if (pg == GET) {
+	goto fetch;
+      }
+      goto store;
+
+    case OP_FETCH:
+    fetch:
+      EACHLANE(l) {
+	x = s[sp - 1][l];
+	if ( ! (x > -1 && x < arrayelements)) {
+	  goto handover;
+	}
+      }
+      ind = FALSE;
+      EACHLANE(l) {
+	s[sp - 1][l] = lanearray[(long) s[sp - 1][l]][l];
+      }
+      break;
+
+    case OP_STORE:
+    store:
+      EACHLANE(l) {
+	x = s[sp - 1][l];
+	if ( ! (x > -1 && x < arrayelements)) {
+	  goto handover;
+	}
+      }
+      ind = FALSE;
+      sp--;
+      EACHLANE(l) {
+	lanearray[(long) s[sp][l]][l] = s[sp - 1][l];
+      }
+      break;
+
+    case OP_RANDDYN:
+      if (pg == PUT) {
+	goto seed;
+      }
+      /* fall through */
+    case OP_RAND:
+      EACHLANE(l) {
+	pipirandseed = laneseed[l];
+	s[sp][l] = pipi();
+	laneseed[l] = pipirandseed;
+      }
+      sp++;
+      break;
+
+    case OP_SEED:
+    seed:
+      if (recordfp != NULL || replaying) {
+	goto handover;
+      }
+      EACHLANE(l) {
+	laneseed[l] = seedvalue(s[sp - 1][l]);
+      }
+      break;
+
+    case OP_IODYN:
+      if (pg == GET) {
+	goto handover;
+      }
+      /* fall through */
+    case OP_OUTPUT:
+      EACHLANE(l) {
+	fprintf(laneout[l], laneformat[l], s[sp - 1][l]);
+      }
+      break;
+
+    case OP_ATDYN:
+      if (pg == PUT) {
+	goto jump;
+      }
+      /* fall through */
+    case OP_GETAT:
+      EACHLANE(l) {
+	s[sp][l] = laneexlino[l];
+      }
+      sp++;
+      break;
+
+    case OP_JUMP:
+    jump:
+      EACHLANE(l) {
+	if (s[sp - 1][l] != 0) {
+	  laneexlino[l] = s[sp - 1][l];
+	}
+      }
+      break;
+
+    case OP_USTKDYN:
+      if (pg == PUT) {
+	goto pushu;
+      }
+      /* fall through */
+    case OP_POPU:
+      usp--;
+      LANESET(s[sp], u[usp]);
+      sp++;
+      break;
+
+    case OP_PUSHU:
+    pushu:
+      LANESET(u[usp], s[sp - 1]);
+      usp++;
+      break;
+
+    case OP_STOP:
+      EACHLANE(l) {
+	lanerunning[l] = FALSE;
+      }
+      goto done;
+
+    default:
+      goto handover;
+    }
+  }
+
+  if (code->hasconst) {
+    LANESET(lanethenumber, (LANEVEC) {} + code->lastconst);
+  }
+  goto done;
+
+ handover:
+  result = op - code->ops;
+
+ done:
+  EACHLANE(l) {
+    lanesp[l] = sp;
+    laneusp[l] = usp;
+    laneputget[l] = pg;
+    laneindirect[l] = ind;
+  }
+  return result;
+}
+
+
+/*
+** laneeject
+**
+** Hand lane l over to the double engine to finish its run alone, from
+** operation first of code, or from its @ register if code is NULL.
+*/
+
+void laneeject(int l, CODENODE *code, int first) {
+
+  FILE *saveout;
+  long i;
+
+  /* as the run would have found them, had it run alone */
+  if (tasking) {
+    taskreset();
+  }
+  hashclear();
+  memcpy(views, laneviews, sizeof(views));
+  numbuild = FALSE;
+  StringPrint = FALSE;
+  gatherformat = FALSE;
+
+  for (i = 0; i < VARCOUNT; i++) {
+    varz[i] = lanevarz[i][l];
+  }
+  for (i = 0; i < STACKLIMIT; i++) {
+    compstack[i] = lanestack[i][l];
+    ustack[i] = laneustack[i][l];
+  }
+  for (i = 0; i < arrayelements; i++) {
+    darray[i] = lanearray[i][l];
+  }
+  compstackindex = lanesp[l];
+  ustackindex = laneusp[l];
+  exlino = laneexlino[l];
+  thenumber = lanethenumber[l];
+  putget = laneputget[l];
+  indirect = laneindirect[l];
+  strcpy(numberformat, laneformat[l]);
+  pipirandseed = laneseed[l];
+  exitstatus = lanestatus[l];
+
+  saveout = stdout;
+  stdout = laneout[l];
+  running = TRUE;
+  if (code != NULL) {
+    runline(code, first);
+    if ( compstackindex < 0) {
+      printf("*** Tiny Comp Stack underflow \n");
+      running = FALSE;
+    }
+    if (tasking) {
+      schedule();
+    }
+  }
+  if (running) {
+    runprogram();
+  }
+  stdout = saveout;
+
+  lanestatus[l] = exitstatus;
+  lanerunning[l] = FALSE;
+}
+
+
+/*
+** lanestart
+**
+** Set up a lane for each of n runs, from the state the program would
+** start in and the variables in presets.
+*/
+
+void lanestart(double presets[][26], int n) {
+
+  long i;
+  int l, v;
+
+  startrun();
+  verifyprogram(0);
+
+  if (lanearray == NULL) {
+    lanearray = aligned_alloc(sizeof(LANEVEC), arrayelements * sizeof(LANEVEC));
+  }
+  for (i = 0; i < arrayelements; i++) {
+    lanearray[i] = (LANEVEC) {} + darray[i];
+  }
+  for (v = 0; v < VARCOUNT; v++) {
+    lanevarz[v] = (LANEVEC) {} + varz[v];
+  }
+  memset(lanestack, 0, sizeof(lanestack));
+  memset(laneustack, 0, sizeof(laneustack));
+  lanethenumber = (LANEVEC) {};
+  memcpy(laneviews, views, sizeof(views));
+
+  for (l = 0; l < LANES; l++) {
+    lanerunning[l] = l < n;
+    laneexlino[l] = linos[0];
+    lanestep[l] = 0;
+    lanesp[l] = 0;
+    laneusp[l] = 0;
+    laneputget[l] = GET;
+    laneindirect[l] = FALSE;
+    lanestatus[l] = exitstatus;
+    laneseed[l] = pipirandseed;
+    strcpy(laneformat[l], numberformat);
+    laneout[l] = NULL;
+    if (l < n) {
+      for (v = 0; v < 26; v++) {
+	lanevarz[v][l] = presets[l][v];
+      }
+      laneout[l] = open_memstream(&lanebuf[l], &lanelen[l]);
+    }
+  }
+}
+
+
+/*
+** lanerun
+**
+** Run the lanes until every run has ended.
+*/
+
+void lanerun(void) {
+
+  CODENODE *code;
+  LANEMASK m;
+  int l, lead, step, full, first, sp, usp, found;
+  double foundlino;
+
+  for (;;) {
+
+    /* the first line a lane is waiting at */
+    lead = -1;
+    for (l = 0; l < LANES; l++) {
+      if (lanerunning[l] && (lead < 0 || lanestep[l] < lanestep[lead])) {
+	lead = l;
+      }
+    }
+    if (lead < 0) {
+      return;
+    }
+
+    /* ... and the lanes there that can run with it */
+    step = lanestep[lead];
+    sp = lanesp[lead];
+    usp = laneusp[lead];
+    full = TRUE;
+    for (l = 0; l < LANES; l++) {
+      m[l] = lanerunning[l] && lanestep[l] == step && lanesp[l] == sp
+	     && laneusp[l] == usp && laneputget[l] == laneputget[lead]
+	     && laneindirect[l] == laneindirect[lead] ? -1 : 0;
+      if ( ! m[l]) {
+	full = FALSE;
+      }
+    }
+
+    code = step < laststep ? linecompile(step) : NULL;
+    if (code == NULL || ! code->exact || lineflags[step] != NOBREAKPOINT
+	|| nowstepping || (debugging && traceing)
+	|| ( ! code->proven
+	    && (sp < code->mindepth || sp > code->maxentry
+		|| usp < code->upops || usp > STACKLIMIT - code->urise))) {
+      EACHLANE(l) {
+	laneeject(l, NULL, 0);
+      }
+      continue;
+    }
+
+    thisstep = (long) laneexlino[lead];
+    EACHLANE(l) {
+      laneexlino[l] = linos[step + 1];
+    }
+    first = laneline(code, &m, full, lead);
+
+    /* where each goes next; lanes that jump mostly jump together */
+    foundlino = -1;
+    found = -1;
+    EACHLANE(l) {
+      if (first >= 0) {
+	laneeject(l, code, first);
+      } else if (lanerunning[l]) {
+	if (step + 1 <= laststep && linos[step + 1] == laneexlino[l]) {
+	  lanestep[l] = step + 1;
+	} else {
+	  if (laneexlino[l] != foundlino) {
+	    foundlino = laneexlino[l];
+	    found = findstep(foundlino);
+	  }
+	  lanestep[l] = found;
+	  if (lanestep[l] < 0) {
+	    laneeject(l, NULL, 0);
+	  }
+	}
+      }
+    }
+  }
+}
+
+
+/*
+** batchprogram
+**
+** fltiny --batch: run the loaded program for each line of the file
+** path, LANES runs at a time. Returns the highest exit status.
+*/
+
+int batchprogram(char path[]) {
+
+  FILE *fp;
+  char *line, *p;
+  double (*presets)[26]; /* variables for each run                        */
+  long nsets, size, first, i;
+  int n, l, len, status;
+  char name;
+  double v;
+
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    printf("Tiny -- can't open batch [%s]\n", path);
+    return 1;
+  }
+
+  nsets = 0;
+  size = 64;
+  presets = malloc(size * sizeof(*presets));
+  while ((line = readtext(fp)) != NULL) {
+    for (p = line; isspace(*p); p++) {
+    }
+    if (*p != '\0' && *p != '#') {
+      if (nsets == size) {
+	size = size * 2;
+	presets = realloc(presets, size * sizeof(*presets));
+      }
+      for (i = 0; i < 26; i++) {
+	presets[nsets][i] = 0;
+      }
+      while (sscanf(p, " %c = %lf%n", &name, &v, &len) == 2) {
+	if (name >= 'a' && name <= 'z') {
+	  presets[nsets][name - 'a'] = v;
+	}
+	p += len;
+      }
+      nsets++;
+    }
+    free(line);
+  }
+  fclose(fp);
+
+  status = 0;
+  for (first = 0; first < nsets; first += LANES) {
+    n = nsets - first < LANES ? (int) (nsets - first) : LANES;
+    lanestart(presets + first, n);
+    lanerun();
+    for (l = 0; l < n; l++) {
+      fclose(laneout[l]);
+      printf("--- run %ld\n", first + l + 1);
+      fwrite(lanebuf[l], 1, lanelen[l], stdout);
+      free(lanebuf[l]);
+      if (lanestatus[l] > status) {
+	status = lanestatus[l];
+      }
+    }
+  }
+  free(presets);
+  return status;
+}
+
+
+double inputnumber(void) {
+
+#define CR '\012'
+#define BS '\000'
+
+	double val;
+	int  c;
+	int  i;
+	char txtnumber[30];
+
+	if (replaying) {
+		return replayinput();
+	}
+	outflush();
+	i = 0;
+	val = 0;
+	txtnumber[0] = 0;
+	do {
+		c = getchar();
+		if (c == '!') {
+			nowstepping = TRUE;
+			debugging = TRUE;
+			c = CR;
+		}
+		if (c == EOF) {
+			c = CR;
+		}
+		if (i < (int) sizeof(txtnumber) - 1) {
+			txtnumber[i]   = c;
+			txtnumber[i+1] = 0;
+			i++;
+		}
+	} while (c != CR);
+	sscanf(txtnumber,"%lf",&val);
+	if (recordfp != NULL) {
+		recordwrite('?', val);
+	}
+	return val;
+}
+
+
+/*
+** Suspending for input
+**
+** With inputyield set, a '?' that finds no input waiting stops the
+** run instead of reading zero, leaving suspended set and where it
+** was in suspendcode or suspendchars. The host gets more input and
+** calls resumeprogram() with the number, and the run carries on as
+** if '?' had read it. Every other part of the run's state is in the
+** globals as it was, for the host to keep; see sessionout().
+**
+** Only the double engine stops: the typed engines hand a '?' over to
+** it. A run with tasks started, or a parallel loop, never stops.
+*/
+
+CODENODE suspendcode;              /* what is left of the compiled line */
+char *suspendchars;                /* ... or the interpreted line, NULL */
+int suspendat;                     /* ... and where in it to carry on   */
+
+
+/*
+** inputended
+**
+** TRUE if '?' should suspend the run, as there is no more input.
+*/
+
+int inputended(void) {
+
+  int c;
+
+  if ( ! inputyield || tasking || replaying) {
+    return FALSE;
+  }
+  c = getchar();
+  if (c == EOF) {
+    clearerr(stdin);
+    return TRUE;
+  }
+  ungetc(c, stdin);
+  return FALSE;
+}
+
+
+/*
+** suspendline / suspendtext
+**
+** Stop the run, to carry on with operation next of a compiled line or
+** character next of an interpreted one. The rest of a compiled line is
+** copied, as the optimizer may have rewritten the line by then.
+*/
+
+void suspendline(CODENODE *code, int next) {
+
+  suspendcode = *code;
+  suspendcode.nops = code->nops - next;
+  suspendcode.ops = malloc((suspendcode.nops + 1) * sizeof(OPNODE));
+  memcpy(suspendcode.ops, code->ops + next, suspendcode.nops * sizeof(OPNODE));
+  suspendcode.plain = NULL;
+  suspendcode.hoist = NULL;
+  suspendchars = NULL;
+  running = FALSE;
+  suspended = TRUE;
+}
+
+
+void suspendtext(char xtext[], int next) {
+
+  suspendcode.ops = NULL;
+  suspendchars = xtext;
+  suspendat = next;
+  running = FALSE;
+  suspended = TRUE;
+}
+
+
+/*
+** resumeprogram
+**
+** Carry on a suspended run with value as the number '?' read. The
+** program must be the one that was running, but it may have been run
+** again since, so its lines go back to the way they were compiled.
+*/
+
+void resumeprogram(double value) {
+
+  CODENODE rest;
+
+  running = TRUE;
+  suspended = FALSE;
+  limitstart();
+  optreset();
+  memoanalyse();
+
+  cpush(value);
+  if (suspendchars != NULL) {
+    interpretfrom(suspendchars, suspendat);
+  } else {
+    rest = suspendcode;
+    suspendcode.ops = NULL;
+    runline(&rest, 0);
+    free(rest.ops);
+  }
+  if ( compstackindex < 0) {
+    printf("*** Tiny Comp Stack underflow \n");
+    running = FALSE;
+  }
+
+  if (running) {
+    runengine();
+  }
+  limitstop();
+}
+
+
+/*
+** Asynchronous output
+**
+** With --output=async stdout becomes a stream that copies what is
+** printed into outring, and a writer thread takes it out again and
+** writes it to the real standard output in large writes. A slow
+** terminal or pipe then only holds the program up once the ring is
+** full. The interpreter owns outtail and the writer owns outhead, so
+** bytes move without a lock; outlock is only taken to sleep when one
+** side has to wait for the other. outflush() empties the ring before
+** input is read, and outstop() at exit.
+**
+** A write that would block is waited out with poll(). One that fails
+** outright leaves its errno in outerror and the rest of the output is
+** dropped, so that the program is not held up for ever; outflush() and
+** outstop() then say so, and fltiny exits with OUTSTATUS.
+*/
+
+#define OUTRINGSIZE (1L << 20)     /* bytes in the ring, a power of 2   */
+#define OUTBUFSIZE  65536          /* stdio buffer in front of the ring */
+
+char *outring;                     /* NULL unless --output=async        */
+unsigned long outhead;             /* bytes the writer has written      */
+unsigned long outtail;             /* bytes put into the ring           */
+int outsleeping;                   /* writer waiting for bytes          */
+int outwaiting;                    /* interpreter waiting for room      */
+int outstopping;                   /* writer to finish when empty       */
+int outerror;                      /* errno of a write that failed      */
+int outreported;                   /* ... and it has been said          */
+pthread_mutex_t outlock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t outwake = PTHREAD_COND_INITIALIZER; /* for the writer    */
+pthread_cond_t outroom = PTHREAD_COND_INITIALIZER; /* for the program   */
+pthread_t outthread;
+
+
+/*
+** outwriter
+**
+** The writer thread. Writes whatever is in the ring, as much as runs
+** to the end of it at a time, and sleeps when it is empty.
+*/
+
+void *outwriter(void *arg) {
+
+  unsigned long head, tail, n, at;
+  ssize_t done;
+  int stop;
+  struct pollfd pfd;
+
+  (void) arg;
+  for (;;) {
+    head = outhead;
+    tail = __atomic_load_n(&outtail, __ATOMIC_SEQ_CST);
+
+    if (head == tail) {
+      pthread_mutex_lock(&outlock);
+      __atomic_store_n(&outsleeping, TRUE, __ATOMIC_SEQ_CST);
+      while (__atomic_load_n(&outtail, __ATOMIC_SEQ_CST) == head
+	     && ! outstopping) {
+	pthread_cond_wait(&outwake, &outlock);
+      }
+      __atomic_store_n(&outsleeping, FALSE, __ATOMIC_SEQ_CST);
+      stop = outstopping && outtail == head;
+      pthread_mutex_unlock(&outlock);
+      if (stop) {
+	return NULL;
+      }
+      continue;
+    }
+
+    at = head & (OUTRINGSIZE - 1);
+    n = tail - head;
+    if (n > OUTRINGSIZE - at) {
+      n = OUTRINGSIZE - at;
+    }
+    if (__atomic_load_n(&outerror, __ATOMIC_SEQ_CST) != 0) {
+      /* lost already, see outflush() */
+      done = n;
+    } else {
+      done = write(STDOUT_FILENO, outring + at, n);
+      if (done < 0 && errno == EINTR) {
+	continue;
+      }
+      if (done < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+	pfd.fd = STDOUT_FILENO;
+	pfd.events = POLLOUT;
+	poll(&pfd, 1, -1);
+	continue;
+      }
+      if (done <= 0) {
+	__atomic_store_n(&outerror, done < 0 ? errno : EIO, __ATOMIC_SEQ_CST);
+	done = n;
+      }
+    }
+
+    __atomic_store_n(&outhead, head + done, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&outwaiting, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&outlock);
+      pthread_cond_signal(&outroom);
+      pthread_mutex_unlock(&outlock);
+    }
+  }
+}
+
+
+/*
+** outwait
+**
+** Wait until the ring has room for at least room bytes. OUTRINGSIZE
+** waits for it to be empty, every byte written.
+*/
+
+void outwait(unsigned long room) {
+
+  pthread_mutex_lock(&outlock);
+  __atomic_store_n(&outwaiting, TRUE, __ATOMIC_SEQ_CST);
+  while (OUTRINGSIZE - (outtail - __atomic_load_n(&outhead, __ATOMIC_SEQ_CST))
+	 < room) {
+    pthread_cond_wait(&outroom, &outlock);
+  }
+  __atomic_store_n(&outwaiting, FALSE, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&outlock);
+}
+
+
+/*
+** outwrite
+**
+** Write function of the stdout stream, called when its buffer fills
+** or is flushed. Copies into the ring, waiting for room if it is full.
+*/
+
+ssize_t outwrite(void *cookie, const char *buf, size_t size) {
+
+  unsigned long tail, n, at;
+  size_t done;
+
+  (void) cookie;
+  for (done = 0; done < size; done += n) {
+    tail = outtail;
+    n = OUTRINGSIZE - (tail - __atomic_load_n(&outhead, __ATOMIC_SEQ_CST));
+    if (n == 0) {
+      outwait(1);
+      continue;
+    }
+
+    at = tail & (OUTRINGSIZE - 1);
+    if (n > OUTRINGSIZE - at) {
+      n = OUTRINGSIZE - at;
+    }
+    if (n > size - done) {
+      n = size - done;
+    }
+    memcpy(outring + at, buf + done, n);
+
+    __atomic_store_n(&outtail, tail + n, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&outsleeping, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&outlock);
+      pthread_cond_signal(&outwake);
+      pthread_mutex_unlock(&outlock);
+    }
+  }
+  return size;
+}
+
+
+/*
+** outstart
+**
+** Switch stdout over to the ring and start the writer.
+*/
+
+void outstart(void) {
+
+  cookie_io_functions_t io;
+
+  fflush(stdout);
+  outring = malloc(OUTRINGSIZE);
+  if (outring == NULL
+      || pthread_create(&outthread, NULL, outwriter, NULL) != 0) {
+    /* stay as we are */
+    free(outring);
+    outring = NULL;
+    return;
+  }
+
+  memset(&io, 0, sizeof(io));
+  io.write = outwrite;
+  stdout = fopencookie(NULL, "w", io);
+  setvbuf(stdout, NULL, _IOFBF, OUTBUFSIZE);
+  atexit(outstop);
+}
+
+
+/*
+** outfailed
+**
+** If the writer lost output, say so once. Returns TRUE if it did.
+*/
+
+int outfailed(void) {
+
+  int err;
+
+  err = __atomic_load_n(&outerror, __ATOMIC_SEQ_CST);
+  if (err != 0 && ! outreported) {
+    fprintf(stderr, "Tiny -- output lost: %s\n", strerror(err));
+    outreported = TRUE;
+  }
+  return err != 0;
+}
+
+
+/*
+** outflush
+**
+** Get everything printed so far out to the real standard output.
+*/
+
+void outflush(void) {
+
+  if (outring != NULL) {
+    fflush(stdout);
+    outwait(OUTRINGSIZE);
+    if (outfailed()) {
+      exitstatus = OUTSTATUS;
+    }
+  }
+}
+
+
+/*
+** outstop
+**
+** At exit: empty the ring and let the writer finish.
+*/
+
+void outstop(void) {
+
+  fflush(stdout);
+  pthread_mutex_lock(&outlock);
+  outstopping = TRUE;
+  pthread_cond_signal(&outwake);
+  pthread_mutex_unlock(&outlock);
+  pthread_join(outthread, NULL);
+  if (outfailed()) {
+    _exit(OUTSTATUS);
+  }
+}
+
+
+/*
+** Sampling
+**
+** --sample file keeps a profile of where a run spends its time and
+** writes it to file when the run ends, as collapsed stacks, one line
+** for each stack seen with its weight, as flame graph tools take:
+**
+**    110;200;230 41
+**
+** A SIGPROF timer ticks SAMPLEHZ times a second of CPU time, and the
+** handler only sets sampledue. The engines look at it between lines
+** and call sample() for the line that was running. That costs one
+** test a line and one hash lookup a tick, so a profile can always be
+** kept. The stack is the $ stack read as return lines, for each one
+** the line before it, the one that pushed it, and then the line
+** itself; entries that are not line numbers are left out.
+**
+** With --sample-event= cycles, cache-misses or branch-misses a
+** hardware counter from perf_event_open() is read at each tick, and
+** the stack weighed by how far it has gone since the tick before,
+** rather than by 1.
+*/
+
+#define SAMPLEHZ 1000              /* ticks a second of CPU time        */
+#define SAMPLETABLE 4096           /* stacks kept, a power of 2         */
+
+typedef struct stacksample {
+  int    depth;
+  double *frames;                  /* line numbers, outermost first     */
+  long long weight;
+  struct stacksample *next;        /* in the same hash chain            */
+} STACKSAMPLE;
+
+int samplefd = -1;                 /* the counter, -1 if none           */
+long long samplelast;              /* ... as it was at the last tick    */
+STACKSAMPLE *samples[SAMPLETABLE];
+
+int samplecounters[] = { 0, PERF_COUNT_HW_CPU_CYCLES,
+			 PERF_COUNT_HW_CACHE_MISSES,
+			 PERF_COUNT_HW_BRANCH_MISSES };
+
+
+void sampletick(int sig) {
+
+  (void) sig;
+  sampledue = TRUE;
+}
+
+
+/*
+** samplestart
+**
+** Start the timer, and the counter if one was asked for, for a run.
+*/
+
+void samplestart(void) {
+
+  struct perf_event_attr attr;
+  struct sigaction sa;
+  struct itimerval tv;
+
+  if (samplepath == NULL) {
+    return;
+  }
+
+  if (sampleevent > 0 && samplefd < 0) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = samplecounters[sampleevent];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    samplefd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (samplefd < 0) {
+      printf("Tiny -- no %s counter, sampling time\n",
+	     sampleevents[sampleevent]);
+      sampleevent = 0;
+    }
+  }
+  if (samplefd >= 0 && read(samplefd, &samplelast, sizeof(samplelast))
+      != sizeof(samplelast)) {
+    samplelast = 0;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sampletick;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPROF, &sa, NULL);
+
+  tv.it_interval.tv_sec = 0;
+  tv.it_interval.tv_usec = 1000000 / SAMPLEHZ;
+  tv.it_value = tv.it_interval;
+  setitimer(ITIMER_PROF, &tv, NULL);
+}
+
+
+/*
+** stackframes
+**
+** The stack of the line at step, outermost first, into frames: the
+** line before each return line on the $ stack and then the line
+** itself. Returns how many there are, STACKLIMIT + 1 at most.
+*/
+
+int stackframes(int step, double frames[]) {
+
+  int depth, i, at;
+
+  depth = 0;
+  for (i = 0; i < ustackindex && i < STACKLIMIT; i++) {
+    at = findstep(ustack[i]);
+    if (at > 0 && at < laststep) {
+      frames[depth++] = linos[at - 1];
+    }
+  }
+  frames[depth++] = linos[step];
+  return depth;
+}
+
+
+/*
+** sample
+**
+** Add the stack of the line at step to the profile.
+*/
+
+void sample(int step) {
+
+  double frames[STACKLIMIT + 1];
+  STACKSAMPLE *s;
+  unsigned long hash;
+  long long now, weight;
+  int depth;
+
+  sampledue = FALSE;
+
+  weight = 1;
+  if (samplefd >= 0 && read(samplefd, &now, sizeof(now)) == sizeof(now)) {
+    weight = now - samplelast;
+    samplelast = now;
+  }
+
+  depth = stackframes(step, frames);
+  hash = hashtext((char *) frames, depth * sizeof(double));
+  for (s = samples[hash & (SAMPLETABLE - 1)]; s != NULL; s = s->next) {
+    if (s->depth == depth
+	&& memcmp(s->frames, frames, depth * sizeof(double)) == 0) {
+      s->weight += weight;
+      return;
+    }
+  }
+
+  s = malloc(sizeof(STACKSAMPLE));
+  s->depth = depth;
+  s->frames = malloc(depth * sizeof(double));
+  memcpy(s->frames, frames, depth * sizeof(double));
+  s->weight = weight;
+  s->next = samples[hash & (SAMPLETABLE - 1)];
+  samples[hash & (SAMPLETABLE - 1)] = s;
+}
+
+
+/*
+** samplestop
+**
+** Stop the timer and write the profile of the run to --sample's file,
+** leaving the profile empty for the next run.
+*/
+
+void samplestop(void) {
+
+  struct itimerval tv;
+  STACKSAMPLE *s, *next;
+  FILE *fp;
+  int h, i;
+
+  if (samplepath == NULL) {
+    return;
+  }
+
+  memset(&tv, 0, sizeof(tv));
+  setitimer(ITIMER_PROF, &tv, NULL);
+  sampledue = FALSE;
+
+  fp = fopen(samplepath, "w");
+  if (fp == NULL) {
+    printf("Tiny -- can't write %s\n", samplepath);
+  }
+  for (h = 0; h < SAMPLETABLE; h++) {
+    for (s = samples[h]; s != NULL; s = next) {
+      next = s->next;
+      if (fp != NULL) {
+	for (i = 0; i < s->depth; i++) {
+	  fprintf(fp, "%s%g", i > 0 ? ";" : "", s->frames[i]);
+	}
+	fprintf(fp, " %lld\n", s->weight);
+      }
+      free(s->frames);
+      free(s);
+    }
+    samples[h] = NULL;
+  }
+  if (fp != NULL) {
+    fclose(fp);
+  }
+}
+
+
+/*
+** Limits
+**
+** --max-lines, --max-time and --max-output stop a run that has run so
+** many lines, gone on for so many seconds or printed so many bytes.
+** The engines count limitleft down a line at a time and only call
+** limitcheck() when it runs out, LIMITCHUNK lines at most, so that a
+** limit costs one decrement a line and the clock is seldom read. The
+** output is counted by a stream put in front of stdout for the run,
+** which drops what goes over and runs limitleft out at once.
+**
+** A run that is stopped says which limit and where, the way --sample
+** writes a stack, and exits with LIMITSTATUS. Under --serve the time
+** a job spent stopped for others to take their turn is not counted.
+*/
+
+long limitarmed;                   /* limitleft as it was last set      */
+long limitran;                     /* lines run before that             */
+struct timespec limitbegan;        /* when the run started              */
+long limitprinted;                 /* bytes printed in the run          */
+int limitover;                     /* --max-output went over            */
+FILE *limitout;                    /* stdout behind the counting stream */
+volatile long long *limitpaused;   /* ns a --serve job has been stopped */
+long long limitpausebase;          /* ... as it was at the start        */
+
+
+/*
+** limitarm
+**
+** Set limitleft to the lines until the next check.
+*/
+
+static void limitarm(void) {
+
+  if (limitlines <= 0 && limittime <= 0 && limitoutput <= 0) {
+    limitarmed = LONG_MAX;
+  } else if (limitlines > 0 && limitlines - limitran < LIMITCHUNK) {
+    limitarmed = limitlines - limitran;
+  } else {
+    limitarmed = LIMITCHUNK;
+  }
+  limitleft = limitarmed;
+}
+
+
+/*
+** limitwrite
+**
+** Write function of the counting stream.
+*/
+
+ssize_t limitwrite(void *cookie, const char *buf, size_t size) {
+
+  size_t n;
+
+  (void) cookie;
+  n = size;
+  if (limitprinted + (long) size > limitoutput) {
+    n = limitoutput - limitprinted;
+    limitover = TRUE;
+    limitran += limitarmed - limitleft;
+    limitarmed = 0;
+    limitleft = 0;
+  }
+  fwrite(buf, 1, n, limitout);
+  limitprinted += n;
+  return size;
+}
+
+
+/*
+** limitstart
+**
+** Start the count for a run.
+*/
+
+void limitstart(void) {
+
+  cookie_io_functions_t io;
+
+  limitran = 0;
+  limitprinted = 0;
+  limitover = FALSE;
+  clock_gettime(CLOCK_MONOTONIC, &limitbegan);
+  if (limitpaused != NULL) {
+    limitpausebase = *limitpaused;
+  }
+  limitarm();
+
+  if (limitoutput > 0 && limitout == NULL) {
+    fflush(stdout);
+    limitout = stdout;
+    memset(&io, 0, sizeof(io));
+    io.write = limitwrite;
+    stdout = fopencookie(NULL, "w", io);
+    setvbuf(stdout, NULL, _IONBF, 0);
+  }
+}
+
+
+/*
+** limitcheck
+**
+** Called by the engines when limitleft runs out, after the line at
+** step. Stops the run if it is over a limit, else sets limitleft for
+** the next check. Returns TRUE if the run was stopped.
+*/
+
+int limitcheck(int step) {
+
+  double frames[STACKLIMIT + 1];
+  struct timespec now;
+  double seconds;
+  char *over;
+  FILE *fp;
+  int depth, i;
+
+  limitran += limitarmed - limitleft;
+  over = NULL;
+  if (limitlines > 0 && limitran >= limitlines) {
+    over = "--max-lines";
+  }
+  if (limittime > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = (now.tv_sec - limitbegan.tv_sec)
+              + (now.tv_nsec - limitbegan.tv_nsec) / 1e9;
+    if (limitpaused != NULL) {
+      seconds -= (*limitpaused - limitpausebase) / 1e9;
+    }
+    if (seconds >= limittime) {
+      over = "--max-time";
+    }
+  }
+  if (limitover) {
+    over = "--max-output";
+  }
+  if (replaywent != NULL) {
+    over = "--replay";
+  }
+  if (over == NULL) {
+    limitarm();
+    return FALSE;
+  }
+
+  /* past the counting stream, which may be full */
+  fp = stdout;
+  if (limitout != NULL) {
+    fflush(stdout);
+    fp = limitout;
+  }
+  if (replaywent != NULL) {
+    replaysay(fp);
+  }
+  fprintf(fp, "Tiny -- %lf stopped by %s after %ld lines in ", exlino, over,
+	  limitran);
+  depth = stackframes(step, frames);
+  for (i = 0; i < depth; i++) {
+    fprintf(fp, "%s%g", i > 0 ? ";" : "", frames[i]);
+  }
+  fprintf(fp, "\n");
+
+  running = FALSE;
+  exitstatus = LIMITSTATUS;
+  limitarmed = LONG_MAX;
+  limitleft = LONG_MAX;
+  return TRUE;
+}
+
+
+/*
+** limitstop
+**
+** At the end of a run, take the counting stream away again.
+*/
+
+void limitstop(void) {
+
+  if (limitout != NULL) {
+    fclose(stdout);
+    stdout = limitout;
+    limitout = NULL;
+  }
+}
+
+
+/*
+** Recording and replaying
+**
+** --record writes every number '?' reads, and every seed '~' is given,
+** to a file, and --replay reads them back from one in place of stdin
+** and the clock, so that a run can be repeated exactly. The file is
+** RECORDMAGIC and then, for each, a kind byte and a double in the byte
+** order of the machine: '?' a number read, '~' a seed given, and '0' a
+** seed taken from the clock as ~ was given 0.
+**
+** A replay reads the whole file before the run and hands the records
+** out in turn. A run that asks for something other than the next
+** record, gives ~ another seed than the one recorded, or asks for more
+** than there is, has gone another way than the recording did: the
+** replay stops it the way a limit does, see limitcheck(). A run that
+** ends with records left over has too.
+*/
+
+char *replaykinds;                 /* kind of each record replayed      */
+double *replayvalues;              /* ... and its number                */
+long replaycount;                  /* records there are                 */
+long replaynext;                   /* record to hand out next           */
+
+
+/*
+** recordopen
+**
+** --record path: start the file. Returns FALSE if it can't be written.
+*/
+
+int recordopen(char path[]) {
+
+  recordfp = fopen(path, "wb");
+  if (recordfp == NULL) {
+    printf("Tiny -- can't write record [%s]\n", path);
+    return FALSE;
+  }
+  fputs(RECORDMAGIC, recordfp);
+  return TRUE;
+}
+
+
+/*
+** replayload
+**
+** --replay path: read all of the file. Returns FALSE if it can't be
+** read or is not a record.
+*/
+
+int replayload(char path[]) {
+
+  FILE *fp;
+  char magic[sizeof(RECORDMAGIC)];
+  long size;
+  int kind;
+  double value;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) {
+    printf("Tiny -- can't open record [%s]\n", path);
+    return FALSE;
+  }
+  if (fread(magic, 1, strlen(RECORDMAGIC), fp) != strlen(RECORDMAGIC)
+      || memcmp(magic, RECORDMAGIC, strlen(RECORDMAGIC)) != 0) {
+    printf("Tiny -- [%s] is not a record\n", path);
+    fclose(fp);
+    return FALSE;
+  }
+
+  size = 64;
+  replaykinds = malloc(size);
+  replayvalues = malloc(size * sizeof(double));
+  replaycount = 0;
+  while ((kind = getc(fp)) != EOF
+	 && fread(&value, sizeof(value), 1, fp) == 1) {
+    if (replaycount == size) {
+      size = size * 2;
+      replaykinds = realloc(replaykinds, size);
+      replayvalues = realloc(replayvalues, size * sizeof(double));
+    }
+    replaykinds[replaycount] = (char) kind;
+    replayvalues[replaycount] = value;
+    replaycount++;
+  }
+  fclose(fp);
+  replaynext = 0;
+  replaywent = NULL;
+  replaying = TRUE;
+  return TRUE;
+}
+
+
+/*
+** recordwrite
+**
+** Add a record to the --record file.
+*/
+
+void recordwrite(int kind, double value) {
+
+  putc(kind, recordfp);
+  fwrite(&value, sizeof(value), 1, recordfp);
+}
+
+
+/*
+** replaytake
+**
+** Hand out the next record, if it is of kind, into *value. Else the
+** run has gone another way: say how, have the engines stop the run at
+** the end of the line, and return FALSE.
+*/
+
+static int replaytake(int kind, double *value) {
+
+  if (replaywent != NULL) {
+    return FALSE;
+  }
+  if (replaynext < replaycount && replaykinds[replaynext] == kind) {
+    *value = replayvalues[replaynext++];
+    return TRUE;
+  }
+  if (replaynext == replaycount) {
+    replaywent = "asked for more than was recorded";
+  } else if (kind == '?') {
+    replaywent = "read a number where the recording seeded ~";
+  } else if (replaykinds[replaynext] == '?') {
+    replaywent = "seeded ~ where the recording read a number";
+  } else {
+    replaywent = "seeded ~ with another number than the recording";
+  }
+  limitran += limitarmed - limitleft;
+  limitarmed = 0;
+  limitleft = 0;
+  return FALSE;
+}
+
+
+/*
+** replayinput
+**
+** The number '?' reads under --replay.
+*/
+
+double replayinput(void) {
+
+  double value;
+
+  if ( ! replaytake('?', &value)) {
+    return 0;
+  }
+  return value;
+}
+
+
+/*
+** seedvalue
+**
+** The seed for '~' given x: x itself, or one from the clock for 0.
+** Both are recorded or replayed.
+*/
+
+double seedvalue(double x) {
+
+  double value;
+
+  if (replaying) {
+    if ( ! replaytake(x == 0 ? '0' : '~', &value)) {
+      return x == 0 ? fmod((double) time(NULL) * M_E + M_PI, 1.0) : x;
+    }
+    if (x != 0 && value != x) {
+      replaywent = "seeded ~ with another number than the recording";
+      limitran += limitarmed - limitleft;
+      limitarmed = 0;
+      limitleft = 0;
+      return x;
+    }
+    return value;
+  }
+
+  value = x == 0 ? fmod((double) time(NULL) * M_E + M_PI, 1.0) : x;
+  if (recordfp != NULL) {
+    recordwrite(x == 0 ? '0' : '~', value);
+  }
+  return value;
+}
+
+
+/*
+** replaysay
+**
+** Say to fp how the replay went another way.
+*/
+
+void replaysay(FILE *fp) {
+
+  fprintf(fp, "Tiny -- replay stopped after %ld of %ld records: the run %s\n",
+	  replaynext, replaycount, replaywent);
+}
+
+
+/*
+** recordstop
+**
+** At the end of a run from the command line, finish the --record file,
+** and stop a --replay that has records left over or went another way
+** too late in the run to be stopped.
+*/
+
+void recordstop(void) {
+
+  if (recordfp != NULL) {
+    fclose(recordfp);
+    recordfp = NULL;
+  }
+  if ( ! replaying || exitstatus == LIMITSTATUS) {
+    return;
+  }
+  if (replaywent == NULL && replaynext < replaycount) {
+    replaywent = "ended with records left over";
+  }
+  if (replaywent != NULL) {
+    outflush();
+    replaysay(stdout);
+    exitstatus = LIMITSTATUS;
+  }
+}
+
+
+void saveprogram(char filename[]) {
+
+  FILE *fp;
+  long i;
+
+  /* Set listing format */
+  formatlisting();
+
+  fp = fopen(filename,"w");
+  for (i = 0; i < laststep; i++) {
+    fprintf(fp,listformat,linos[i],linetext(i));
+  }
+  fclose(fp);
+}
+
+/*
+** Server mode
+**
+** fltiny --serve /path/sock  listens on a Unix domain socket and runs
+** programs for clients. A pool of worker processes is forked up front;
+** each accepts one connection at a time, runs the request with its
+** own copy of the interpreter and answers. Each worker keeps the
+** programs it has loaded in a small LRU cache keyed by a hash of the
+** program text, so a program that is run again is not parsed or
+** compiled again.
+**
+** A request is header lines, optionally followed by program text:
+**
+**     program /path/to/file.flt       run this file
+**     input 3 4.5                     numbers for '?', one per line
+**     var a 1.5                       preset a variable
+**     text                            the rest is the program text
+**
+** The client half closes the connection after the request. The answer
+** is
+**
+**     output <bytes>
+**     <what the program printed>
+**     var a <value>   ...   var z <value>
+**     status <exit status>
+**     end
+**
+** A request whose first line is resumable is ended by a line run
+** instead, and its program stops at a '?' that the input lines have
+** not answered. The answer is then the output so far and a line
+** input, and the client sends a line of numbers to carry on with:
+**
+**     output <bytes>                  input 7
+**     <what the program printed>
+**     input
+**
+** until the program ends and the usual answer is sent. Meanwhile the
+** run is kept as a session on the worker, which runs other requests,
+** and each worker waits on its listening socket and all its sessions
+** at once with epoll. Connections are read without blocking, into a
+** buffer for each, and a request is only run once all of it has come
+** in, a session only carried on once a whole input line has.
+**
+** stdin and stdout are swapped for memory streams while a request
+** runs, which glibc allows.
+*/
+
+/* A connection whose request is coming in, or once entry is set a
+   run waiting for input, with all the state sessionout() keeps */
+typedef struct session {
+  int fd;                          /* connection the input comes on     */
+  char *in;                        /* what has come in and is not used  */
+  long inlen;                      /* ... NUL terminated                */
+  long insize;
+  int closed;                      /* the client has sent all it will   */
+  PROGCACHE *entry;                /* its program, held in the cache    */
+  TASK regs;                       /* stacks and registers, kept as a   */
+                                   /* task's are between turns          */
+  double varz[VARCOUNT];
+  double **pages;                  /* the array up to the last element  */
+  long arraykept;                  /* ... that is not 0, SESSIONPAGE at */
+                                   /* a time, NULL for a page all 0     */
+  HASHSLOT *hashslots;             /* the hash table                    */
+  long hashsize;
+  long hashcount;
+  VIEW views[26];
+  char numberformat[20];
+  double seed;                     /* pipirandseed                      */
+  int exitstatus;
+  CODENODE code;                   /* where it carries on, see          */
+  char *chars;                     /* ... suspendline() and             */
+  int at;                          /* ... suspendtext()                 */
+  struct session *next;            /* in the pool, once it has ended    */
+} SESSION;
+
+SESSION *sessionpool;              /* ended sessions, for new ones      */
+int nsessionpool;
+
+PROGCACHE progcache[CACHESIZE];    /* programs this worker has loaded   */
+long cacheclock;                   /* use counter for LRU replacement   */
+
+
+/*
+** hashtext
+**
+** FNV-1a hash of program text.
+*/
+
+unsigned long hashtext(char text[], long len) {
+
+  unsigned long hash;
+  long i;
+
+  hash = 2166136261UL;
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char) text[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+
+/*
+** saveprog / useprog
+**
+** Move the program memory globals into a PROGNODE, or make a PROGNODE
+** the current program.
+*/
+
+void saveprog(PROGNODE *prog) {
+
+  prog->linos        = linos;
+  prog->lineflags    = lineflags;
+  prog->textoff      = textoff;
+  prog->linecode     = linecode;
+  prog->stepsize     = stepsize;
+  prog->laststep     = laststep;
+  prog->textarena    = textarena;
+  prog->arenaused    = arenaused;
+  prog->arenasize    = arenasize;
+  prog->arenagarbage = arenagarbage;
+}
+
+
+void useprog(PROGNODE *prog) {
+
+  linos        = prog->linos;
+  lineflags    = prog->lineflags;
+  textoff      = prog->textoff;
+  linecode     = prog->linecode;
+  stepsize     = prog->stepsize;
+  laststep     = prog->laststep;
+  textarena    = prog->textarena;
+  arenaused    = prog->arenaused;
+  arenasize    = prog->arenasize;
+  arenagarbage = prog->arenagarbage;
+}
+
+
+void freeprog(PROGNODE *prog) {
+
+  int i;
+
+  for (i = 0; i < prog->laststep; i++) {
+    freecode(prog->linecode[i]);
+  }
+  free(prog->linos);
+  free(prog->lineflags);
+  free(prog->textoff);
+  free(prog->linecode);
+  free(prog->textarena);
+}
+
+
+/*
+** cacheprogram
+**
+** Make the program with this text current, from the cache if it is
+** there, otherwise by loading it into the least recently used slot
+** that no session is waiting in. If sessions wait in every slot it
+** is loaded outside the cache, see cacherelease(). Returns the slot.
+*/
+
+PROGCACHE *cacheprogram(char text[], long len) {
+
+  unsigned long hash;
+  PROGCACHE *entry, *oldest;
+  FILE *fp;
+  int i;
+
+  hash = hashtext(text, len);
+  oldest = NULL;
+  for (i = 0; i < CACHESIZE; i++) {
+    entry = &progcache[i];
+    if (entry->text != NULL && entry->hash == hash && entry->len == len
+	&& memcmp(entry->text, text, len) == 0) {
+      entry->lastuse = ++cacheclock;
+      useprog(&entry->prog);
+      return entry;
+    }
+    if (entry->held == 0
+	&& (oldest == NULL || entry->lastuse < oldest->lastuse)) {
+      oldest = entry;
+    }
+  }
+
+  entry = oldest;
+  if (entry == NULL) {
+    entry = calloc(1, sizeof(PROGCACHE));
+  } else if (entry->text != NULL) {
+    freeprog(&entry->prog);
+    free(entry->text);
+  }
+
+  /* a fresh program memory, setup() allocates it */
+  textarena = NULL;
+  linos = NULL;
+  lineflags = NULL;
+  textoff = NULL;
+  linecode = NULL;
+  stepsize = 0;
+  laststep = 0;
+  setup();
+
+  fp = fmemopen(text, len, "r");
+  if (fp != NULL) {
+    loadstream(fp);
+    fclose(fp);
+  }
+
+  saveprog(&entry->prog);
+  entry->text = malloc(len);
+  memcpy(entry->text, text, len);
+  entry->len = len;
+  entry->hash = hash;
+  entry->lastuse = ++cacheclock;
+  return entry;
+}
+
+
+/*
+** cacherelease
+**
+** A run is done with its program. One loaded outside the cache goes
+** when no session is left waiting in it.
+*/
+
+void cacherelease(PROGCACHE *entry) {
+
+  if (entry->held == 0
+      && (entry < progcache || entry >= progcache + CACHESIZE)) {
+    freeprog(&entry->prog);
+    free(entry->text);
+    free(entry);
+  }
+}
+
+
+/*
+** readall
+**
+** Read everything from a file descriptor until end of file. The
+** buffer is malloc'd and NUL terminated.
+*/
+
+char *readall(int fd, long *len) {
+
+  char *buf;
+  long size, got;
+  ssize_t n;
+
+  size = 4096;
+  got = 0;
+  buf = malloc(size);
+  while ((n = read(fd, buf + got, size - got - 1)) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      break;
+    }
+    got += n;
+    if (got + 1 == size) {
+      size = size * 2;
+      buf = realloc(buf, size);
+    }
+  }
+  buf[got] = '\0';
+  *len = got;
+  return buf;
+}
+
+
+int writeall(int fd, char buf[], long len) {
+
+  struct pollfd pfd;
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+	/* a connection, which is not blocking */
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	poll(&pfd, 1, -1);
+	continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+
+/*
+** sessionread
+**
+** Add what has come in on a session's connection to its buffer,
+** without waiting for more, and note when the client has closed its
+** end. Returns FALSE if the connection failed.
+*/
+
+int sessionread(SESSION *s) {
+
+  ssize_t n;
+
+  for (;;) {
+    if (s->inlen + 1 >= s->insize) {
+      s->insize = s->insize == 0 ? 4096 : s->insize * 2;
+      s->in = realloc(s->in, s->insize);
+    }
+    n = read(s->fd, s->in + s->inlen, s->insize - s->inlen - 1);
+    if (n > 0) {
+      s->inlen += n;
+      continue;
+    }
+    s->in[s->inlen] = '\0';
+    if (n == 0) {
+      s->closed = TRUE;
+      return TRUE;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+}
+
+
+/*
+** sessiontake
+**
+** Take the first n bytes of a session's buffer, malloc'd and NUL
+** terminated.
+*/
+
+char *sessiontake(SESSION *s, long n) {
+
+  char *taken;
+
+  taken = malloc(n + 1);
+  memcpy(taken, s->in, n);
+  taken[n] = '\0';
+  s->inlen -= n;
+  memmove(s->in, s->in + n, s->inlen + 1);
+  return taken;
+}
+
+
+/*
+** requestend
+**
+** The length of the request in a session's buffer, or -1 if it has
+** not all come in. A request runs to end of file, or for a resumable
+** one up to the line run that ends it.
+*/
+
+long requestend(SESSION *s) {
+
+  char *run;
+
+  if (s->inlen >= 10 && strncmp(s->in, "resumable\n", 10) == 0) {
+    run = strstr(s->in + 9, "\nrun\n");
+    if (run != NULL) {
+      return run + 5 - s->in;
+    }
+  }
+  return s->closed ? s->inlen : -1;
+}
+
+
+/*
+** sessionpages
+**
+** Free the array a session kept.
+*/
+
+void sessionpages(SESSION *s) {
+
+  long p;
+
+  if (s->pages != NULL) {
+    for (p = 0; p * SESSIONPAGE < s->arraykept; p++) {
+      free(s->pages[p]);
+    }
+    free(s->pages);
+    s->pages = NULL;
+  }
+  s->arraykept = 0;
+}
+
+
+/*
+** sessionout / sessionin
+**
+** Move a suspended run's state out of the globals into a session, and
+** back into them to carry it on. The array and the hash table move
+** with it, so the next request starts with them empty. Only the
+** pages of the array that are not all 0 are kept, so that an idle
+** session costs what its run has written.
+*/
+
+void sessionout(SESSION *s) {
+
+  long n, i, p, len;
+
+  s->regs.compstackindex = compstackindex;
+  s->regs.ustackindex = ustackindex;
+  s->regs.exlino = exlino;
+  s->regs.thenumber = thenumber;
+  s->regs.putget = putget;
+  s->regs.indirect = indirect;
+  s->regs.numbuild = numbuild;
+  s->regs.StringPrint = StringPrint;
+  s->regs.gatherformat = gatherformat;
+  strcpy(s->regs.numstring, numstring);
+  memcpy(s->regs.stackspace, stackspace, sizeof(s->regs.stackspace));
+  memcpy(s->regs.ustack, ustack, sizeof(s->regs.ustack));
+  memcpy(s->varz, varz, sizeof(varz));
+
+  for (n = arrayelements; n > 0; n--) {
+    if (darray[n - 1] != 0 || signbit(darray[n - 1])) {
+      break;
+    }
+  }
+  s->arraykept = n;
+  s->pages = malloc(((n + SESSIONPAGE - 1) / SESSIONPAGE) * sizeof(double *)
+		    + 1);
+  for (p = 0; p * SESSIONPAGE < n; p++) {
+    len = n - p * SESSIONPAGE;
+    if (len > SESSIONPAGE) {
+      len = SESSIONPAGE;
+    }
+    s->pages[p] = NULL;
+    for (i = 0; i < len; i++) {
+      if (darray[p * SESSIONPAGE + i] != 0
+	  || signbit(darray[p * SESSIONPAGE + i])) {
+	s->pages[p] = malloc(len * sizeof(double));
+	memcpy(s->pages[p], darray + p * SESSIONPAGE, len * sizeof(double));
+	break;
+      }
+    }
+  }
+
+  s->hashslots = hashslots;
+  s->hashsize = hashsize;
+  s->hashcount = hashcount;
+  hashslots = NULL;
+  hashclear();
+
+  memcpy(s->views, views, sizeof(views));
+  strcpy(s->numberformat, numberformat);
+  s->seed = pipirandseed;
+  s->exitstatus = exitstatus;
+  s->code = suspendcode;
+  s->chars = suspendchars;
+  s->at = suspendat;
+  suspendcode.ops = NULL;
+}
+
+
+void sessionin(SESSION *s) {
+
+  long p, len;
+
+  if (tasking) {
+    taskreset();
+  }
+  useprog(&s->entry->prog);
+
+  compstackindex = s->regs.compstackindex;
+  ustackindex = s->regs.ustackindex;
+  exlino = s->regs.exlino;
+  thenumber = s->regs.thenumber;
+  putget = s->regs.putget;
+  indirect = s->regs.indirect;
+  numbuild = s->regs.numbuild;
+  StringPrint = s->regs.StringPrint;
+  gatherformat = s->regs.gatherformat;
+  strcpy(numstring, s->regs.numstring);
+  memcpy(stackspace, s->regs.stackspace, sizeof(s->regs.stackspace));
+  memcpy(ustack, s->regs.ustack, sizeof(s->regs.ustack));
+  memcpy(varz, s->varz, sizeof(varz));
+
+  arrayclear();
+  for (p = 0; p * SESSIONPAGE < s->arraykept; p++) {
+    len = s->arraykept - p * SESSIONPAGE;
+    if (len > SESSIONPAGE) {
+      len = SESSIONPAGE;
+    }
+    if (s->pages[p] != NULL) {
+      memcpy(darray + p * SESSIONPAGE, s->pages[p], len * sizeof(double));
+    }
+  }
+  sessionpages(s);
+
+  hashclear();
+  hashslots = s->hashslots;
+  hashsize = s->hashsize;
+  hashcount = s->hashcount;
+  s->hashslots = NULL;
+
+  memcpy(views, s->views, sizeof(views));
+  strcpy(numberformat, s->numberformat);
+  pipirandseed = s->seed;
+  exitstatus = s->exitstatus;
+  suspendcode = s->code;
+  suspendchars = s->chars;
+  suspendat = s->at;
+  s->code.ops = NULL;
+}
+
+
+/*
+** sessionnew / sessionfree
+**
+** Start a session for a connection, and forget it, whether it ended or
+** its client went away. Sessions that are forgotten go to a pool, up
+** to SESSIONPOOL of them, and are used again.
+*/
+
+SESSION *sessionnew(int fd) {
+
+  SESSION *s;
+
+  s = sessionpool;
+  if (s == NULL) {
+    s = calloc(1, sizeof(SESSION));
+  } else {
+    sessionpool = s->next;
+    nsessionpool--;
+    memset(s, 0, sizeof(SESSION));
+  }
+  s->fd = fd;
+  return s;
+}
+
+
+void sessionfree(SESSION *s) {
+
+  sessionpages(s);
+  free(s->hashslots);
+  free(s->code.ops);
+  if (s->entry != NULL) {
+    s->entry->held--;
+    cacherelease(s->entry);
+  }
+  free(s->in);
+  if (nsessionpool < SESSIONPOOL) {
+    s->next = sessionpool;
+    sessionpool = s;
+    nsessionpool++;
+  } else {
+    free(s);
+  }
+}
+
+
+/*
+** serverun
+**
+** Run the current program, or with resume carry on the suspended run,
+** with inbuf as its input, and answer on fd. Returns TRUE if the run
+** is waiting for more input.
+*/
+
+int serverun(int fd, char inbuf[], size_t inlen, int resume) {
+
+  char *outbuf;          /* what the program printed                      */
+  size_t outlen;
+  FILE *savein, *saveout;
+  char *answer;
+  size_t anslen;
+  FILE *ansfp;
+  int i;
+
+  /* run with stdin and stdout in memory */
+  savein = stdin;
+  saveout = stdout;
+  stdin = fmemopen(inbuf, inlen, "r");
+  stdout = open_memstream(&outbuf, &outlen);
+
+  if (resume) {
+    resumeprogram(inputnumber());
+  } else {
+    execprogram();
+  }
+
+  fclose(stdout);
+  fclose(stdin);
+  stdin = savein;
+  stdout = saveout;
+
+  /* answer */
+  ansfp = open_memstream(&answer, &anslen);
+  fprintf(ansfp, "output %lu\n", (unsigned long) outlen);
+  fwrite(outbuf, 1, outlen, ansfp);
+  if (suspended) {
+    fprintf(ansfp, "input\n");
+  } else {
+    for (i = 0; i < 26; i++) {
+      fprintf(ansfp, "var %c %.17g\n", 'a' + i, varz[i]);
+    }
+    fprintf(ansfp, "status %d\nend\n", exitstatus);
+  }
+  fclose(ansfp);
+  writeall(fd, answer, anslen);
+
+  free(answer);
+  free(outbuf);
+  return suspended;
+}
+
+
+/*
+** serverequest
+**
+** Run the request that has come in on a session's connection, and
+** answer. Returns TRUE if it is waiting for input.
+*/
+
+int serverequest(SESSION *s, char request[], long reqlen) {
+
+  char *line, *next;     /* header line being read                        */
+  char *progtext;        /* program text                                  */
+  long proglen;
+  int progfile;          /* progtext was read from a file                 */
+  int resumable;         /* it may wait for input                         */
+  char *inbuf;           /* numbers for '?'                               */
+  size_t inlen;
+  FILE *infp;
+  PROGCACHE *entry;
+  double vars[27];       /* variable presets                              */
+  int i, fd2, waiting;
+  double v;
+  char name;
+
+  resumable = strncmp(request, "resumable\n", 10) == 0;
+  progtext = NULL;
+  proglen = 0;
+  progfile = FALSE;
+  infp = open_memstream(&inbuf, &inlen);
+
+  for (i = 0; i < 27; i++) {
+    vars[i] = 0;
+  }
+
+  /* header lines */
+  line = request;
+  while (line < request + reqlen) {
+    next = strchr(line, '\n');
+    if (next == NULL) {
+      next = request + reqlen;
+    } else {
+      *next++ = '\0';
+    }
+
+    if (strncmp(line, "program ", 8) == 0) {
+      fd2 = open(line + 8, O_RDONLY);
+      if (fd2 >= 0) {
+	free(progtext);
+	progtext = readall(fd2, &proglen);
+	progfile = TRUE;
+	close(fd2);
+      }
+    } else if (strncmp(line, "input ", 6) == 0) {
+      for (line = strtok(line + 6, " \t"); line != NULL;
+	   line = strtok(NULL, " \t")) {
+	fprintf(infp, "%s\n", line);
+      }
+    } else if (sscanf(line, "var %c %lf", &name, &v) == 2) {
+      if (name >= 'a' && name <= 'z') {
+	vars[name - 'a'] = v;
+      }
+    } else if (strcmp(line, "text") == 0) {
+      progtext = next;
+      proglen = request + reqlen - next;
+      if (resumable) {
+	proglen -= 4;        /* run */
+      }
+      break;
+    }
+    line = next;
+  }
+  if ( ! resumable) {
+    fputc('\n', infp);
+  }
+  fclose(infp);
+
+  /* a fresh machine with the requested program */
+  entry = cacheprogram(progtext != NULL ? progtext : "", proglen);
+  for (i = 0; i < 27; i++) {
+    varz[i] = vars[i];
+  }
+  arrayclear();
+  hashclear();
+  compstackindex = 0;
+  ustackindex = 0;
+  traceing = FALSE;
+  nowstepping = FALSE;
+  debugging = TRUE;
+  spipi(0);
+  strcpy(numberformat,"%lf");
+
+  inputyield = resumable;
+  waiting = serverun(s->fd, inbuf, inlen, FALSE);
+  if (waiting) {
+    s->entry = entry;
+    entry->held++;
+    sessionout(s);
+  } else {
+    cacherelease(entry);
+  }
+
+  free(inbuf);
+  if (progfile) {
+    free(progtext);
+  }
+  return waiting;
+}
+
+
+/*
+** serveresume
+**
+** Carry a session's run on with the line of input it was waiting for.
+** Returns TRUE if it is waiting again, FALSE if it ended or the line
+** was not input.
+*/
+
+int serveresume(SESSION *s, char line[]) {
+
+  char *p;
+  char *inbuf;
+  size_t inlen;
+  FILE *infp;
+  int waiting;
+
+  if (strncmp(line, "input", 5) != 0) {
+    return FALSE;
+  }
+
+  infp = open_memstream(&inbuf, &inlen);
+  for (p = strtok(line + 5, " \t\n"); p != NULL; p = strtok(NULL, " \t\n")) {
+    fprintf(infp, "%s\n", p);
+  }
+  fclose(infp);
+
+  sessionin(s);
+  inputyield = TRUE;
+  waiting = serverun(s->fd, inbuf, inlen, TRUE);
+  if (waiting) {
+    sessionout(s);
+  }
+  free(inbuf);
+  return waiting;
+}
+
+
+/*
+** serveinput
+**
+** Read what has come in on a connection. Its request is run once all
+** of it is there, and then its session carried on for each whole line
+** of input. Returns FALSE when the connection is done with.
+*/
+
+int serveinput(SESSION *s) {
+
+  char *text, *nl;
+  long len;
+  int ok, waiting;
+
+  ok = sessionread(s);
+  waiting = TRUE;
+  if (s->entry == NULL) {
+    len = requestend(s);
+    if ( ! ok || len < 0) {
+      return ok;
+    }
+    text = sessiontake(s, len);
+    waiting = serverequest(s, text, len);
+    free(text);
+  }
+  while (waiting && (nl = memchr(s->in, '\n', s->inlen)) != NULL) {
+    text = sessiontake(s, nl + 1 - s->in);
+    waiting = serveresume(s, text);
+    free(text);
+  }
+  if (s->inlen == 0) {
+    /* nothing for an idle session to hold on to */
+    free(s->in);
+    s->in = NULL;
+    s->insize = 0;
+  }
+  return waiting && ok && ! s->closed;
+}
+
+
+volatile sig_atomic_t servedone;   /* set by SIGTERM / SIGINT           */
+
+void servestop(int sig) {
+
+  servedone = sig;
+}
+
+
+/*
+** servesignal
+**
+** Stop or continue the job in a slot, and keep the time it was stopped.
+*/
+
+void servesignal(SERVESLOT *slot, int stop, struct timespec *now) {
+
+  if (stop) {
+    kill(slot->pid, SIGSTOP);
+  } else {
+    kill(slot->pid, SIGCONT);
+    slot->paused += (now->tv_sec - slot->since.tv_sec) * 1000000000LL
+                    + (now->tv_nsec - slot->since.tv_nsec);
+  }
+  slot->stopped = stop;
+  slot->since = *now;
+}
+
+
+/*
+** serveoldest
+**
+** The busy job that has been running, or stopped, the longest. NULL
+** if there is none.
+*/
+
+SERVESLOT *serveoldest(SERVESLOT slots[], int n, int stopped) {
+
+  SERVESLOT *best;
+  int i;
+
+  best = NULL;
+  for (i = 0; i < n; i++) {
+    if (slots[i].pid > 0 && slots[i].busy && slots[i].stopped == stopped
+	&& (best == NULL
+	    || slots[i].since.tv_sec < best->since.tv_sec
+	    || (slots[i].since.tv_sec == best->since.tv_sec
+		&& slots[i].since.tv_nsec < best->since.tv_nsec))) {
+      best = &slots[i];
+    }
+  }
+  return best;
+}
+
+
+/*
+** servetick
+**
+** One turn of the scheduler. There are SERVEJOBS processes for each
+** worker, but only as many jobs as workers run at once; the others
+** are SIGSTOPped. A job that has had a turn of SERVESLICE ms gives
+** way to the one that has waited longest, so a long job can't keep
+** the short ones behind it waiting.
+*/
+
+void servetick(SERVESLOT slots[], int n, int workers) {
+
+  struct timespec now;
+  SERVESLOT *run, *wait;
+  long ms;
+  int i, runs;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  runs = 0;
+  for (i = 0; i < n; i++) {
+    if (slots[i].pid > 0 && slots[i].stopped && ! slots[i].busy) {
+      /* stopped just as it finished, let it take the next request */
+      servesignal(&slots[i], FALSE, &now);
+    }
+    if (slots[i].pid > 0 && slots[i].busy && ! slots[i].stopped) {
+      runs++;
+    }
+  }
+
+  for (; runs > workers; runs--) {
+    servesignal(serveoldest(slots, n, FALSE), TRUE, &now);
+  }
+  for (; runs < workers; runs++) {
+    wait = serveoldest(slots, n, TRUE);
+    if (wait == NULL) {
+      break;
+    }
+    servesignal(wait, FALSE, &now);
+  }
+
+  /* turns */
+  for (i = 0; i < workers; i++) {
+    run = serveoldest(slots, n, FALSE);
+    wait = serveoldest(slots, n, TRUE);
+    if (run == NULL || wait == NULL) {
+      break;
+    }
+    ms = (now.tv_sec - run->since.tv_sec) * 1000
+         + (now.tv_nsec - run->since.tv_nsec) / 1000000;
+    if (ms < SERVESLICE) {
+      break;
+    }
+    servesignal(run, TRUE, &now);
+    servesignal(wait, FALSE, &now);
+  }
+}
 
 
-	case ')':
-	  if (putget == GET) {
+/*
+** serveworker
+**
+** A worker's loop. Its epoll set holds the listening socket and the
+** connection of each of its sessions, so it takes a new connection,
+** reads a request or carries on a session, whichever is ready first.
+*/
 
-	    /* 
-	    ** Replace top of stack with array pointed to by top of stack,
-	    ** Lowers Indirect flag
-	    */
-	    indirect = FALSE;
-	    cpush(darray[(long) cpop()]);
-	    
+void serveworker(int lfd, SERVESLOT *slot) {
 
-	  } else { /* put */
+  struct epoll_event ev, ready[SERVEREADY];
+  SESSION *s;
+  int epfd, fd, i, n;
 
-	    /* lower indirect, stores 2nd in array(top), trash top */
-	    indirect = FALSE;
-	    x = cpop();
-	    y = cpop();
-	    darray[(long) x] = y;
-	    cpush(y);
+  limitpaused = &slot->paused;
+  epfd = epoll_create1(0);
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+  ev.data.ptr = NULL;
+  if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev) < 0) {
+    _exit(1);
+  }
 
+  while ((n = epoll_wait(epfd, ready, SERVEREADY, -1)) >= 0
+	 || errno == EINTR) {
+    for (i = 0; i < n; i++) {
+      clock_gettime(CLOCK_MONOTONIC, &slot->since);
+      slot->busy = TRUE;
+      s = ready[i].data.ptr;
+      if (s == NULL) {
+	/* another worker may have taken it */
+	fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK);
+	if (fd >= 0) {
+	  s = sessionnew(fd);
+	  ev.events = EPOLLIN;
+	  ev.data.ptr = s;
+	  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	    close(fd);
+	    sessionfree(s);
 	  }
-	  break;
-
+	}
+      } else if ( ! serveinput(s)) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+	close(s->fd);
+	sessionfree(s);
+      }
+      slot->busy = FALSE;
+    }
+  }
+  _exit(1);
+}
 
-	  /* to be replaced with an int function */
-	  case '%':
-	    x = cpop();
-	    if (x < 0 ) {
-	      cpush(ceil(x));
-	    } else {
-	      cpush(floor(x));
-	    }
-	    break; 
-	  
 
-	case '^': 
-	  x = cpop();
-	  y = cpop();
-	  cpush((double) pow( (double) y, (double) x) );
-	  break;
+/*
+** serve
+**
+** Listen on a Unix socket and keep a pool of workers * SERVEJOBS
+** worker processes, of which servetick() lets workers run at once.
+*/
 
-	case '-': 
-	  x = cpop();
-	  y = cpop();
-	  cpush(y - x); 
-	  break;
+void serve(char path[], int workers) {
+
+  struct sockaddr_un addr;
+  struct sigaction sa;
+  struct stat st;
+  SERVESLOT *slots, *slot;
+  pid_t pid;
+  mode_t mask;
+  int lfd, i, n;
+  int forkfailed;        /* said so, until a worker starts again          */
+
+  if (workers < 1) {
+    workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) {
+      workers = 1;
+    }
+  }
 
-	case '/': 
-	  x = cpop();
-	  y = cpop();
-	  if (x == 0) {
-	    printf("Tiny -- %lf div by zero! Black hole forming!\n",exlino);
-	    running = FALSE;
-	  } else {
-	    cpush(y/x);
+  lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  /* a socket left by an earlier server, but never any other file */
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+  /* requests name any file to run, and programs may read and write
+     files, so only the user running the server may connect */
+  mask = umask(077);
+  i = lfd < 0 ? -1 : bind(lfd, (struct sockaddr *) &addr, sizeof(addr));
+  umask(mask);
+  if (i < 0 || listen(lfd, 128) < 0) {
+    printf("Tiny can't listen on [%s] \n", path);
+    exit(1);
+  }
+  /* the workers all wait on it, and only one gets each connection */
+  fcntl(lfd, F_SETFL, O_NONBLOCK);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = servestop;
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  fflush(stdout);
+
+  /* shared with the workers, which say when they are busy */
+  n = workers * SERVEJOBS;
+  slots = mmap(NULL, n * sizeof(SERVESLOT), PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (slots == MAP_FAILED) {
+    printf("Tiny can't share memory with workers \n");
+    exit(1);
+  }
+  memset(slots, 0, n * sizeof(SERVESLOT));
+
+  forkfailed = FALSE;
+  while (! servedone) {
+
+    /* start any worker that is not running */
+    for (i = 0; i < n; i++) {
+      if (slots[i].pid == 0) {
+	slot = &slots[i];
+	slot->busy = FALSE;
+	slot->stopped = FALSE;
+	pid = fork();
+	if (pid == 0) {
+	  signal(SIGTERM, SIG_DFL);
+	  signal(SIGINT, SIG_DFL);
+	  serveworker(lfd, slot);
+	}
+	if (pid < 0) {
+	  /* the slot stays free, to be tried again next tick */
+	  if ( ! forkfailed) {
+	    printf("Tiny can't start a worker: %s \n", strerror(errno));
+	    fflush(stdout);
+	    forkfailed = TRUE;
 	  }
 	  break;
+	}
+	forkfailed = FALSE;
+	slot->pid = pid;
+      }
+    }
 
-	case '<': 
-	  x = cpop();
-	  y = cpop();
-	  cpush(y<x);
-	  break;
+    servetick(slots, n, workers);
+    usleep(SERVESLICE * 1000);
 
-	case '>': 
-	  x = cpop();
-	  y = cpop();
-	  cpush(y>x);
-	  break;
+    /* forget any that have finished */
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+      for (i = 0; i < n; i++) {
+	if (slots[i].pid == pid) {
+	  slots[i].pid = 0;
+	}
+      }
+    }
+  }
 
-	case '=': 
-	  cpush(cpop() == cpop());
-	  break;
+  for (i = 0; i < n; i++) {
+    if (slots[i].pid > 0) {
+      kill(slots[i].pid, SIGTERM);
+      kill(slots[i].pid, SIGCONT);
+    }
+  }
+  while (wait(NULL) > 0) {
+  }
+  munmap(slots, n * sizeof(SERVESLOT));
+  close(lfd);
+  unlink(path);
+}
 
 
-	case '&': 
-	  x = logical(cpop());
-	  y = logical(cpop());
-	  if ((x == 1) && (y == 1)) {
-	    cpush(1);
-	  } else {
-	    cpush(0);
-	  }
-	  break;
+/*
+** client
+**
+** fltiny --client /path/sock file.flt  runs a file on a server as if
+** it had been run directly. Lines piped to stdin are sent as input
+** for '?'. From a terminal the request is resumable, and a line is
+** read and sent each time the program asks for one. If the server
+** can't be reached the file is run here; if the file can't be found
+** it is not run at all.
+*/
 
+int client(char path[], char filename[]) {
+
+  struct sockaddr_un addr;
+  char *fullname;
+  char line[256];
+  char buf[4096];
+  char *instring;
+  FILE *in;
+  unsigned long outlen;
+  size_t n;
+  int fd, status, resumable, ended;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  fullname = realpath(filename, NULL);
+  if (fullname == NULL) {
+    printf("Tiny can't open file [%s] \n", filename);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
 
-	case '|': 
-		x = logical(cpop());
-		y = logical(cpop());
-		if ((x == 1) || (y == 1)) {
-			cpush(1);
-		} else {
-			cpush(0);
-		}
-	  break;
+  if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    free(fullname);
+    fprintf(stderr, "Tiny can't reach server [%s], running here\n", path);
+    setup();
+    loadprogram(filename);
+    execprogram();
+    return exitstatus;
+  }
 
+  resumable = isatty(0);
+  if (resumable) {
+    dprintf(fd, "resumable\nprogram %s\nrun\n", fullname);
+  } else {
+    dprintf(fd, "program %s\n", fullname);
+    while ((instring = readtext(stdin)) != NULL) {
+      dprintf(fd, "input %s%s", instring,
+	      strchr(instring, '\n') ? "" : "\n");
+      free(instring);
+    }
+    shutdown(fd, SHUT_WR);
+  }
+  free(fullname);
+
+  /* the output, then either a request for input or the end */
+  in = fdopen(fd, "r");
+  status = 1;
+  ended = FALSE;
+  while ( ! ended && fgets(line, sizeof(line), in) != NULL) {
+    if (sscanf(line, "output %lu", &outlen) == 1) {
+      while (outlen > 0
+	     && (n = fread(buf, 1, outlen < sizeof(buf) ? outlen : sizeof(buf),
+			   in)) > 0) {
+	fwrite(buf, 1, n, stdout);
+	outlen -= n;
+      }
+      fflush(stdout);
+    } else if (strcmp(line, "input\n") == 0) {
+      instring = readtext(stdin);
+      dprintf(fd, "input %s%s", instring != NULL ? instring : "",
+	      instring != NULL && strchr(instring, '\n') ? "" : "\n");
+      free(instring);
+    } else if (sscanf(line, "status %d", &status) == 1) {
+    } else if (strcmp(line, "end\n") == 0) {
+      ended = TRUE;
+    }
+  }
+  fclose(in);
 
-	/* Special Variables */
-	case '~':
-	  if (putget == GET) {
+  if ( ! ended) {
+    fprintf(stderr, "Tiny -- bad answer from server\n");
+    status = 1;
+  }
+  return status;
+}
 
-		  cpush(pipi());
 
-	  } else {
-	    double dx;
-	    x = cpop();
-	    cpush(x);
-	    if (x==0) {
-	      dx = fmod((double) time(NULL) * M_E + M_PI, 1.0);
-	    }
-	    spipi(dx);
-	  }
-	  break;
+/*
+** Engine checking
+**
+** fltiny --difftest n [--seed s] writes n random programs and runs each
+** of them with every engine. The output, the variables and the array
+** must come out byte for byte the same as the reference engine's. A
+** program that does not is cut down, a line and then a word at a time,
+** to the smallest program that still differs, and that is printed.
+**
+** Generated programs use arithmetic, the array, strings and formats,
+** counted loops, forward jumps and the subroutine idiom, plus lines
+** that lean on putget carried over from the line before, and now and
+** then an error part way through a line. Subroutines are often at
+** fractional line numbers such as 5000.5 and 5000.1. Loops only jump
+** back while their counter is above zero, so every program ends.
+*/
 
-	case '?':
-	  if (putget == GET) {
-	    printf("%s",NUMPROMPT);
-	    x = inputnumber();
-	    cpush(x);
-	  } else {
-	    x = cpop();
-	    cpush(x);
-	    printf(numberformat,x);
-	  }
-	  break;
+#define GENLINES   30              /* statements in a generated program */
+#define GENSUBS    3               /* subroutines in a generated program*/
+#define GENARRAY   40              /* array elements generated code uses*/
+#define RUNSECONDS 2               /* a test run taking longer is killed*/
 
-	case '@':
-	  if (putget == GET) {
-	    cpush(exlino);
-	  } else {
+unsigned long genstate;            /* generator random number state     */
+int genints;                       /* TRUE: integers only, for int64    */
+char *genfrac;                     /* after subroutine line numbers     */
 
-	    x = cpop();
-	    cpush(x);
-	    if (x != 0) {
-	      exlino = x;
-	    }
-	  }
-	  break;
+char geninput[] = "3\n1.5\n-2\n7\n0.25\n100\n-0.5\n42\n0\n9\n"
+                  "3\n1.5\n-2\n7\n0.25\n100\n-0.5\n42\n0\n9\n";
 
 
-	case '$':
-	  if (putget == GET) {
-	    cpush(spop());
-	  } else {
-	    x = cpop();
-	    cpush(x);
-	    spush(x);
-	  }
-	  break;
+int genrand(int n) {
 
-	}
-      }
+  genstate = genstate * 6364136223846793005UL + 1442695040888963407UL;
+  return (int) ((genstate >> 33) % n);
+}
+
+
+void genatom(FILE *fp) {
+
+  switch (genrand(8)) {
+  case 0: case 1: fprintf(fp, "%d", genrand(20));                     break;
+  case 2:
+    if (genints) {
+      /* big enough that a few products pass what double holds */
+      fprintf(fp, "%d", 100000 + genrand(900000));
+    } else {
+      fprintf(fp, "%d.%d", genrand(10), genrand(100));
     }
+    break;
+  case 3: case 4: fprintf(fp, "%c", 'a' + genrand(6));                break;
+  case 5:         fprintf(fp, "%d ( )", genrand(GENARRAY));           break;
+  case 6:         fprintf(fp, "%c 2 + ( )", 'i' + genrand(2));        break;
+  case 7:         fprintf(fp, "%c", "ij@~"[genrand(genints ? 3 : 4)]); break;
+  }
+}
 
-    if ( compstackindex < 0) {
-      printf("*** Tiny Comp Stack underflow \n");
-      running = FALSE;
+
+void genexpr(FILE *fp, int depth) {
+
+  if (depth == 0 || genrand(3) == 0) {
+    genatom(fp);
+  } else if (genrand(4) == 0) {
+    genexpr(fp, depth - 1);
+    if (genints || genrand(3) > 0) {
+      fprintf(fp, " %c", "!_%"[genrand(3)]);
+    } else {
+      fprintf(fp, " {%s}", mathnames[genrand(MATH_ATAN + 1)]);
     }
+  } else {
+    genexpr(fp, depth - 1);
+    fprintf(fp, " ");
+    genexpr(fp, depth - 1);
+    fprintf(fp, " %c", (genints ? "+-*<>=&|" : "+-*/^<>=&|")
+	                [genrand(genints ? 8 : 10)]);
+  }
+}
 
 
-  } while ( running );   /* execute do loop */
-   
-} /* execprogram */
+void genstring(FILE *fp) {
 
+  static char *pieces[] = { "ab", "x y", " ", "\\n", "\\t", "\\\\", "\\\"",
+			    "\\.", "\\'", "\\q", "a:b", "1.5", "[x]", "#",
+			    NULL };
+  int i, n, count;
 
-double inputnumber(void) {
+  for (count = 0; pieces[count] != NULL; count++) {
+  }
 
-#define CR '\012'
-#define BS '\000'
+  fprintf(fp, "\"");
+  n = 1 + genrand(3);
+  for (i = 0; i < n; i++) {
+    /* '#' is rare, it leaves the string open. A bare quote is never
+       used: the format it opens takes in later lines and can end up
+       as a conversion printf can not be given a double for */
+    fprintf(fp, "%s", pieces[genrand(genrand(8) == 0 ? count : count - 1)]);
+  }
+  fprintf(fp, "\"");
+}
 
-	double val;
-	char c;
-	int  i;
-	char txtnumber[30];
 
-	i = 0;
-	val = 0;
-	do {
-		c = getchar();
-		if (c == '!') {
-			nowstepping = TRUE;
-			debugging = TRUE;
-			c = CR;
-		}
-		txtnumber[i]   = c;
-		txtnumber[i+1] = 0;
-		i++;
-	} while (c != CR);
-	sscanf(txtnumber,"%lf",&val);
-	return val;
+/*
+** genstatement
+**
+** One simple statement. lino is the line it is on and last is the
+** last line of the main program, for forward jumps.
+*/
+
+void genstatement(FILE *fp, int lino, int last) {
+
+  static char *formats[] = { "'%g '", "'%.3f '", "'%5.1lf'", "'%lf'" };
+  int target, kernel, k;
+
+  switch (genrand(17)) {
+  case 16:
+    /* a subroutine as a task ends when its [$] @ finds nothing */
+    switch (genrand(3)) {
+    case 0:
+      fprintf(fp, "[%d%s] {%s}", 5000 + 100 * genrand(GENSUBS), genfrac,
+	      tasknames[genrand(2)]);
+      break;
+    case 1:
+      fprintf(fp, "{yield}");
+      break;
+    case 2:
+      fprintf(fp, "[{task}] %c", 'a' + genrand(6));
+      break;
+    }
+    break;
+  case 15:
+    /* the views are small, so indexes are often out of bounds */
+    switch (genrand(3)) {
+    case 0:
+      fprintf(fp, "[%d %d {%c}] %c", genrand(3), genrand(3), 'A' + genrand(3),
+	      'a' + genrand(6));
+      break;
+    case 1:
+      fprintf(fp, "[");
+      genexpr(fp, 2);
+      fprintf(fp, " %d %d] {%c}", genrand(3), genrand(3), 'A' + genrand(3));
+      break;
+    case 2:
+      kernel = MATRIX_MATMUL + genrand(MATRIX_COLMAX - MATRIX_MATMUL + 1);
+      fprintf(fp, "{%s", matrixnames[kernel]);
+      for (k = 0; k < matrixviews[kernel]; k++) {
+	fprintf(fp, " %c", 'A' + genrand(3));
+      }
+      fprintf(fp, "}");
+      break;
+    }
+    break;
+  case 14:
+    if ( ! genints) {
+      /* a maths function over part of the array */
+      target = genrand(GENARRAY);
+      fprintf(fp, "[%d %d] {%s}", target, genrand(GENARRAY - target + 1),
+	      mathnames[genrand(MATH_ATAN + 1)]);
+      break;
+    }
+    /* fall through */
+  case 0: case 1: case 2:
+    fprintf(fp, "[");
+    genexpr(fp, 3);
+    fprintf(fp, "] %c", 'a' + genrand(6));
+    break;
+  case 3: case 4:
+    if (genrand(2)) {
+      genstring(fp);
+      fprintf(fp, " ");
+    }
+    fprintf(fp, "[");
+    genexpr(fp, 3);
+    fprintf(fp, "] ?");
+    break;
+  case 5:
+    fprintf(fp, "[");
+    genexpr(fp, 2);
+    if (genrand(2)) {
+      fprintf(fp, "] (%d)", genrand(GENARRAY));
+    } else {
+      fprintf(fp, "] (%c %d +)", 'i' + genrand(2), 2 + genrand(5));
+    }
+    break;
+  case 6:
+    genstring(fp);
+    break;
+  case 7:
+    fprintf(fp, "%s", formats[genrand(4)]);
+    break;
+  case 8:
+    if (genints) {
+      /* 0 _ is -0, which only double has */
+      fprintf(fp, "[%d _] %c", genrand(8), 'a' + genrand(6));
+    } else {
+      fprintf(fp, "[?] %c", 'a' + genrand(6));
+    }
+    break;
+  case 9:
+    /* no '[', carries on putting or getting from the line before */
+    fprintf(fp, "%c %c ?", 'a' + genrand(6), 'a' + genrand(6));
+    break;
+  case 10:
+    fprintf(fp, "[");
+    genexpr(fp, 1);
+    fprintf(fp, " ");
+    genexpr(fp, 1);
+    fprintf(fp, "] %c ? # leaves one behind", 'a' + genrand(6));
+    break;
+  case 11:
+    /* forward jump, or an @ of zero which is ignored */
+    target = lino + 10 * (1 + genrand(3));
+    if (target > last) {
+      target = last;
+    }
+    fprintf(fp, "[");
+    genexpr(fp, 2);
+    fprintf(fp, " %d *] @", genrand(4) == 0 ? 0 : target);
+    break;
+  case 12:
+    fprintf(fp, "[@]$ [%d%s]@", 5000 + 100 * genrand(GENSUBS), genfrac);
+    break;
+  case 13:
+    if (genrand(20) == 0) {
+      /* an error part way through a line, which ends the run there */
+      if (genints) {
+	fprintf(fp, "[%d _ ( )] ? [%c] ?", 1 + genrand(9), 'a' + genrand(6));
+      } else {
+	fprintf(fp, "[%c 0 /] ? [%c] ?", 'a' + genrand(6), 'a' + genrand(6));
+      }
+      break;
+    }
+    fprintf(fp, "[");
+    genexpr(fp, 2);
+    fprintf(fp, "] %c %c", 'a' + genrand(6), 'a' + genrand(6));
+    break;
+  }
 }
 
 
-void saveprogram(char filename[20]) {
+/*
+** genprogram
+**
+** Write a random program. The result is malloc'd.
+*/
+
+char *genprogram(void) {
 
+  static char *fracs[] = { "", ".5", ".1" };
+  char *text;
+  size_t len;
   FILE *fp;
-  long i;
+  int lino, last, i, s, n, r, c;
+  int loopstart[2];      /* first body line of open loops                 */
+  int loopleft[2];       /* statements left in open loops                 */
+  int depth;             /* loops open                                    */
+
+  fp = open_memstream(&text, &len);
+
+  /* seed and starting variables */
+  genints = genrand(2) == 0;
+  genfrac = genints ? "" : fracs[genrand(3)];
+  if (genints) {
+    fprintf(fp, "0010 [%d] ~ '%%g '", 1 + genrand(99));
+    for (i = 0; i < 6; i++) {
+      fprintf(fp, " [%d] %c", genrand(100), 'a' + i);
+    }
+  } else {
+    fprintf(fp, "0010 [0.%d] ~ '%%g '", 1 + genrand(99));
+    for (i = 0; i < 6; i++) {
+      fprintf(fp, " [%d.%d] %c", genrand(10), genrand(10), 'a' + i);
+    }
+  }
 
-  /* Set listing format */
-  formatlisting();
+  /* A and B square and the same size, so that kernels often fit */
+  r = 1 + genrand(3);
+  c = 1 + genrand(3);
+  fprintf(fp, " [%d %d %d %d] {view A}", genrand(GENARRAY - 12), r, r, r);
+  fprintf(fp, " [%d %d %d %d] {view B}", genrand(GENARRAY - 12), r, r,
+	  r + genrand(2));
+  fprintf(fp, " [%d %d %d %d] {view C}", genrand(GENARRAY - 12), r, c, c);
+  fprintf(fp, "\n");
+
+  last = 100 + 10 * GENLINES;
+  depth = 0;
+  for (lino = 100; lino < last; lino += 10) {
+
+    if (depth > 0 && loopleft[depth - 1] == 0) {
+      /* close the innermost loop */
+      depth--;
+      fprintf(fp, "%04d [%c 1 -] %c [%c 0 > %d *] @\n", lino,
+	      'i' + depth, 'i' + depth, 'i' + depth, loopstart[depth]);
+      continue;
+    }
 
-  fp = fopen(filename,"w");
-  for (i = 0; i < laststep; i++) {
-    fprintf(fp,listformat,progmem[i].lino,progmem[i].text);
+    if (depth < 2 && lino + 40 < last && genrand(6) == 0) {
+      /* open a loop */
+      fprintf(fp, "%04d [%d] %c\n", lino, 1 + genrand(4), 'i' + depth);
+      loopstart[depth] = lino + 10;
+      loopleft[depth] = 1 + genrand(3);
+      if (depth > 0 && loopleft[depth] >= loopleft[depth - 1]) {
+	loopleft[depth] = loopleft[depth - 1] - 1;
+      }
+      if (loopleft[depth] > 0) {
+	depth++;
+      }
+      continue;
+    }
+
+    fprintf(fp, "%04d ", lino);
+    genstatement(fp, lino, last);
+    fprintf(fp, "\n");
+    for (i = 0; i < depth; i++) {
+      loopleft[i]--;
+    }
+  }
+  fprintf(fp, "%04d :\n", last);
+
+  /* subroutines, straight line code ending in the return */
+  for (s = 0; s < GENSUBS; s++) {
+    n = 1 + genrand(3);
+    for (i = 0; i < n; i++) {
+      fprintf(fp, "%04d%s ", 5000 + 100 * s + 10 * i, genfrac);
+      switch (genrand(3)) {
+      case 0:
+	fprintf(fp, "[");
+	genexpr(fp, 2);
+	fprintf(fp, "] %c", 'a' + genrand(6));
+	break;
+      case 1:
+	fprintf(fp, "[");
+	genexpr(fp, 2);
+	fprintf(fp, "] ?");
+	break;
+      case 2:
+	genstring(fp);
+	break;
+      }
+      fprintf(fp, "\n");
+    }
+    fprintf(fp, "%04d%s [$] @\n", 5000 + 100 * s + 10 * n, genfrac);
   }
+
   fclose(fp);
+  return text;
+}
+
+
+/*
+** runfor
+**
+** Run program text with one engine in a child process, so that a
+** crash or a runaway is contained. Returns in one malloc'd buffer all
+** the run leaves behind: its output, the variables, the array and how
+** the process ended.
+*/
+
+char *runfor(char text[], int eng, long *len) {
+
+  int fds[2];
+  pid_t pid;
+  FILE *fp;
+  char *out, *res;
+  size_t outlen;
+  int status;
+
+  fflush(stdout);
+  if (pipe(fds) < 0) {
+    printf("Tiny -- can't make a pipe\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    alarm(RUNSECONDS);
+    engine = eng;
+    setup();
+    if (strlen(text) > 0) {
+      fp = fmemopen(text, strlen(text), "r");
+      loadstream(fp);
+      fclose(fp);
+    }
+    stdin = fmemopen(geninput, strlen(geninput), "r");
+    stdout = open_memstream(&out, &outlen);
+    execprogram();
+    fclose(stdout);
+    writeall(fds[1], out, outlen);
+    /* a to z and the accumulator, not the optimizer's registers */
+    writeall(fds[1], (char *) varz, 27 * sizeof(double));
+    writeall(fds[1], (char *) darray, arrayelements * sizeof(double));
+    _exit(0);
+  }
+
+  close(fds[1]);
+  res = readall(fds[0], len);
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+
+  res = realloc(res, *len + sizeof(status));
+  memcpy(res + *len, &status, sizeof(status));
+  *len += sizeof(status);
+  return res;
+}
+
+
+/*
+** differs
+**
+** Returns the first engine whose run of text differs from the
+** reference engine, or -1 if they all agree.
+*/
+
+int differs(char text[]) {
+
+  char *ref, *res;
+  long reflen, reslen;
+  int e, found;
+
+  ref = runfor(text, ENGINE_REFERENCE, &reflen);
+  found = -1;
+  for (e = 0; enginenames[e] != NULL && found < 0; e++) {
+    if (e != ENGINE_REFERENCE && engineexact[e]) {
+      res = runfor(text, e, &reslen);
+      if (reslen != reflen || memcmp(res, ref, reflen) != 0) {
+	found = e;
+      }
+      free(res);
+    }
+  }
+  free(ref);
+  return found;
+}
+
+
+/*
+** shrink
+**
+** Cut a differing program down: drop each line, then each word after
+** the line number, keeping every cut that still differs.
+*/
+
+char *shrink(char text[]) {
+
+  char *best, *try, *p, *q;
+  long len;
+  int changed;
+  long pos;
+
+  best = strdup(text);
+  do {
+    changed = FALSE;
+
+    /* whole lines */
+    for (p = best; *p != '\0'; ) {
+      q = strchr(p, '\n');
+      q = (q == NULL) ? p + strlen(p) : q + 1;
+      len = strlen(best) - (q - p);
+      try = malloc(len + 1);
+      memcpy(try, best, p - best);
+      strcpy(try + (p - best), q);
+      if (differs(try) >= 0) {
+	pos = p - best;
+	free(best);
+	best = try;
+	p = best + pos;
+	changed = TRUE;
+      } else {
+	free(try);
+	p = q;
+      }
+    }
+
+    /* words, but not line numbers */
+    for (p = best; *p != '\0'; ) {
+      if (*p == ' ' && p > best && p[-1] != '\n') {
+	for (q = p + 1; *q != '\0' && *q != ' ' && *q != '\n'; q++) {
+	}
+	if (q > p + 1) {
+	  len = strlen(best) - (q - p);
+	  try = malloc(len + 1);
+	  memcpy(try, best, p - best);
+	  strcpy(try + (p - best), q);
+	  if (differs(try) >= 0) {
+	    pos = p - best;
+	    free(best);
+	    best = try;
+	    p = best + pos;
+	    changed = TRUE;
+	    continue;
+	  }
+	  free(try);
+	}
+      }
+      p++;
+    }
+  } while (changed);
+
+  return best;
+}
+
+
+/*
+** difftest
+**
+** Check count random programs. Returns 0 if every engine agreed.
+*/
+
+int difftest(long count, unsigned long seed) {
+
+  char *text, *small;
+  long n;
+  int e;
+
+  /* engines that round differently are run, but not compared */
+  printf("difftest: %ld programs, seed %lu, engines compared:", count, seed);
+  for (e = 0; enginenames[e] != NULL; e++) {
+    if (engineexact[e]) {
+      printf(" %s", enginenames[e]);
+    }
+  }
+  printf(", run only:");
+  for (e = 0; enginenames[e] != NULL; e++) {
+    if ( ! engineexact[e]) {
+      printf(" %s", enginenames[e]);
+    }
+  }
+  printf("\n");
+
+  genstate = seed;
+  for (n = 1; n <= count; n++) {
+    text = genprogram();
+    e = differs(text);
+    if (e >= 0) {
+      printf("difftest: program %ld, %s differs from reference\n",
+	     n, enginenames[e]);
+      small = shrink(text);
+      e = differs(small);
+      printf("difftest: smallest program that differs ( %s ):\n%s",
+	     enginenames[e < 0 ? 0 : e], small);
+      free(small);
+      free(text);
+      return 1;
+    }
+    free(text);
+  }
+
+  printf("difftest: all engines compared agree\n");
+  return 0;
 }
 
+
 void helpscreen(void) {
   printf("\033[2J\033[0;0H");
   printf("Floating Point Tiny Help                                                       \n");
@@ -1219,9 +12051,12 @@ void helpscreen(void) {
   printf("#n               New  - Clear program memory and variables      \n");
   printf("#b               Bye  - Exit tiny                               \n");
   printf("#o filename      Old  - Load a program file into tiny           \n");
+  printf("#i file first last  Include a unit of lines first to last      \n");
   printf("#?               Help - Print this help screen                  \n");
   printf("#r               Run  - Begin executing current program         \n");
   printf("#k t|b|n lino    Breakpoint (trace, break, none) set breakpoint \n");
+  printf("[x] ?            No line number - run the line now              \n");
+  printf("{sqrt} {view A}  Maths functions and matrices, see README       \n");
   printf("=============================================================== \n");
   printf("\n\n");
 }